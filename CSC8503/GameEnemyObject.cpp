@@ -28,9 +28,9 @@ void InitializePatrolPoints() {
 
 int currentPatrolIndex = 0;
 
-GameEnemyObject::GameEnemyObject(NavigationGrid *grid, GamePlayerObject *gameObject) {
+GameEnemyObject::GameEnemyObject(PathRequestQueue *pathRequests, GamePlayerObject *gameObject) {
 
-    this->grid = grid;
+    this->pathRequests = pathRequests;
     this->target = gameObject;
     this->stateMachine = new StateMachine();
     counter = 20.0f;
@@ -90,6 +90,7 @@ GameEnemyObject::GameEnemyObject(NavigationGrid *grid, GamePlayerObject *gameObj
 }
 
 GameEnemyObject::~GameEnemyObject() {
+    pathRequests->Cancel(pathRequest); //the callback would point at a deleted object
     delete stateMachine;
 }
 
@@ -120,12 +121,15 @@ void GameEnemyObject::MoveToTarget(float dt) {
 }
 
 void GameEnemyObject::CalculatePath() {
-    pathToTarget.clear();
-    NavigationPath outPath;
     if (target == nullptr) return;
-    bool found = grid->FindPath(GetTransform().GetPosition(), target->GetTransform().GetPosition(), outPath);
-    Vector3 pos;
-    while (outPath.PopWaypoint(pos)) {
-        pathToTarget.push_back(pos);
-    }
+    pathRequests->Cancel(pathRequest); //a newer path makes the one still on its way out of date
+    pathRequest = pathRequests->RequestPath(GetTransform().GetPosition(), target->GetTransform().GetPosition(),
+                                            [this](bool found, NavigationPath &outPath) {
+        pathRequest = 0;
+        pathToTarget.clear();
+        Vector3 pos;
+        while (outPath.PopWaypoint(pos)) {
+            pathToTarget.push_back(pos);
+        }
+    });
 }
\ No newline at end of file
@@ -9,13 +9,14 @@
 #include "State.h"
 #include "StateMachine.h"
 #include "NavigationGrid.h"
+#include "PathRequestQueue.h"
 #include "GamePlayerObject.h"
 
 namespace NCL {
     namespace CSC8503 {
         class GameEnemyObject : public GameObject {
         public:
-            GameEnemyObject(NavigationGrid *grid, GamePlayerObject *target);
+            GameEnemyObject(PathRequestQueue *pathRequests, GamePlayerObject *target);
 
             ~GameEnemyObject();
 
@@ -37,7 +38,8 @@ namespace NCL {
 
 
             GamePlayerObject *target; //todo PlayerObject?
-            NavigationGrid *grid;
+            PathRequestQueue *pathRequests;
+            int pathRequest = 0; //ticket for the path we're still waiting on, if any
             std::vector<Vector3> pathToTarget;
             float counter;
 
@@ -25,9 +25,9 @@ void GameGooseObject::InitializePatrolPoints() {
 
 
 
-GameGooseObject::GameGooseObject(NavigationGrid *grid, GamePlayerObject *gameObject) {
+GameGooseObject::GameGooseObject(PathRequestQueue *pathRequests, GamePlayerObject *gameObject) {
 
-    this->grid = grid;
+    this->pathRequests = pathRequests;
     this->target = gameObject;
     this->stateMachine = new StateMachine();
     counter = 20.0f;
@@ -75,6 +75,7 @@ GameGooseObject::GameGooseObject(NavigationGrid *grid, GamePlayerObject *gameObj
 }
 
 GameGooseObject::~GameGooseObject() {
+    pathRequests->Cancel(pathRequest); //the callback would point at a deleted object
     delete stateMachine;
 }
 
@@ -116,13 +117,14 @@ void GameGooseObject::MoveToTarget(float dt) {
 void GameGooseObject::CalculatePath() {
  //   Vector3 dir = this->GetTransform().GetPosition();
   //  std::cout<<"this->GetTransform().GetPosition():"<<this->GetTransform().GetPosition()<<std::endl;
-    pathToTarget.clear();
-    NavigationPath outPath;
-    bool found = grid->FindPath(GetTransform().GetPosition(), target->GetTransform().GetPosition(), outPath);
- //   bool found = grid->FindPath(GetTransform().GetPosition(), Vector3(220,-11,240), outPath);
-    Vector3 pos;
-    while (outPath.PopWaypoint(pos)) {
-        pathToTarget.push_back(pos);
-    }
-
+    pathRequests->Cancel(pathRequest); //a newer path makes the one still on its way out of date
+    pathRequest = pathRequests->RequestPath(GetTransform().GetPosition(), target->GetTransform().GetPosition(),
+                                            [this](bool found, NavigationPath &outPath) {
+        pathRequest = 0;
+        pathToTarget.clear();
+        Vector3 pos;
+        while (outPath.PopWaypoint(pos)) {
+            pathToTarget.push_back(pos);
+        }
+    });
 }
\ No newline at end of file
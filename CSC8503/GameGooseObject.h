@@ -9,13 +9,14 @@
 #include "State.h"
 #include "StateMachine.h"
 #include "NavigationGrid.h"
+#include "PathRequestQueue.h"
 #include "GamePlayerObject.h"
 
 namespace NCL {
     namespace CSC8503 {
         class GameGooseObject : public GameObject {
         public:
-            GameGooseObject(NavigationGrid *grid, GamePlayerObject *target);
+            GameGooseObject(PathRequestQueue *pathRequests, GamePlayerObject *target);
 
             ~GameGooseObject();
             void InitializePatrolPoints();
@@ -35,7 +36,8 @@ namespace NCL {
             virtual void Update(float dt);
 
             GamePlayerObject *target;
-            NavigationGrid *grid;
+            PathRequestQueue *pathRequests;
+            int pathRequest = 0; //ticket for the path we're still waiting on, if any
 
             float counter;
 
@@ -21,8 +21,7 @@ NCL::CSC8503::OBBGameObject::OBBGameObject(TutorialGame& gGame, Vector3 position
     renderObject->SetColour(color);
 
     physicsObject = new PhysicsObject(&transform, boundingVolume);
-    physicsObject->SetInverseMass(0);
-    physicsObject->InitCubeInertia();
+    physicsObject->SetBodyType(BodyType::Static);
 }
 
 void NCL::CSC8503::OBBGameObject::OnCollisionBegin(GameObject* otherObject)
@@ -94,6 +94,8 @@ TutorialGame::TutorialGame() : controller(*Window::GetWindow()->GetKeyboard(), *
 #endif
 
     physics = new PhysicsSystem(*world);
+    // pickups only need to know when the player touches them
+    physics->SetLayerCollisionMask(PickupLayer, 1u << PlayerLayer);
 
     forceMagnitude = 10.0f;
     useGravity = true;
@@ -145,6 +147,8 @@ TutorialGame::~TutorialGame() {
     delete physics;
     delete renderer;
     delete world;
+    delete pathRequests; //after the world, as the enemies cancel their requests as they're deleted
+    delete grid;
 
 }
 
@@ -275,6 +279,7 @@ void TutorialGame::UpdateGame(float dt) {
     world->UpdateWorld(dt);
     renderer->Update(dt);
     physics->Update(dt);
+    pathRequests->Update();
 
     if (testStateObject && cylinderStateObject) {
         cylinderStateObject->Update(dt);
@@ -480,8 +485,7 @@ GameObject *TutorialGame::AddFloorToWorld(const Vector3 &position, std::string n
     floor->SetRenderObject(new RenderObject(&floor->GetTransform(), cubeMesh, basicTex, basicShader));
     floor->SetPhysicsObject(new PhysicsObject(&floor->GetTransform(), floor->GetBoundingVolume()));
 
-    floor->GetPhysicsObject()->SetInverseMass(0);
-    floor->GetPhysicsObject()->InitCubeInertia();
+    floor->GetPhysicsObject()->SetBodyType(BodyType::Static);
 
   // floor->GetPhysicsObject()->SetCollisionType(CollisionType::Spring);
 
@@ -537,6 +541,11 @@ TutorialGame::AddCoinToWorldWithColor(const Vector3 &position, float radius, flo
 
     sphere->GetPhysicsObject()->SetInverseMass(inverseMass);
     sphere->GetPhysicsObject()->InitSphereInertia();
+    sphere->GetPhysicsObject()->SetTrigger(true);
+    if (inverseMass == 0.0f) {
+        sphere->GetPhysicsObject()->SetBodyType(BodyType::Static);
+    }
+    sphere->SetLayer(PickupLayer);
 
     sphere->GetRenderObject()->SetColour(color);
     world->AddGameObject(sphere);
@@ -560,6 +569,9 @@ TutorialGame::AddCubeToWorld(const Vector3 &position, Vector3 dimensions, float
 
     cube->GetPhysicsObject()->SetInverseMass(inverseMass);
     cube->GetPhysicsObject()->InitCubeInertia();
+    if (inverseMass == 0.0f) {
+        cube->GetPhysicsObject()->SetBodyType(BodyType::Static); // the maze walls
+    }
 
     world->AddGameObject(cube);
 
@@ -838,6 +850,7 @@ void TutorialGame::InitMazeWorld() {
 
     if (grid == nullptr) {
         grid = new NavigationGrid("TestGrid3.txt");
+        pathRequests = new PathRequestQueue(*grid);
     }
 
     int **gridSquare = grid->GetGrid();
@@ -880,6 +893,7 @@ void TutorialGame::InitGamePlayerObject() {
 
     player->GetPhysicsObject()->SetInverseMass(inverseMass);
     player->GetPhysicsObject()->InitSphereInertia();
+    player->SetLayer(PlayerLayer);
 
     player->GetRenderObject()->SetColour(Debug::MAGENTA);
 
@@ -964,7 +978,7 @@ GameEnemyObject *TutorialGame::AddGameEnemyObject(Vector3 position) {
     float meshSize = 7.0f;
     float inverseMass = 5.0f;
 
-    GameEnemyObject *character = new GameEnemyObject(grid, player);
+    GameEnemyObject *character = new GameEnemyObject(pathRequests, player);
 
     character->SetName("EnemyPlayer");
     AABBVolume *volume = new AABBVolume(Vector3(0.3f, 0.9f, 0.3f) * meshSize);
@@ -992,7 +1006,7 @@ GameGooseObject *TutorialGame::AddGameGooseObject(Vector3 position) {
     float meshSize = 2.0f;
     float inverseMass = 5.0f;
 
-    GameGooseObject *character = new GameGooseObject(grid, player);
+    GameGooseObject *character = new GameGooseObject(pathRequests, player);
 
     character->SetName("GoosePlayer");
     AABBVolume *volume = new AABBVolume(Vector3(0.3f, 0.9f, 0.3f) * meshSize);
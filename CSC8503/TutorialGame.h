@@ -11,6 +11,7 @@
 #include "GamePlayerFollowCamera.h"
 #include "PhysicsSystem.h"
 #include "NavigationGrid.h"
+#include "PathRequestQueue.h"
 #include "StateGameObject.h"
 #include "GamePlayerObject.h"
 #include "OBBGameObject.h"
@@ -22,6 +23,13 @@
 #include "../CSC8503CoreClasses/PushdownState.h"
 namespace NCL {
     namespace CSC8503 {
+        //Collision layers, see PhysicsSystem::SetLayerCollision
+        enum GameLayers {
+            DefaultLayer = 0,
+            PlayerLayer = 1,
+            PickupLayer = 2
+        };
+
         class TutorialGame {
         public:
             TutorialGame();
@@ -160,7 +168,8 @@ namespace NCL {
 
             GameObject *objClosest = nullptr;
 
-            NavigationGrid *grid;
+            NavigationGrid *grid = nullptr;
+            PathRequestQueue *pathRequests = nullptr;
 
 
 
@@ -3,12 +3,20 @@
 #include "AABBVolume.h"
 #include "OBBVolume.h"
 #include "SphereVolume.h"
+#include "GJK.h"
+#include "ConvexHullVolume.h"
+#include "TriangleMeshVolume.h"
 #include "Window.h"
 #include "Maths.h"
 #include "Debug.h"
 #include <algorithm>
 #include "Vector3.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define COLLISION_USE_SSE
+#include <emmintrin.h>
+#endif
+
 using namespace NCL;
 
 bool CollisionDetection::RayPlaneIntersection(const Ray &r, const Plane &p, RayCollision &collisions) {
@@ -53,6 +61,10 @@ bool CollisionDetection::RayIntersection(const Ray &r, GameObject &object, RayCo
         case VolumeType::Capsule:
             hasCollided = RayCapsuleIntersection(r, worldTransform, (const CapsuleVolume &) *volume, collision);
             break;
+        case VolumeType::ConvexHull:
+        case VolumeType::Mesh:
+            hasCollided = RayMeshIntersection(r, worldTransform, *volume, collision);
+            break;
     }
 
     return hasCollided;
@@ -91,6 +103,75 @@ bool CollisionDetection::RayBoxIntersection(const Ray &r, const Vector3 &boxPos,
     return true;
 }
 
+/*
+Sweeping one box against another is the same as casting its centre
+point against a box grown by both sets of half sizes - where the ray
+enters on the last axis is where the boxes first touch.
+*/
+bool CollisionDetection::SweptAABBIntersection(const Vector3 &startA, const Vector3 &halfSizeA, const Vector3 &motion,
+                                               const Vector3 &posB, const Vector3 &halfSizeB, float &timeOfImpact,
+                                               Vector3 &normal) {
+    Vector3 boxMin = posB - halfSizeA - halfSizeB;
+    Vector3 boxMax = posB + halfSizeA + halfSizeB;
+
+    float tEnter = -FLT_MAX;
+    float tExit = FLT_MAX;
+    int enterAxis = -1;
+
+    for (int i = 0; i < 3; ++i) {
+        if (motion[i] == 0.0f) {
+            if (startA[i] < boxMin[i] || startA[i] > boxMax[i]) {
+                return false; // never going to line up on this axis
+            }
+            continue;
+        }
+        float t0 = (boxMin[i] - startA[i]) / motion[i];
+        float t1 = (boxMax[i] - startA[i]) / motion[i];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        if (t0 > tEnter) {
+            tEnter = t0;
+            enterAxis = i;
+        }
+        tExit = std::min(tExit, t1);
+    }
+    if (enterAxis < 0 || tEnter > tExit || tEnter < 0.0f || tEnter > 1.0f) {
+        return false; // missed, already overlapping, or too far away this step
+    }
+    normal = Vector3();
+    normal[enterAxis] = motion[enterAxis] > 0.0f ? -1.0f : 1.0f;
+    timeOfImpact = tEnter;
+    return true;
+}
+
+bool CollisionDetection::SweptSphereIntersection(const Vector3 &startA, float radiusA, const Vector3 &motion,
+                                                 const Vector3 &posB, float radiusB, float &timeOfImpact,
+                                                 Vector3 &normal) {
+    Vector3 delta = startA - posB;
+    float radii = radiusA + radiusB;
+
+    // solve |delta + motion * t| = radii for the smallest t
+    float a = Vector3::Dot(motion, motion);
+    float b = Vector3::Dot(delta, motion);
+    float c = Vector3::Dot(delta, delta) - radii * radii;
+
+    if (c < 0.0f || b >= 0.0f || a == 0.0f) {
+        return false; // already overlapping, or not heading towards each other
+    }
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+    float t = (-b - sqrt(discriminant)) / a;
+    if (t > 1.0f) {
+        return false;
+    }
+    timeOfImpact = t;
+    normal = (delta + motion * t).Normalised();
+    return true;
+}
+
 bool CollisionDetection::RayAABBIntersection(const Ray &r, const Transform &worldTransform, const AABBVolume &volume,
                                              RayCollision &collision) {
 
@@ -175,6 +256,74 @@ bool CollisionDetection::RayCapsuleIntersection(const Ray& r, const Transform& w
     sphereTransform.SetScale(Vector3(volume.GetRadius(), volume.GetRadius(), volume.GetRadius()));
     return RaySphereIntersection(r, sphereTransform, sphere, collision);
 }
+//Moller-Trumbore - distance is how far along the ray it hits the triangle, from either side
+bool CollisionDetection::RayTriangleIntersection(const Vector3 &origin, const Vector3 &direction, const Vector3 &a,
+                                                 const Vector3 &b, const Vector3 &c, float &distance) {
+    Vector3 ab = b - a;
+    Vector3 ac = c - a;
+    Vector3 p = Vector3::Cross(direction, ac);
+    float det = Vector3::Dot(ab, p);
+    if (fabs(det) < 1e-8f) {
+        return false; // parallel to the triangle
+    }
+    float invDet = 1.0f / det;
+    Vector3 toOrigin = origin - a;
+    float u = Vector3::Dot(toOrigin, p) * invDet;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    Vector3 q = Vector3::Cross(toOrigin, ab);
+    float v = Vector3::Dot(direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    distance = Vector3::Dot(ac, q) * invDet;
+    return distance >= 0.0f;
+}
+
+/*
+Convex hulls and triangle meshes are both tested triangle by triangle, in the
+volume's local space. Meshes use their tree to skip most of them, while hulls
+are small enough to just test them all.
+*/
+bool CollisionDetection::RayMeshIntersection(const Ray &r, const Transform &worldTransform,
+                                             const CollisionVolume &volume, RayCollision &collision) {
+    Quaternion orientation = worldTransform.GetOrientation();
+    Vector3 position = worldTransform.GetPosition();
+
+    Matrix3 transform = Matrix3(orientation);
+    Matrix3 invTransform = Matrix3(orientation.Conjugate());
+
+    Vector3 localPos = invTransform * (r.GetPosition() - position);
+    Vector3 localDir = invTransform * r.GetDirection();
+
+    float distance = FLT_MAX;
+    Vector3 normal;
+    bool hit = false;
+
+    if (volume.type == VolumeType::Mesh) {
+        hit = ((const TriangleMeshVolume &) volume).RayCast(localPos, localDir, FLT_MAX, distance, normal);
+    } else {
+        const std::vector<Vector3> &triangles = ((const ConvexHullVolume &) volume).GetTriangles();
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            float triDistance;
+            if (RayTriangleIntersection(localPos, localDir, triangles[i], triangles[i + 1], triangles[i + 2], triDistance) &&
+                triDistance < distance) {
+                distance = triDistance;
+                normal = Vector3::Cross(triangles[i + 1] - triangles[i], triangles[i + 2] - triangles[i]).Normalised();
+                hit = true;
+            }
+        }
+    }
+    if (!hit) {
+        return false;
+    }
+    collision.rayDistance = distance;
+    collision.collidedAt = r.GetPosition() + r.GetDirection() * distance;
+    collision.collidedNormal = transform * normal;
+    return true;
+}
+
 bool CollisionDetection::ObjectIntersection(GameObject *a, GameObject *b, CollisionInfo &collisionInfo) {
     const CollisionVolume *volA = a->GetBoundingVolume();
     const CollisionVolume *volB = b->GetBoundingVolume();
@@ -186,11 +335,31 @@ bool CollisionDetection::ObjectIntersection(GameObject *a, GameObject *b, Collis
     collisionInfo.a = a;
     collisionInfo.b = b;
 
-    Transform &transformA = a->GetTransform();
-    Transform &transformB = b->GetTransform();
+    return VolumeIntersection(volA, a->GetTransform(), volB, b->GetTransform(), collisionInfo);
+}
+
+/*
+The same tests, for volumes that don't have to belong to a GameObject (the
+shape queries use this). Whenever the pair has to be tested the other way
+around, a and b are swapped in the collision info to match.
 
+Only the cheap sphere and AABB pairs, and box pairs (the most common
+expensive pair, thanks to stacks of crates), have their own tests now.
+*/
+bool CollisionDetection::VolumeIntersection(const CollisionVolume *volA, const Transform &transformA,
+                                            const CollisionVolume *volB, const Transform &transformB,
+                                            CollisionInfo &collisionInfo) {
     VolumeType pairType = (VolumeType) ((int) volA->type | (int) volB->type);
 
+    //Triangle meshes, against anything but another mesh
+    if (volA->type == VolumeType::Mesh && volB->type != VolumeType::Mesh) {
+        return MeshIntersection((const TriangleMeshVolume &) *volA, transformA, volB, transformB, collisionInfo);
+    }
+    if (volB->type == VolumeType::Mesh && volA->type != VolumeType::Mesh) {
+        std::swap(collisionInfo.a, collisionInfo.b);
+        return MeshIntersection((const TriangleMeshVolume &) *volB, transformB, volA, transformA, collisionInfo);
+    }
+
     //Two AABBs
     if (pairType == VolumeType::AABB) {
         return AABBIntersection((AABBVolume &) *volA, transformA, (AABBVolume &) *volB, transformB, collisionInfo);
@@ -200,23 +369,13 @@ bool CollisionDetection::ObjectIntersection(GameObject *a, GameObject *b, Collis
         return SphereIntersection((SphereVolume &) *volA, transformA, (SphereVolume &) *volB, transformB,
                                   collisionInfo);
     }
-    //Two OBBs
-    if (pairType == VolumeType::OBB) {
-        return OBBIntersection((OBBVolume &) *volA, transformA, (OBBVolume &) *volB, transformB, collisionInfo);
-    }
-    //Two Capsules
-    if (pairType == VolumeType::Capsule) {
-        return CapsuleIntersection((CapsuleVolume&)*volA, transformA, (CapsuleVolume&)*volB, transformB, collisionInfo);
-    }
-
     //AABB vs Sphere pairs
     if (volA->type == VolumeType::AABB && volB->type == VolumeType::Sphere) {
         return AABBSphereIntersection((AABBVolume &) *volA, transformA, (SphereVolume &) *volB, transformB,
                                       collisionInfo);
     }
     if (volA->type == VolumeType::Sphere && volB->type == VolumeType::AABB) {
-        collisionInfo.a = b;
-        collisionInfo.b = a;
+        std::swap(collisionInfo.a, collisionInfo.b);
         return AABBSphereIntersection((AABBVolume &) *volB, transformB, (SphereVolume &) *volA, transformA,
                                       collisionInfo);
     }
@@ -227,8 +386,7 @@ bool CollisionDetection::ObjectIntersection(GameObject *a, GameObject *b, Collis
                                      collisionInfo);
     }
     if (volA->type == VolumeType::Sphere && volB->type == VolumeType::OBB) {
-        collisionInfo.a = b;
-        collisionInfo.b = a;
+        std::swap(collisionInfo.a, collisionInfo.b);
         return OBBSphereIntersection((OBBVolume &) *volB, transformB, (SphereVolume &) *volA, transformA,
                                      collisionInfo);
     }
@@ -239,22 +397,80 @@ bool CollisionDetection::ObjectIntersection(GameObject *a, GameObject *b, Collis
                                          collisionInfo);
     }
     if (volA->type == VolumeType::Sphere && volB->type == VolumeType::Capsule) {
-        collisionInfo.a = b;
-        collisionInfo.b = a;
+        std::swap(collisionInfo.a, collisionInfo.b);
         return SphereCapsuleIntersection((CapsuleVolume &) *volB, transformB, (SphereVolume &) *volA, transformA,
                                          collisionInfo);
     }
 
-    if (volA->type == VolumeType::Capsule && volB->type == VolumeType::AABB) {
-        return AABBCapsuleIntersection((AABBVolume&)*volB, transformB, (CapsuleVolume&)*volA, transformA, collisionInfo);
+    //Boxes of either kind go through the separating axis test
+    if (pairType == VolumeType::OBB) {
+        return OBBIntersection((OBBVolume &) *volA, transformA, (OBBVolume &) *volB, transformB, collisionInfo);
     }
-    if (volA->type == VolumeType::AABB && volB->type == VolumeType::Capsule) {
-        collisionInfo.a = b;
-        collisionInfo.b = a;
-        return AABBCapsuleIntersection((AABBVolume&)*volA, transformA, (CapsuleVolume&)*volB, transformB, collisionInfo);
+    if (pairType == (VolumeType) ((int) VolumeType::AABB | (int) VolumeType::OBB)) {
+        Matrix3 rotA = volA->type == VolumeType::OBB ? Matrix3(transformA.GetOrientation()) : Matrix3();
+        Matrix3 rotB = volB->type == VolumeType::OBB ? Matrix3(transformB.GetOrientation()) : Matrix3();
+        Vector3 halfA = volA->type == VolumeType::OBB ? ((OBBVolume &) *volA).GetHalfDimensions() : ((AABBVolume &) *volA).GetHalfDimensions();
+        Vector3 halfB = volB->type == VolumeType::OBB ? ((OBBVolume &) *volB).GetHalfDimensions() : ((AABBVolume &) *volB).GetHalfDimensions();
+        return BoxIntersection(transformA.GetPosition(), rotA, halfA, transformB.GetPosition(), rotB, halfB, collisionInfo);
     }
 
-    return false;
+    //Every other convex pair goes through GJK / EPA, which only needs each shape's support function
+    const int convexTypes = (int) VolumeType::AABB | (int) VolumeType::OBB | (int) VolumeType::Sphere |
+                            (int) VolumeType::Capsule | (int) VolumeType::ConvexHull;
+    if (((int) pairType & ~convexTypes) != 0) {
+        return false;
+    }
+    return GJK::Intersection(ConvexShape(volA, transformA), ConvexShape(volB, transformB), collisionInfo);
+}
+
+/*
+Each triangle near the other volume is treated as a tiny convex shape of its
+own, and tested with GJK. The manifold keeps the deepest points across all
+of them. The other volume's box is worked out along the mesh's own axes, so
+the triangle tree can be queried in local space.
+*/
+bool CollisionDetection::MeshIntersection(const TriangleMeshVolume &mesh, const Transform &meshTransform,
+                                          const CollisionVolume *other, const Transform &otherTransform,
+                                          CollisionInfo &collisionInfo) {
+    const int convexTypes = (int) VolumeType::AABB | (int) VolumeType::OBB | (int) VolumeType::Sphere |
+                            (int) VolumeType::Capsule | (int) VolumeType::ConvexHull;
+    if (((int) other->type & ~convexTypes) != 0) {
+        return false;
+    }
+    ConvexShape otherShape(other, otherTransform);
+
+    Matrix3 meshRotation = Matrix3(meshTransform.GetOrientation());
+    Vector3 meshPosition = meshTransform.GetPosition();
+    TreeAABB localBox;
+    for (int i = 0; i < 3; ++i) {
+        Vector3 axis = meshRotation.GetColumn(i);
+        localBox.max[i] = Vector3::Dot(axis, otherShape.SupportWithMargin(axis) - meshPosition);
+        localBox.min[i] = Vector3::Dot(axis, otherShape.SupportWithMargin(-axis) - meshPosition);
+    }
+
+    mesh.QueryTriangles(localBox, [&](int triangle) {
+        CollisionInfo triangleInfo;
+        ConvexShape triangleShape(mesh.GetTriangle(triangle), 3, meshTransform);
+        if (!GJK::Intersection(triangleShape, otherShape, triangleInfo)) {
+            return;
+        }
+        for (int i = 0; i < triangleInfo.pointCount; ++i) {
+            const ContactPoint &p = triangleInfo.points[i];
+            // neighbouring triangles find the same point on a shared edge or vertex, so only keep it once
+            bool duplicate = false;
+            for (int j = 0; j < collisionInfo.pointCount && !duplicate; ++j) {
+                duplicate = (collisionInfo.points[j].localA - p.localA).LengthSquared() < 1e-4f;
+                if (duplicate && p.penetration > collisionInfo.points[j].penetration) {
+                    collisionInfo.points[j].normal = p.normal;
+                    collisionInfo.points[j].penetration = p.penetration;
+                }
+            }
+            if (!duplicate) {
+                collisionInfo.AddContactPoint(p.localA, p.localB, p.normal, p.penetration);
+            }
+        }
+    });
+    return collisionInfo.pointCount > 0;
 }
 
 bool CollisionDetection::AABBTest(const Vector3 &posA, const Vector3 &posB, const Vector3 &halfSizeA,
@@ -390,42 +606,6 @@ bool CollisionDetection::AABBSphereIntersection(const AABBVolume &volumeA, const
     return false;
 }
 
-bool CollisionDetection::CapsuleIntersection(	const CapsuleVolume& volumeA, const Transform& worldTransformA,
-                                                 const CapsuleVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-    // Capsule A
-    Vector3 capsuleTopA = worldTransformA.GetPosition() + (worldTransformA.GetOrientation() * (Vector3(0, 1, 0) * (volumeA.GetHalfHeight() - volumeA.GetRadius())));
-    Vector3 capsuleBottomA = worldTransformA.GetPosition() - (worldTransformA.GetOrientation() * (Vector3(0, 1, 0) * (volumeA.GetHalfHeight() - volumeA.GetRadius())));
-    Vector3 capsuleDirectionA = capsuleTopA - capsuleBottomA;
-    float capsuleLengthA = capsuleDirectionA.Length();
-    capsuleDirectionA.Normalise();
-
-    // Capsule B
-    Vector3 capsuleTopB = worldTransformB.GetPosition() + (worldTransformB.GetOrientation() * (Vector3(0, 1, 0) * (volumeB.GetHalfHeight() - volumeB.GetRadius())));
-    Vector3 capsuleBottomB = worldTransformB.GetPosition() - (worldTransformB.GetOrientation() * (Vector3(0, 1, 0) * (volumeB.GetHalfHeight() - volumeB.GetRadius())));
-    Vector3 capsuleDirectionB = capsuleTopB - capsuleBottomB;
-    float capsuleLengthB = capsuleDirectionB.Length();
-    capsuleDirectionB.Normalise();
-
-    Vector3 v0 = capsuleTopB - capsuleTopA;
-    Vector3 v1 = capsuleBottomB - capsuleTopA;
-    Vector3 v2 = capsuleTopB - capsuleBottomA;
-    Vector3 v3 = capsuleBottomB - capsuleBottomA;
-
-    float d0 = Vector3::Dot(v0, v0);
-    float d1 = Vector3::Dot(v1, v1);
-    float d2 = Vector3::Dot(v2, v2);
-    float d3 = Vector3::Dot(v3, v3);
-
-    Vector3 bestA;
-    if (d2 < d0 || d2 < d1 || d3 < d0 || d3 < d1) {
-        bestA = capsuleBottomA;
-    }
-    else {
-        bestA = capsuleTopA;
-    }
-
-    return false;
-}
 bool CollisionDetection::OBBSphereIntersection(const OBBVolume &volumeA, const Transform &worldTransformA,
                                                const SphereVolume &volumeB, const Transform &worldTransformB,
                                                CollisionInfo &collisionInfo) {
@@ -481,116 +661,6 @@ bool CollisionDetection::OBBSphereIntersection(const OBBVolume &volumeA, const T
     return false;
 }
 
-bool CollisionDetection::AABBCapsuleIntersection(const AABBVolume& volumeB, const Transform& worldTransformB,
-                                                 const CapsuleVolume& volumeA, const Transform& worldTransformA, CollisionInfo& collisionInfo) {
-
-
-        Vector3 capsulePosition = worldTransformA.GetPosition();
-        Quaternion orientation = worldTransformA.GetOrientation();
-
-        Matrix3 transform = Matrix3(orientation);
-        Vector3 upVector = transform * Vector3(0, 1, 0);
-
-        Vector3 topPos = capsulePosition + (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-
-        Vector3 localPos = worldTransformB.GetPosition() - capsulePosition;
-        Vector3 originTop = topPos - capsulePosition;
-
-        Vector3 thirdPoint = Vector3::Cross(localPos.Normalised(), originTop.Normalised());
-
-        thirdPoint += capsulePosition;
-
-        Vector3 vA = topPos - worldTransformB.GetPosition();
-        Vector3 vB = topPos - capsulePosition;
-
-        float dotDist = Vector3::Dot(vA, vB);
-
-        if (dotDist < 0) {
-            Vector3 penetrationDistance = worldTransformB.GetPosition() - topPos;
-
-            float penetrationFloat = penetrationDistance.Length();
-
-            if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-                SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-                Transform transform = Transform();
-                transform.SetPosition(topPos);
-                transform.SetOrientation(orientation);
-                transform.SetScale(worldTransformA.GetScale());
-                GameObject* a = collisionInfo.a;
-                GameObject* b = collisionInfo.b;
-
-                collisionInfo.a = b;
-                collisionInfo.b = a;
-
-                return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
-            }
-
-            //return false;
-        }
-
-        Vector3 bottomPos = capsulePosition - (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-        vA = bottomPos - worldTransformB.GetPosition();
-        //vA.Normalise();
-        vB = bottomPos - capsulePosition;
-        //vB.Normalise();
-        dotDist = Vector3::Dot(vA, vB);
-
-        if (dotDist < 0) {
-            Vector3 penetrationDistance = worldTransformB.GetPosition() - bottomPos;
-
-            float penetrationFloat = penetrationDistance.Length();
-
-            if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-                SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-                Transform transform = Transform();
-                transform.SetPosition(bottomPos);
-                transform.SetOrientation(orientation);
-                transform.SetScale(worldTransformA.GetScale());
-                GameObject* a = collisionInfo.a;
-                GameObject* b = collisionInfo.b;
-
-                collisionInfo.a = b;
-                collisionInfo.b = a;
-                return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
-            }
-
-            //return false;
-        }
-
-        Vector3 cD = worldTransformB.GetPosition() - capsulePosition;
-        //Vector3 extents = Vector3(volume.GetRadius(), volume.GetHalfHeight(), volume.GetRadius());
-        float clampedDot = Maths::Clamp(Vector3::Dot(cD, upVector), -volumeA.GetHalfHeight(), volumeA.GetHalfHeight());
-
-        Vector3 d = capsulePosition + (upVector * (clampedDot));
-
-        float dist = (d - worldTransformB.GetPosition()).Length();
-
-        if (dist > volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-            return false;
-        }
-
-            //if (dist > volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-            //	return false;
-            //}
-
-        else {
-            SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-            Transform transform = Transform();
-            transform.SetPosition(d);
-            transform.SetOrientation(orientation);
-            transform.SetScale(worldTransformA.GetScale());
-            GameObject* a = collisionInfo.a;
-            GameObject* b = collisionInfo.b;
-
-            collisionInfo.a = b;
-            collisionInfo.b = a;
-            return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
-            //return true;
-        }
-
-        return false;
-}
-
 // Sphere-Capsule by Sphere-Sphere
 bool CollisionDetection::SphereCapsuleIntersection(
         const CapsuleVolume& volumeA, const Transform& worldTransformA,
@@ -614,149 +684,320 @@ bool CollisionDetection::SphereCapsuleIntersection(
     return SphereIntersection(sphereFromCapsule, sphereFromCapsuleTransform, volumeB, worldTransformB, collisionInfo);
 }
 
-//https://github.com/gszauer/GamePhysicsCookbook/blob/master/Code/Geometry3D.cpp
-bool CollisionDetection::OBBIntersection(const OBBVolume &volumeA, const Transform &worldTransformA,
-                                         const OBBVolume &volumeB, const Transform &worldTransformB,
-                                         CollisionInfo &collisionInfo) {
-    float ra, rb;
-    Matrix3 R, AbsR;
-
-    //------------------------------------------------------------------------------
-    //Get Local Axis of OBB A
-    Matrix4 boxAMat = worldTransformA.GetMatrix();
-    boxAMat.SetPositionVector(Vector3(0, 0, 0));
-
-    Vector3 boxARight = boxAMat * Vector3(1, 0, 0);
-    Vector3 boxAUp = boxAMat * Vector3(0, 1, 0);
-    Vector3 boxAForward = boxAMat * Vector3(0, 0, -1);
-
-    Vector3 uA[3] = { boxARight.Normalised(), boxAUp.Normalised(), boxAForward.Normalised() };
-
-    Vector3 boxAExtents = volumeA.GetHalfDimensions();
-    //------------------------------------------------------------------------------
-
-    //------------------------------------------------------------------------------
-    //Get Local Axis of OBB B
-    Matrix4 boxBMat = worldTransformB.GetMatrix();
-    boxBMat.SetPositionVector(Vector3(0, 0, 0));
-
-    Vector3 boxBRight = boxBMat * Vector3(1, 0, 0);
-    Vector3 boxBUp = boxBMat * Vector3(0, 1, 0);
-    Vector3 boxBForward = boxBMat * Vector3(0, 0, -1);
-
-    Vector3 uB[3] = { boxBRight.Normalised(), boxBUp.Normalised(), boxBForward.Normalised() };
-
-    Vector3 boxBExtents = volumeB.GetHalfDimensions();
-    //------------------------------------------------------------------------------
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++)
-            R.array[i][j] = Vector3::Dot(uA[i], uB[j]);
-
-    Vector3 t = worldTransformB.GetPosition() - worldTransformA.GetPosition();
-    t = Vector3(Vector3::Dot(t, uA[0]), Vector3::Dot(t, uA[1]), Vector3::Dot(t, uA[2]));
-
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++)
-            AbsR.array[i][j] = abs(R.array[i][j]) + 0.01f;
-
-    //Test Axes L = A0, L = A1, L = A2
-    for (int i = 0; i < 3; i++)
-    {
-        ra = boxAExtents[i];
-        rb = boxBExtents[0] * AbsR.array[i][0] +
-             boxBExtents[1] * AbsR.array[i][1] +
-             boxBExtents[2] * AbsR.array[i][2];
-
-        if (abs(t[i]) > ra + rb)
-            return false;
+#ifdef COLLISION_USE_SSE
+namespace {
+    inline __m128 Abs(__m128 v) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
     }
 
-    //Test Axes L = B0, L = B1, L = B2
-    for (int i = 0; i < 3; i++)
-    {
-        ra = boxAExtents[0] * AbsR.array[0][i] +
-             boxAExtents[1] * AbsR.array[1][i] +
-             boxAExtents[2] * AbsR.array[2][i];
-        rb = boxBExtents[i];
-
-        if (abs(t[0] * R.array[0][i] + t[1] * R.array[1][i] + t[2] * R.array[2][i]) > ra + rb)
-            return false;
+    inline __m128 Dot(__m128 x, __m128 y, __m128 z, const Vector3 &v) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(v.x)), _mm_mul_ps(y, _mm_set1_ps(v.y))),
+                          _mm_mul_ps(z, _mm_set1_ps(v.z)));
+    }
+}
+#endif
+
+namespace {
+    const int SATAxisCount = 15;
+
+    /*
+    One box pair, moved into A's local space - so A's axes are just x, y
+    and z, and B is described by its centre and axes relative to A.
+    */
+    struct BoxPair {
+        Vector3 halfA;
+        Vector3 halfB;
+        Vector3 centreB;
+        Vector3 axesB[3];
+    };
+
+    /*
+    The 15 SAT axes, stored side by side so that four can be tested at once.
+    A's faces and B's faces come first, as they separate boxes far more often
+    than the 9 edge pairs do. The 16th lane is padding that never separates.
+    */
+    void BuildSATAxes(const BoxPair &pair, float x[16], float y[16], float z[16]) {
+        for (int i = 0; i < 3; ++i) {
+            x[i] = i == 0 ? 1.0f : 0.0f;
+            y[i] = i == 1 ? 1.0f : 0.0f;
+            z[i] = i == 2 ? 1.0f : 0.0f;
+
+            x[i + 3] = pair.axesB[i].x;
+            y[i + 3] = pair.axesB[i].y;
+            z[i + 3] = pair.axesB[i].z;
+        }
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const Vector3 &b = pair.axesB[j];
+                int index = 6 + i * 3 + j;
+                //the cross product of A's axis i with b
+                x[index] = i == 0 ? 0.0f : (i == 1 ? b.z : -b.y);
+                y[index] = i == 0 ? -b.z : (i == 1 ? 0.0f : b.x);
+                z[index] = i == 0 ? b.y : (i == 1 ? -b.x : 0.0f);
+            }
+        }
+        x[15] = y[15] = z[15] = 0.0f;
     }
 
+    //How far apart the boxes are along the axis, or how far they overlap if negative
+    float AxisSeparation(const BoxPair &pair, const Vector3 &axis) {
+        float length = axis.Length();
+        if (length < 1e-5f) {
+            return -FLT_MAX; //parallel edges, which the face axes already cover
+        }
+        float ra = abs(axis.x) * pair.halfA.x + abs(axis.y) * pair.halfA.y + abs(axis.z) * pair.halfA.z;
+        float rb = abs(Vector3::Dot(axis, pair.axesB[0])) * pair.halfB.x +
+                   abs(Vector3::Dot(axis, pair.axesB[1])) * pair.halfB.y +
+                   abs(Vector3::Dot(axis, pair.axesB[2])) * pair.halfB.z;
+        return (abs(Vector3::Dot(axis, pair.centreB)) - ra - rb) / length;
+    }
 
+    //Returns a bit per axis in the batch of four that separates the boxes
+    int SeparateBatch(const BoxPair &pair, const float *x, const float *y, const float *z, float *separation) {
+#ifdef COLLISION_USE_SSE
+        __m128 ax = _mm_load_ps(x);
+        __m128 ay = _mm_load_ps(y);
+        __m128 az = _mm_load_ps(z);
+
+        __m128 ra = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs(ax), _mm_set1_ps(pair.halfA.x)),
+                                          _mm_mul_ps(Abs(ay), _mm_set1_ps(pair.halfA.y))),
+                               _mm_mul_ps(Abs(az), _mm_set1_ps(pair.halfA.z)));
+        __m128 rb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs(Dot(ax, ay, az, pair.axesB[0])), _mm_set1_ps(pair.halfB.x)),
+                                          _mm_mul_ps(Abs(Dot(ax, ay, az, pair.axesB[1])), _mm_set1_ps(pair.halfB.y))),
+                               _mm_mul_ps(Abs(Dot(ax, ay, az, pair.axesB[2])), _mm_set1_ps(pair.halfB.z)));
+        __m128 distance = Abs(Dot(ax, ay, az, pair.centreB));
+
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_mul_ps(az, az)));
+        __m128 valid = _mm_cmpge_ps(length, _mm_set1_ps(1e-5f));
+        __m128 result = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(distance, ra), rb), _mm_max_ps(length, _mm_set1_ps(1e-5f)));
+        result = _mm_or_ps(_mm_and_ps(valid, result), _mm_andnot_ps(valid, _mm_set1_ps(-FLT_MAX)));
+
+        _mm_store_ps(separation, result);
+        return _mm_movemask_ps(_mm_cmpgt_ps(result, _mm_setzero_ps()));
+#else
+        int mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            separation[i] = AxisSeparation(pair, Vector3(x[i], y[i], z[i]));
+            if (separation[i] > 0.0f) {
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+#endif
+    }
 
-    //Test Axis L = A0 x B0
-    ra = boxAExtents[1] * AbsR.array[2][0] + boxAExtents[2] * AbsR.array[1][0];
-    rb = boxBExtents[1] * AbsR.array[0][2] + boxBExtents[2] * AbsR.array[0][1];
-    if (abs(t[2] * R.array[1][0] - t[1] * R.array[2][0]) > ra + rb)
-        return false;
-
-    //Test Axis L = A0 x B1
-    ra = boxAExtents[1] * AbsR.array[2][1] + boxAExtents[2] * AbsR.array[1][1];
-    rb = boxBExtents[0] * AbsR.array[0][2] + boxBExtents[2] * AbsR.array[0][0];
-    if (abs(t[2] * R.array[1][1] - t[1] * R.array[2][1]) > ra + rb)
-        return false;
-
-    //Test Axis L = A0 x B2
-    ra = boxAExtents[1] * AbsR.array[2][2] + boxAExtents[2] * AbsR.array[1][2];
-    rb = boxBExtents[0] * AbsR.array[0][1] + boxBExtents[1] * AbsR.array[0][0];
-    if (abs(t[2] * R.array[1][2] - t[1] * R.array[2][2]) > ra + rb)
-        return false;
+    //Sutherland-Hodgman - keeps the part of the polygon where dot(normal, p) <= offset
+    int ClipPolygon(const Vector3 *in, int count, const Vector3 &normal, float offset, Vector3 *out) {
+        int outCount = 0;
+        for (int i = 0; i < count; ++i) {
+            const Vector3 &from = in[i];
+            const Vector3 &to = in[(i + 1) % count];
+            float fromDist = Vector3::Dot(normal, from) - offset;
+            float toDist = Vector3::Dot(normal, to) - offset;
+
+            if (fromDist <= 0.0f) {
+                out[outCount++] = from;
+            }
+            if ((fromDist < 0.0f && toDist > 0.0f) || (fromDist > 0.0f && toDist < 0.0f)) {
+                out[outCount++] = from + (to - from) * (fromDist / (fromDist - toDist));
+            }
+        }
+        return outCount;
+    }
 
+    /*
+    Clips the incident box's face against the side planes of the reference
+    box's face. Whatever is left below the reference face are the contacts,
+    up to 8 of them before the manifold keeps the deepest 4.
+    */
+    int ClipBoxFaces(const Vector3 &refPos, const Matrix3 &refRot, const Vector3 &refHalf, int refAxis,
+                     const Vector3 &refNormal, const Vector3 &incPos, const Matrix3 &incRot, const Vector3 &incHalf,
+                     Vector3 *points, float *depths) {
+        int incAxis = 0;
+        float mostOpposed = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            float d = abs(Vector3::Dot(incRot.GetColumn(i), refNormal));
+            if (d > mostOpposed) {
+                mostOpposed = d;
+                incAxis = i;
+            }
+        }
+        Vector3 incNormal = incRot.GetColumn(incAxis);
+        if (Vector3::Dot(incNormal, refNormal) > 0.0f) {
+            incNormal = -incNormal;
+        }
+        Vector3 centre = incPos + incNormal * incHalf[incAxis];
+        Vector3 u = incRot.GetColumn((incAxis + 1) % 3) * incHalf[(incAxis + 1) % 3];
+        Vector3 v = incRot.GetColumn((incAxis + 2) % 3) * incHalf[(incAxis + 2) % 3];
 
+        Vector3 polygon[8] = {centre + u + v, centre - u + v, centre - u - v, centre + u - v};
+        Vector3 clipped[8];
+        int count = 4;
 
-    //Test Axis L = A1 x B0
-    ra = boxAExtents[0] * AbsR.array[2][0] + boxAExtents[2] * AbsR.array[0][0];
-    rb = boxBExtents[1] * AbsR.array[1][2] + boxBExtents[2] * AbsR.array[1][1];
-    if (abs(t[0] * R.array[2][0] - t[2] * R.array[0][0]) > ra + rb)
-        return false;
+        for (int i = 1; i < 3 && count > 0; ++i) {
+            int sideAxis = (refAxis + i) % 3;
+            Vector3 side = refRot.GetColumn(sideAxis);
+            float centreOffset = Vector3::Dot(side, refPos);
 
-    //Test Axis L = A1 x B1
-    ra = boxAExtents[0] * AbsR.array[2][1] + boxAExtents[2] * AbsR.array[0][1];
-    rb = boxBExtents[0] * AbsR.array[1][2] + boxBExtents[2] * AbsR.array[1][0];
-    if (abs(t[0] * R.array[2][1] - t[2] * R.array[0][1]) > ra + rb)
-        return false;
+            count = ClipPolygon(polygon, count, side, centreOffset + refHalf[sideAxis], clipped);
+            count = ClipPolygon(clipped, count, -side, -centreOffset + refHalf[sideAxis], polygon);
+        }
 
-    //Test Axis L = A1 x B2
-    ra = boxAExtents[0] * AbsR.array[2][2] + boxAExtents[2] * AbsR.array[0][2];
-    rb = boxBExtents[0] * AbsR.array[1][1] + boxBExtents[1] * AbsR.array[1][0];
-    if (abs(t[0] * R.array[2][2] - t[2] * R.array[0][2]) > ra + rb)
-        return false;
+        float faceOffset = Vector3::Dot(refNormal, refPos) + refHalf[refAxis];
+        int pointCount = 0;
+        for (int i = 0; i < count; ++i) {
+            float depth = faceOffset - Vector3::Dot(refNormal, polygon[i]);
+            if (depth >= 0.0f) {
+                points[pointCount] = polygon[i];
+                depths[pointCount] = depth;
+                pointCount++;
+            }
+        }
+        return pointCount;
+    }
+}
 
+bool CollisionDetection::OBBIntersection(const OBBVolume &volumeA, const Transform &worldTransformA,
+                                         const OBBVolume &volumeB, const Transform &worldTransformB,
+                                         CollisionInfo &collisionInfo) {
+    return BoxIntersection(worldTransformA.GetPosition(), Matrix3(worldTransformA.GetOrientation()), volumeA.GetHalfDimensions(),
+                           worldTransformB.GetPosition(), Matrix3(worldTransformB.GetOrientation()), volumeB.GetHalfDimensions(),
+                           collisionInfo);
+}
 
+/*
+Separating axis test between two boxes. The axis that separated the pair
+last time is tried first, as it usually still does, then the rest are
+tested four at a time, stopping at the first batch with a separating axis.
+
+If the boxes overlap on every axis, the one with the least overlap is the
+contact normal. Face axes are preferred over edge axes (and A's faces over
+B's) unless the other is clearly better, so that a box resting on another
+doesn't flip between axes from frame to frame. Face contacts are clipped
+to give up to 4 points, which is what lets a stack of boxes sit still.
+*/
+bool CollisionDetection::BoxIntersection(const Vector3 &posA, const Matrix3 &rotA, const Vector3 &halfSizeA,
+                                         const Vector3 &posB, const Matrix3 &rotB, const Vector3 &halfSizeB,
+                                         CollisionInfo &collisionInfo) {
+    Vector3 axesA[3] = {rotA.GetColumn(0), rotA.GetColumn(1), rotA.GetColumn(2)};
+    auto toLocalA = [&](const Vector3 &v) {
+        return Vector3(Vector3::Dot(axesA[0], v), Vector3::Dot(axesA[1], v), Vector3::Dot(axesA[2], v));
+    };
+
+    BoxPair pair;
+    pair.halfA = halfSizeA;
+    pair.halfB = halfSizeB;
+    pair.centreB = toLocalA(posB - posA);
+    for (int i = 0; i < 3; ++i) {
+        pair.axesB[i] = toLocalA(rotB.GetColumn(i));
+    }
 
+    alignas(16) float axisX[16];
+    alignas(16) float axisY[16];
+    alignas(16) float axisZ[16];
+    alignas(16) float separation[16];
+    BuildSATAxes(pair, axisX, axisY, axisZ);
 
-    //Test Axis L = A2 x B0
-    ra = boxAExtents[0] * AbsR.array[1][0] + boxAExtents[1] * AbsR.array[0][0];
-    rb = boxBExtents[1] * AbsR.array[2][2] + boxBExtents[2] * AbsR.array[2][1];
-    if (abs(t[1] * R.array[0][0] - t[0] * R.array[1][0]) > ra + rb)
+    int cached = collisionInfo.separatingAxis;
+    if (cached >= 0 && cached < SATAxisCount &&
+        AxisSeparation(pair, Vector3(axisX[cached], axisY[cached], axisZ[cached])) > 0.0f) {
         return false;
+    }
+    for (int batch = 0; batch < 16; batch += 4) {
+        int separating = SeparateBatch(pair, axisX + batch, axisY + batch, axisZ + batch, separation + batch);
+        if (separating) {
+            int lane = 0;
+            while (!(separating & (1 << lane))) {
+                lane++;
+            }
+            collisionInfo.separatingAxis = batch + lane;
+            return false;
+        }
+    }
+    collisionInfo.separatingAxis = -1;
 
-    //Test Axis L = A2 x B1
-    ra = boxAExtents[0] * AbsR.array[1][1] + boxAExtents[1] * AbsR.array[0][1];
-    rb = boxBExtents[0] * AbsR.array[2][2] + boxBExtents[2] * AbsR.array[2][0];
-    if (abs(t[1] * R.array[0][1] - t[0] * R.array[1][1]) > ra + rb)
-        return false;
+    const float relativeTolerance = 0.95f;
+    const float absoluteTolerance = 0.01f;
 
-    //Test Axis L = A2 x B2
-    ra = boxAExtents[0] * AbsR.array[1][2] + boxAExtents[1] * AbsR.array[0][2];
-    rb = boxBExtents[0] * AbsR.array[2][1] + boxBExtents[1] * AbsR.array[2][0];
-    if (abs(t[1] * R.array[0][2] - t[0] * R.array[1][2]) > ra + rb)
-        return false;
+    int best = separation[0] >= separation[1] ? 0 : 1;
+    best = separation[2] > separation[best] ? 2 : best;
+    int bestB = separation[3] >= separation[4] ? 3 : 4;
+    bestB = separation[5] > separation[bestB] ? 5 : bestB;
+    if (separation[bestB] > relativeTolerance * separation[best] + absoluteTolerance) {
+        best = bestB;
+    }
+    int bestEdge = 6;
+    for (int i = 7; i < SATAxisCount; ++i) {
+        if (separation[i] > separation[bestEdge]) {
+            bestEdge = i;
+        }
+    }
+    if (separation[bestEdge] > relativeTolerance * separation[best] + absoluteTolerance) {
+        best = bestEdge;
+    }
 
-    //Debug::DrawLine(t, t + Vector3(0, 1, 0), Debug::MAGENTA, 1000.0f);
-    RayCollision rayCollision;
-    Ray ray = Ray(worldTransformA.GetPosition(), worldTransformB.GetPosition() - worldTransformA.GetPosition());
-    if (RayOBBIntersection(ray, worldTransformB, volumeB, rayCollision))
-    {
-        //Debug::DrawLine(rayCollision.collidedAt, rayCollision.collidedAt + rayCollision.collidedNormal, Debug::MAGENTA, 1000.0f);
-        collisionInfo.AddContactPoint(Vector3(), rayCollision.collidedAt, -rayCollision.collidedNormal, rayCollision.rayDistance);
+    //The chosen axis in world space, pointing from A to B
+    Vector3 normal = rotA * Vector3(axisX[best], axisY[best], axisZ[best]).Normalised();
+    if (Vector3::Dot(normal, posB - posA) < 0.0f) {
+        normal = -normal;
+    }
+    float penetration = -separation[best];
+
+    if (best < 6) {
+        Vector3 points[8];
+        float depths[8];
+        int count;
+        if (best < 3) {
+            count = ClipBoxFaces(posA, rotA, halfSizeA, best, normal, posB, rotB, halfSizeB, points, depths);
+            for (int i = 0; i < count; ++i) {
+                Vector3 onA = points[i] + normal * depths[i];
+                collisionInfo.AddContactPoint(onA - posA, points[i] - posB, normal, depths[i]);
+            }
+        }
+        else {
+            count = ClipBoxFaces(posB, rotB, halfSizeB, best - 3, -normal, posA, rotA, halfSizeA, points, depths);
+            for (int i = 0; i < count; ++i) {
+                Vector3 onB = points[i] - normal * depths[i];
+                collisionInfo.AddContactPoint(points[i] - posA, onB - posB, normal, depths[i]);
+            }
+        }
+        if (count > 0) {
+            return true;
+        }
     }
 
-    //std::cout << "There is an OBB-OBB collision\n";
+    //Edge against edge (or a face contact that clipped away to nothing) touches at a single point
+    Vector3 supportA = posA;
+    Vector3 supportB = posB;
+    for (int i = 0; i < 3; ++i) {
+        Vector3 axisA = rotA.GetColumn(i);
+        Vector3 axisB = rotB.GetColumn(i);
+        supportA += axisA * (Vector3::Dot(axisA, normal) > 0.0f ? halfSizeA[i] : -halfSizeA[i]);
+        supportB += axisB * (Vector3::Dot(axisB, normal) < 0.0f ? halfSizeB[i] : -halfSizeB[i]);
+    }
+    if (best >= 6) {
+        int edgeA = (best - 6) / 3;
+        int edgeB = (best - 6) % 3;
+        Vector3 dirA = rotA.GetColumn(edgeA);
+        Vector3 dirB = rotB.GetColumn(edgeB);
+        //move the support points to the middle of their edges, then find the closest points on the two lines
+        supportA -= dirA * Vector3::Dot(dirA, supportA - posA);
+        supportB -= dirB * Vector3::Dot(dirB, supportB - posB);
+
+        Vector3 r = supportA - supportB;
+        float b = Vector3::Dot(dirA, dirB);
+        float c = Vector3::Dot(dirA, r);
+        float f = Vector3::Dot(dirB, r);
+        float denom = 1.0f - b * b;
+        if (denom > 1e-6f) {
+            float s = Maths::Clamp((b * f - c) / denom, -halfSizeA[edgeA], halfSizeA[edgeA]);
+            float t = Maths::Clamp((f - b * c) / denom, -halfSizeB[edgeB], halfSizeB[edgeB]);
+            supportA += dirA * s;
+            supportB += dirB * t;
+        }
+    }
+    collisionInfo.AddContactPoint(supportA - posA, supportB - posB, normal, penetration);
     return true;
-
 }
 
 Matrix4 GenerateInverseView(const Camera &c) {
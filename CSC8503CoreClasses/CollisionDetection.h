@@ -9,6 +9,8 @@
 #include "OBBVolume.h"
 #include "SphereVolume.h"
 #include "CapsuleVolume.h"
+#include "ConvexHullVolume.h"
+#include "TriangleMeshVolume.h"
 #include "Ray.h"
 
 using NCL::Camera;
@@ -23,34 +25,65 @@ namespace NCL {
 			Vector3 localB;
 			Vector3 normal;
 			float	penetration;
+
+			//Accumulated by the solver, and carried over to the next frame to warm start it
+			float	normalImpulse;
+			float	tangentImpulse[2];
 		};
+
+		//A contact manifold - the points the pair are touching at this frame
 		struct CollisionInfo {
+			static const int MaxContactPoints = 4;
+
 			GameObject* a;
 			GameObject* b;
-			int		framesLeft;
 
-			ContactPoint point;
+			ContactPoint points[MaxContactPoints];
+			int			 pointCount;
 
-			CollisionInfo() {
+			//The SAT axis that last separated a box pair, tried first next time (-1 if none)
+			int			 separatingAxis;
 
+			CollisionInfo() {
+				a				= nullptr;
+				b				= nullptr;
+				pointCount		= 0;
+				separatingAxis	= -1;
 			}
 
+			//Once the manifold is full, only deeper points replace the shallowest one
 			void AddContactPoint(const Vector3& localA, const Vector3& localB, const Vector3& normal, float p) {
-				point.localA		= localA;
-				point.localB		= localB;
-				point.normal		= normal;
-				point.penetration	= p;
+				int index = pointCount;
+				if (pointCount == MaxContactPoints) {
+					index = 0;
+					for (int i = 1; i < pointCount; ++i) {
+						if (points[i].penetration < points[index].penetration) {
+							index = i;
+						}
+					}
+					if (points[index].penetration >= p) {
+						return;
+					}
+				}
+				else {
+					pointCount++;
+				}
+				ContactPoint& point = points[index];
+				point.localA			= localA;
+				point.localB			= localB;
+				point.normal			= normal;
+				point.penetration		= p;
+				point.normalImpulse		= 0.0f;
+				point.tangentImpulse[0] = 0.0f;
+				point.tangentImpulse[1] = 0.0f;
 			}
 
 			//Advanced collision detection / resolution
 			bool operator < (const CollisionInfo& other) const {
-				size_t otherHash = (size_t)other.a + ((size_t)other.b << 32);
-				size_t thisHash  = (size_t)a + ((size_t)b << 32);
-
-				if (thisHash < otherHash) {
-					return true;
+				if (a != other.a) {
+					return a < other.a;
 				}
-				return false;
+				return b < other.b;
 			}
 
 			bool operator ==(const CollisionInfo& other) const {
@@ -61,9 +94,6 @@ namespace NCL {
 			}
 		};
 
-        static bool AABBCapsuleIntersection(	const AABBVolume& volumeA, const Transform& worldTransformA,
-                                                const CapsuleVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
-
         static bool SphereCapsuleIntersection(
 			const CapsuleVolume& volumeA, const Transform& worldTransformA,
 			const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
@@ -83,15 +113,35 @@ namespace NCL {
 		static bool RayOBBIntersection(const Ray&r, const Transform& worldTransform, const OBBVolume&	volume, RayCollision& collision);
 		static bool RaySphereIntersection(const Ray&r, const Transform& worldTransform, const SphereVolume& volume, RayCollision& collision);
 		static bool RayCapsuleIntersection(const Ray& r, const Transform& worldTransform, const CapsuleVolume& volume, RayCollision& collision);
+		static bool RayMeshIntersection(const Ray& r, const Transform& worldTransform, const CollisionVolume& volume, RayCollision& collision);
+
+		static bool RayTriangleIntersection(const Vector3& origin, const Vector3& direction,
+											const Vector3& a, const Vector3& b, const Vector3& c, float& distance);
 
 
 		static bool RayPlaneIntersection(const Ray&r, const Plane&p, RayCollision& collisions);
 
 		static bool	AABBTest(const Vector3& posA, const Vector3& posB, const Vector3& halfSizeA, const Vector3& halfSizeB);
 
+		/*
+		Swept tests, for continuous collision detection. The first shape moves by
+		'motion' against the second, stationary one, and timeOfImpact is how far
+		along the motion (0 to 1) they first touch, with the normal pointing out
+		of the second shape. Shapes that start off overlapping are left to the
+		narrowphase, so these return false for them.
+		*/
+		static bool SweptAABBIntersection(const Vector3& startA, const Vector3& halfSizeA, const Vector3& motion,
+										  const Vector3& posB, const Vector3& halfSizeB, float& timeOfImpact, Vector3& normal);
+
+		static bool SweptSphereIntersection(const Vector3& startA, float radiusA, const Vector3& motion,
+											const Vector3& posB, float radiusB, float& timeOfImpact, Vector3& normal);
+
 
 		static bool ObjectIntersection(GameObject* a, GameObject* b, CollisionInfo& collisionInfo);
 
+		static bool VolumeIntersection(const CollisionVolume* volA, const Transform& transformA,
+									   const CollisionVolume* volB, const Transform& transformB, CollisionInfo& collisionInfo);
+
 
 		static bool AABBIntersection(	const AABBVolume& volumeA, const Transform& worldTransformA,
 										const AABBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
@@ -105,14 +155,18 @@ namespace NCL {
 		static bool OBBIntersection(	const OBBVolume& volumeA, const Transform& worldTransformA,
 										const OBBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
 
+		//Any two boxes, so AABBs can be tested against OBBs with an identity rotation
+		static bool BoxIntersection(const Vector3& posA, const Matrix3& rotA, const Vector3& halfSizeA,
+									const Vector3& posB, const Matrix3& rotB, const Vector3& halfSizeB, CollisionInfo& collisionInfo);
+
+		//Triangle mesh against any convex volume
+		static bool MeshIntersection(const TriangleMeshVolume& mesh, const Transform& meshTransform,
+									 const CollisionVolume* other, const Transform& otherTransform, CollisionInfo& collisionInfo);
 
 		static bool OBBSphereIntersection(const OBBVolume& volumeA, const Transform& worldTransformA,
 			const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
 
 
-        static bool CapsuleIntersection(const CapsuleVolume& volumeA, const Transform& worldTransformA,
-                                        const CapsuleVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
-
         static Vector3 Unproject(const Vector3& screenPos, const Camera& cam);
 
 
@@ -7,6 +7,7 @@ namespace NCL {
 		Mesh	= 8,
 		Capsule = 16,
 		Compound= 32,
+		ConvexHull	= 64,
 		Invalid = 256
 	};
 
@@ -16,7 +17,8 @@ namespace NCL {
 		CollisionVolume() {
 			type = VolumeType::Invalid;
 		}
-		~CollisionVolume() {}
+		//Virtual, as the mesh based volumes own their vertex data
+		virtual ~CollisionVolume() {}
 
 		VolumeType type;
 	};
@@ -2,12 +2,26 @@
 
 namespace NCL {
 	namespace CSC8503 {
+		class GameObject;
+
 		class Constraint	{
 		public:
 			Constraint() {}
 			virtual ~Constraint() {}
 
 			virtual void UpdateConstraint(float dt) = 0;
+
+			/*
+			The objects this constraint links, so the physics can keep them in the
+			same island. Constraints that report both are solved in parallel with
+			others that don't share a body, so should only touch those two.
+			*/
+			virtual GameObject* GetObjectA() const {
+				return nullptr;
+			}
+			virtual GameObject* GetObjectB() const {
+				return nullptr;
+			}
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "ConvexHullVolume.h"
+#include "Mesh.h"
+
+using namespace NCL;
+using namespace NCL::Rendering;
+
+ConvexHullVolume::ConvexHullVolume(const Mesh& mesh, const Vector3& scale) {
+	type = VolumeType::ConvexHull;
+
+	//Meshes repeat vertices for each face's normals and UVs, which the support function doesn't need
+	for (const Vector3& p : mesh.GetPositionData()) {
+		Vector3 v = p * scale;
+		if (std::find(vertices.begin(), vertices.end(), v) == vertices.end()) {
+			vertices.push_back(v);
+		}
+		halfSizes = Vector3(std::max(halfSizes.x, std::abs(v.x)), std::max(halfSizes.y, std::abs(v.y)), std::max(halfSizes.z, std::abs(v.z)));
+	}
+
+	if (mesh.GetPrimitiveType() == GeometryPrimitive::Triangles) {
+		size_t triCount = mesh.GetPrimitiveCount();
+		triangles.reserve(triCount * 3);
+		for (unsigned int i = 0; i < triCount; ++i) {
+			Vector3 a, b, c;
+			if (mesh.GetTriangle(i, a, b, c)) {
+				triangles.push_back(a * scale);
+				triangles.push_back(b * scale);
+				triangles.push_back(c * scale);
+			}
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "CollisionVolume.h"
+#include "Vector3.h"
+
+namespace NCL {
+	namespace Rendering {
+		class Mesh;
+	}
+	using namespace NCL::Maths;
+
+	/*
+	A convex volume made from a mesh's vertices, for shapes that boxes and
+	spheres fit badly. The mesh is assumed to be convex already - no hull is
+	computed, so anything concave collides as if it had been shrink wrapped.
+
+	Collisions go through GJK, which only needs the support function, and
+	the mesh's triangles are kept for raycasts.
+	*/
+	class ConvexHullVolume : public CollisionVolume
+	{
+	public:
+		ConvexHullVolume(const Rendering::Mesh& mesh, const Vector3& scale = Vector3(1, 1, 1));
+		~ConvexHullVolume() {
+
+		}
+
+		const std::vector<Vector3>& GetVertices() const {
+			return vertices;
+		}
+
+		//Three entries per triangle, in local space
+		const std::vector<Vector3>& GetTriangles() const {
+			return triangles;
+		}
+
+		//Half size of a box around the local origin that holds every vertex
+		Vector3 GetHalfDimensions() const {
+			return halfSizes;
+		}
+
+	protected:
+		std::vector<Vector3>	vertices;
+		std::vector<Vector3>	triangles;
+		Vector3					halfSizes;
+	};
+}
@@ -0,0 +1,524 @@
+#pragma once
+
+#include "Vector3.h"
+
+namespace NCL {
+    using namespace NCL::Maths;
+    namespace CSC8503 {
+        /*
+        A simple min/max box, used by the broadphase structures. Unlike
+        the AABBVolume, this is always in world space.
+        */
+        struct TreeAABB {
+            Vector3 min;
+            Vector3 max;
+
+            TreeAABB() {}
+
+            TreeAABB(const Vector3& min, const Vector3& max) {
+                this->min = min;
+                this->max = max;
+            }
+
+            static TreeAABB FromHalfSizes(const Vector3& pos, const Vector3& halfSizes) {
+                return TreeAABB(pos - halfSizes, pos + halfSizes);
+            }
+
+            bool Overlaps(const TreeAABB& other) const {
+                return  min.x <= other.max.x && max.x >= other.min.x &&
+                        min.y <= other.max.y && max.y >= other.min.y &&
+                        min.z <= other.max.z && max.z >= other.min.z;
+            }
+
+            bool Contains(const TreeAABB& other) const {
+                return  min.x <= other.min.x && max.x >= other.max.x &&
+                        min.y <= other.min.y && max.y >= other.max.y &&
+                        min.z <= other.min.z && max.z >= other.max.z;
+            }
+
+            TreeAABB Fattened(float margin) const {
+                Vector3 m(margin, margin, margin);
+                return TreeAABB(min - m, max + m);
+            }
+
+            static TreeAABB Merge(const TreeAABB& a, const TreeAABB& b) {
+                return TreeAABB(Vector3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
+                                Vector3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)));
+            }
+
+            /*
+            Slab test against a ray, given 1 / direction so the divides are only
+            done once per ray. entry is how far along the ray the box starts,
+            which is 0 if the ray starts inside it.
+            */
+            bool RayEntry(const Vector3& origin, const Vector3& inverseDir, float maxDistance, float& entry) const {
+                float tMin = 0.0f;
+                float tMax = maxDistance;
+                for (int i = 0; i < 3; ++i) {
+                    float t0 = (min[i] - origin[i]) * inverseDir[i];
+                    float t1 = (max[i] - origin[i]) * inverseDir[i];
+                    if (t0 > t1) {
+                        std::swap(t0, t1);
+                    }
+                    //NaNs (0 * inf) fail both of these, which leaves the slab unclipped
+                    if (t0 > tMin) {
+                        tMin = t0;
+                    }
+                    if (t1 < tMax) {
+                        tMax = t1;
+                    }
+                    if (tMin > tMax) {
+                        return false;
+                    }
+                }
+                entry = tMin;
+                return true;
+            }
+
+            //Used as the insertion cost - we want to keep parent boxes as tight as possible
+            float SurfaceArea() const {
+                Vector3 d = max - min;
+                return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+            }
+        };
+
+        /*
+        A dynamic bounding volume hierarchy, in the style of the one found in Box2D.
+        Each leaf holds a 'fat' box, grown by a margin around the object's real box,
+        so that an object can move a little without the tree having to change at all.
+        Only once an object leaves its fat box is its leaf removed and reinserted,
+        which keeps the per-step cost proportional to the number of moving objects.
+
+        Nodes live in a single vector, and are addressed by index (the 'proxy'),
+        so they can be recycled through a free list without any allocations.
+        */
+        template<class T>
+        class DynamicAABBTree {
+        public:
+            static const int NullNode = -1;
+
+            DynamicAABBTree(float fatMargin = 1.0f) {
+                margin = fatMargin;
+                Clear();
+            }
+
+            ~DynamicAABBTree() {
+            }
+
+            void Clear() {
+                nodes.clear();
+                root        = NullNode;
+                freeList    = NullNode;
+                proxyCount  = 0;
+            }
+
+            int CreateProxy(const TreeAABB& box, T object) {
+                int proxy = AllocateNode();
+                nodes[proxy].box    = box.Fattened(margin);
+                nodes[proxy].object = object;
+                nodes[proxy].height = 0;
+                InsertLeaf(proxy);
+                proxyCount++;
+                return proxy;
+            }
+
+            void DestroyProxy(int proxy) {
+                RemoveLeaf(proxy);
+                FreeNode(proxy);
+                proxyCount--;
+            }
+
+            //Returns true if the proxy had to be reinserted
+            bool MoveProxy(int proxy, const TreeAABB& box) {
+                if (nodes[proxy].box.Contains(box)) {
+                    return false;
+                }
+                RemoveLeaf(proxy);
+                nodes[proxy].box = box.Fattened(margin);
+                InsertLeaf(proxy);
+                return true;
+            }
+
+            const TreeAABB& GetFatAABB(int proxy) const {
+                return nodes[proxy].box;
+            }
+
+            T GetObject(int proxy) const {
+                return nodes[proxy].object;
+            }
+
+            int GetProxyCount() const {
+                return proxyCount;
+            }
+
+            int GetHeight() const {
+                return root == NullNode ? 0 : nodes[root].height;
+            }
+
+            /*
+            Calls func(proxy) for every leaf whose fat box overlaps the given box.
+            The callback can return false to stop the query early.
+            */
+            template<class F>
+            void Query(const TreeAABB& box, F&& func) const {
+                if (root == NullNode) {
+                    return;
+                }
+                NodeStack stack;
+                stack.Push(root);
+                while (!stack.Empty()) {
+                    int index = stack.Pop();
+                    const TreeNode& n = nodes[index];
+                    if (!n.box.Overlaps(box)) {
+                        continue;
+                    }
+                    if (n.IsLeaf()) {
+                        if (!func(index)) {
+                            return;
+                        }
+                    }
+                    else {
+                        stack.Push(n.children[0]);
+                        stack.Push(n.children[1]);
+                    }
+                }
+            }
+
+            /*
+            Walks the leaves a ray passes through, nearest box first. func(proxy)
+            returns how far along the ray we still care about - the distance of
+            the closest hit so far - so that boxes beyond it are never visited.
+            Returning a negative value stops the query altogether.
+            */
+            template<class F>
+            void RayQuery(const Vector3& origin, const Vector3& direction, float maxDistance, F&& func) const {
+                if (root == NullNode) {
+                    return;
+                }
+                Vector3 inverseDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+                float entry;
+                if (!nodes[root].box.RayEntry(origin, inverseDir, maxDistance, entry)) {
+                    return;
+                }
+                TraversalStack<RayEntryNode> stack;
+                stack.Push({ root, entry });
+
+                while (!stack.Empty()) {
+                    RayEntryNode next = stack.Pop();
+                    if (next.entry > maxDistance) {
+                        continue; //something closer has been hit since this was pushed
+                    }
+                    const TreeNode& n = nodes[next.index];
+                    if (n.IsLeaf()) {
+                        maxDistance = std::min(maxDistance, func(next.index));
+                        if (maxDistance < 0.0f) {
+                            return;
+                        }
+                        continue;
+                    }
+                    float entry0, entry1;
+                    bool hit0 = nodes[n.children[0]].box.RayEntry(origin, inverseDir, maxDistance, entry0);
+                    bool hit1 = nodes[n.children[1]].box.RayEntry(origin, inverseDir, maxDistance, entry1);
+                    //Push the further child first, so the nearer one is visited next
+                    if (hit0 && hit1) {
+                        if (entry0 < entry1) {
+                            stack.Push({ n.children[1], entry1 });
+                            stack.Push({ n.children[0], entry0 });
+                        }
+                        else {
+                            stack.Push({ n.children[0], entry0 });
+                            stack.Push({ n.children[1], entry1 });
+                        }
+                    }
+                    else if (hit0) {
+                        stack.Push({ n.children[0], entry0 });
+                    }
+                    else if (hit1) {
+                        stack.Push({ n.children[1], entry1 });
+                    }
+                }
+            }
+
+            /*
+            Walks the tree with a whole packet of rays (see RayPacket) at once,
+            so the traversal is shared between them. func(proxy, mask) is given
+            each leaf, along with a bit per ray in the packet that reaches it,
+            and can shrink the packet's max distances as it finds hits.
+            */
+            template<class P, class F>
+            void PacketQuery(P& packet, F&& func) const {
+                if (root == NullNode) {
+                    return;
+                }
+                NodeStack stack;
+                stack.Push(root);
+                while (!stack.Empty()) {
+                    int index = stack.Pop();
+                    const TreeNode& n = nodes[index];
+                    int mask = packet.OverlapsBox(n.box.min, n.box.max);
+                    if (mask == 0) {
+                        continue;
+                    }
+                    if (n.IsLeaf()) {
+                        func(index, mask);
+                    }
+                    else {
+                        stack.Push(n.children[0]);
+                        stack.Push(n.children[1]);
+                    }
+                }
+            }
+
+        protected:
+            struct TreeNode {
+                TreeAABB box;
+                T        object;
+                int      parent;    //doubles as the 'next' link while on the free list
+                int      children[2];
+                int      height;    //leaves are 0, free nodes are -1
+
+                bool IsLeaf() const {
+                    return children[0] == NullNode;
+                }
+            };
+
+            //Traversal stack - lives on the C++ stack unless the tree is very unbalanced
+            template<class V>
+            struct TraversalStack {
+                V                   fixed[128];
+                std::vector<V>      overflow;
+                int                 count = 0;
+
+                void Push(const V& i) {
+                    if (count < 128) {
+                        fixed[count] = i;
+                    }
+                    else {
+                        overflow.push_back(i);
+                    }
+                    count++;
+                }
+                V Pop() {
+                    count--;
+                    if (count < 128) {
+                        return fixed[count];
+                    }
+                    V i = overflow.back();
+                    overflow.pop_back();
+                    return i;
+                }
+                bool Empty() const {
+                    return count == 0;
+                }
+            };
+            typedef TraversalStack<int> NodeStack;
+
+            struct RayEntryNode {
+                int     index;
+                float   entry;
+            };
+
+            int AllocateNode() {
+                if (freeList == NullNode) {
+                    nodes.emplace_back();
+                    freeList = (int)nodes.size() - 1;
+                    nodes[freeList].parent = NullNode;
+                }
+                int index = freeList;
+                freeList = nodes[index].parent;
+
+                TreeNode& n     = nodes[index];
+                n.parent        = NullNode;
+                n.children[0]   = NullNode;
+                n.children[1]   = NullNode;
+                n.height        = 0;
+                return index;
+            }
+
+            void FreeNode(int index) {
+                nodes[index].parent = freeList;
+                nodes[index].height = -1;
+                freeList = index;
+            }
+
+            void InsertLeaf(int leaf) {
+                if (root == NullNode) {
+                    root = leaf;
+                    nodes[root].parent = NullNode;
+                    return;
+                }
+                //Find the best sibling, by walking down the tree and picking
+                //whichever child would grow the least by adding this leaf
+                TreeAABB leafBox = nodes[leaf].box;
+                int index = root;
+                while (!nodes[index].IsLeaf()) {
+                    int child0 = nodes[index].children[0];
+                    int child1 = nodes[index].children[1];
+
+                    float area          = nodes[index].box.SurfaceArea();
+                    float combinedArea  = TreeAABB::Merge(nodes[index].box, leafBox).SurfaceArea();
+
+                    float cost              = 2.0f * combinedArea;
+                    float inheritanceCost   = 2.0f * (combinedArea - area);
+
+                    float cost0 = ChildCost(child0, leafBox) + inheritanceCost;
+                    float cost1 = ChildCost(child1, leafBox) + inheritanceCost;
+
+                    if (cost < cost0 && cost < cost1) {
+                        break;
+                    }
+                    index = cost0 < cost1 ? child0 : child1;
+                }
+                int sibling = index;
+
+                //Make a new parent to hold both the sibling and the new leaf
+                int oldParent = nodes[sibling].parent;
+                int newParent = AllocateNode();
+                nodes[newParent].parent      = oldParent;
+                nodes[newParent].box         = TreeAABB::Merge(leafBox, nodes[sibling].box);
+                nodes[newParent].height      = nodes[sibling].height + 1;
+                nodes[newParent].children[0] = sibling;
+                nodes[newParent].children[1] = leaf;
+                nodes[sibling].parent        = newParent;
+                nodes[leaf].parent           = newParent;
+
+                if (oldParent != NullNode) {
+                    if (nodes[oldParent].children[0] == sibling) {
+                        nodes[oldParent].children[0] = newParent;
+                    }
+                    else {
+                        nodes[oldParent].children[1] = newParent;
+                    }
+                }
+                else {
+                    root = newParent;
+                }
+                RefitUpwards(nodes[leaf].parent);
+            }
+
+            void RemoveLeaf(int leaf) {
+                if (leaf == root) {
+                    root = NullNode;
+                    return;
+                }
+                int parent      = nodes[leaf].parent;
+                int grandParent = nodes[parent].parent;
+                int sibling     = nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0];
+
+                if (grandParent != NullNode) {
+                    //Our sibling takes the place of our old parent
+                    if (nodes[grandParent].children[0] == parent) {
+                        nodes[grandParent].children[0] = sibling;
+                    }
+                    else {
+                        nodes[grandParent].children[1] = sibling;
+                    }
+                    nodes[sibling].parent = grandParent;
+                    FreeNode(parent);
+                    RefitUpwards(grandParent);
+                }
+                else {
+                    root = sibling;
+                    nodes[sibling].parent = NullNode;
+                    FreeNode(parent);
+                }
+            }
+
+            float ChildCost(int child, const TreeAABB& leafBox) const {
+                float mergedArea = TreeAABB::Merge(leafBox, nodes[child].box).SurfaceArea();
+                if (nodes[child].IsLeaf()) {
+                    return mergedArea;
+                }
+                return mergedArea - nodes[child].box.SurfaceArea();
+            }
+
+            void RefitUpwards(int index) {
+                while (index != NullNode) {
+                    index = Balance(index);
+
+                    int child0 = nodes[index].children[0];
+                    int child1 = nodes[index].children[1];
+
+                    nodes[index].height = 1 + std::max(nodes[child0].height, nodes[child1].height);
+                    nodes[index].box    = TreeAABB::Merge(nodes[child0].box, nodes[child1].box);
+
+                    index = nodes[index].parent;
+                }
+            }
+
+            /*
+            If one side of node A is more than one level taller than the other,
+            rotate the taller child up into A's place. Returns the index of
+            whichever node now sits where A used to be.
+            */
+            int Balance(int iA) {
+                TreeNode& A = nodes[iA];
+                if (A.IsLeaf() || A.height < 2) {
+                    return iA;
+                }
+                int iB = A.children[0];
+                int iC = A.children[1];
+
+                int balance = nodes[iC].height - nodes[iB].height;
+
+                if (balance > 1) {
+                    return Rotate(iA, iC, iB, 1);
+                }
+                if (balance < -1) {
+                    return Rotate(iA, iB, iC, 0);
+                }
+                return iA;
+            }
+
+            //Promote the child 'iUp' (in slot upSlot of A) above A
+            int Rotate(int iA, int iUp, int iOther, int upSlot) {
+                TreeNode& A  = nodes[iA];
+                TreeNode& Up = nodes[iUp];
+
+                int iF = Up.children[0];
+                int iG = Up.children[1];
+
+                Up.children[0] = iA;
+                Up.parent      = A.parent;
+                A.parent       = iUp;
+
+                if (Up.parent != NullNode) {
+                    if (nodes[Up.parent].children[0] == iA) {
+                        nodes[Up.parent].children[0] = iUp;
+                    }
+                    else {
+                        nodes[Up.parent].children[1] = iUp;
+                    }
+                }
+                else {
+                    root = iUp;
+                }
+
+                //Keep the taller grandchild up with the promoted node
+                int keep = iF;
+                int give = iG;
+                if (nodes[iF].height < nodes[iG].height) {
+                    keep = iG;
+                    give = iF;
+                }
+                Up.children[1]      = keep;
+                A.children[upSlot]  = give;
+                nodes[give].parent  = iA;
+
+                A.box       = TreeAABB::Merge(nodes[iOther].box, nodes[give].box);
+                Up.box      = TreeAABB::Merge(A.box, nodes[keep].box);
+                A.height    = 1 + std::max(nodes[iOther].height, nodes[give].height);
+                Up.height   = 1 + std::max(A.height, nodes[keep].height);
+
+                return iUp;
+            }
+
+            std::vector<TreeNode> nodes;
+            int     root;
+            int     freeList;
+            int     proxyCount;
+            float   margin;
+        };
+    }
+}
@@ -0,0 +1,579 @@
+#include "GJK.h"
+#include "AABBVolume.h"
+#include "OBBVolume.h"
+#include "SphereVolume.h"
+#include "CapsuleVolume.h"
+#include "ConvexHullVolume.h"
+#include "Transform.h"
+
+using namespace NCL;
+
+namespace {
+	const int	MaxGJKIterations	= 64;
+	const int	MaxEPAIterations	= 64;
+	const int	MaxEPAVertices		= 4 + MaxEPAIterations;
+	const int	MaxEPAFaces			= 2 * MaxEPAVertices;
+
+	const float	GJKTolerance		= 1e-6f;	//relative, against the squared distance
+	const float	EPATolerance		= 1e-4f;	//absolute, in world units
+	const float	TouchingDistance	= 1e-4f;
+}
+
+ConvexShape::ConvexShape(const CollisionVolume* volume, const Transform& transform) {
+	type			= volume->type;
+	position		= transform.GetPosition();
+	rotation		= Matrix3(transform.GetOrientation());
+	halfLength		= 0.0f;
+	margin			= 0.0f;
+	points			= nullptr;
+	pointCount		= 0;
+
+	switch (volume->type) {
+		case VolumeType::AABB: {
+			rotation	= Matrix3();
+			halfSizes	= ((const AABBVolume&)*volume).GetHalfDimensions();
+		}break;
+		case VolumeType::OBB: {
+			halfSizes	= ((const OBBVolume&)*volume).GetHalfDimensions();
+		}break;
+		case VolumeType::Sphere: {
+			margin		= ((const SphereVolume&)*volume).GetRadius();
+		}break;
+		case VolumeType::Capsule: {
+			const CapsuleVolume& capsule = (const CapsuleVolume&)*volume;
+			margin		= capsule.GetRadius();
+			halfLength	= std::max(0.0f, capsule.GetHalfHeight() - capsule.GetRadius());
+		}break;
+		case VolumeType::ConvexHull: {
+			const ConvexHullVolume& hull = (const ConvexHullVolume&)*volume;
+			points		= hull.GetVertices().data();
+			pointCount	= (int)hull.GetVertices().size();
+		}break;
+		default: break;
+	}
+}
+
+ConvexShape::ConvexShape(const Vector3* points, int pointCount, const Transform& transform) {
+	type				= VolumeType::ConvexHull;
+	position			= transform.GetPosition();
+	rotation			= Matrix3(transform.GetOrientation());
+	halfLength			= 0.0f;
+	margin				= 0.0f;
+	this->points		= points;
+	this->pointCount	= pointCount;
+}
+
+Vector3 ConvexShape::Support(const Vector3& dir) const {
+	switch (type) {
+		case VolumeType::AABB:
+		case VolumeType::OBB: {
+			Vector3 localDir(	Vector3::Dot(rotation.GetColumn(0), dir),
+								Vector3::Dot(rotation.GetColumn(1), dir),
+								Vector3::Dot(rotation.GetColumn(2), dir));
+			Vector3 corner(	localDir.x >= 0.0f ? halfSizes.x : -halfSizes.x,
+							localDir.y >= 0.0f ? halfSizes.y : -halfSizes.y,
+							localDir.z >= 0.0f ? halfSizes.z : -halfSizes.z);
+			return position + rotation * corner;
+		}
+		case VolumeType::Capsule: {
+			Vector3 axis = rotation * Vector3(0, halfLength, 0);
+			return Vector3::Dot(dir, axis) >= 0.0f ? position + axis : position - axis;
+		}
+		case VolumeType::ConvexHull: {
+			Vector3 localDir(	Vector3::Dot(rotation.GetColumn(0), dir),
+								Vector3::Dot(rotation.GetColumn(1), dir),
+								Vector3::Dot(rotation.GetColumn(2), dir));
+			int		best	= 0;
+			float	bestDot	= -FLT_MAX;
+			for (int i = 0; i < pointCount; ++i) {
+				float d = Vector3::Dot(points[i], localDir);
+				if (d > bestDot) {
+					bestDot	= d;
+					best	= i;
+				}
+			}
+			return pointCount > 0 ? position + rotation * points[best] : position;
+		}
+		default: //a sphere's core is just its centre
+			return position;
+	}
+}
+
+Vector3 ConvexShape::SupportWithMargin(const Vector3& dir) const {
+	Vector3 point = Support(dir);
+	float length = dir.Length();
+	if (margin > 0.0f && length > 0.0f) {
+		point += dir * (margin / length);
+	}
+	return point;
+}
+
+GJK::SimplexVertex GJK::CoreSupport(const ConvexShape& a, const ConvexShape& b, const Vector3& dir) {
+	SimplexVertex v;
+	v.a = a.Support(dir);
+	v.b = b.Support(-dir);
+	v.w = v.a - v.b;
+	return v;
+}
+
+GJK::SimplexVertex GJK::FullSupport(const ConvexShape& a, const ConvexShape& b, const Vector3& dir) {
+	SimplexVertex v;
+	v.a = a.SupportWithMargin(dir);
+	v.b = b.SupportWithMargin(-dir);
+	v.w = v.a - v.b;
+	return v;
+}
+
+/*
+Finds the point on the simplex closest to the origin, and throws away any
+vertices that don't contribute to it. The weights left behind are the
+barycentric coordinates of that point, which give the closest points on
+the two shapes themselves.
+*/
+Vector3 GJK::ClosestOnSimplex(Simplex& s) {
+	switch (s.count) {
+		case 1: {
+			s.weights[0] = 1.0f;
+			return s.vertices[0].w;
+		}
+		case 2: {
+			Vector3 a	= s.vertices[0].w;
+			Vector3 ab	= s.vertices[1].w - a;
+			float lengthSq = Vector3::Dot(ab, ab);
+			float t = lengthSq > 0.0f ? -Vector3::Dot(a, ab) / lengthSq : 0.0f;
+			if (t <= 0.0f) {
+				s.count = 1;
+				s.weights[0] = 1.0f;
+				return a;
+			}
+			if (t >= 1.0f) {
+				s.vertices[0] = s.vertices[1];
+				s.count = 1;
+				s.weights[0] = 1.0f;
+				return s.vertices[0].w;
+			}
+			s.weights[0] = 1.0f - t;
+			s.weights[1] = t;
+			return a + ab * t;
+		}
+		case 3:
+			return ClosestOnTriangle(s);
+		default:
+			return ClosestOnTetrahedron(s);
+	}
+}
+
+//Voronoi region tests, from Ericson's Real-Time Collision Detection, with the query point at the origin
+Vector3 GJK::ClosestOnTriangle(Simplex& s) {
+	Vector3 a = s.vertices[0].w;
+	Vector3 b = s.vertices[1].w;
+	Vector3 c = s.vertices[2].w;
+
+	Vector3 ab = b - a;
+	Vector3 ac = c - a;
+
+	auto keepVertex = [&](int i) {
+		s.vertices[0]	= s.vertices[i];
+		s.weights[0]	= 1.0f;
+		s.count			= 1;
+		return s.vertices[0].w;
+	};
+	auto keepEdge = [&](int i, int j, float t) {
+		SimplexVertex vi = s.vertices[i];
+		SimplexVertex vj = s.vertices[j];
+		s.vertices[0]	= vi;
+		s.vertices[1]	= vj;
+		s.weights[0]	= 1.0f - t;
+		s.weights[1]	= t;
+		s.count			= 2;
+		return vi.w + (vj.w - vi.w) * t;
+	};
+
+	float d1 = -Vector3::Dot(ab, a);
+	float d2 = -Vector3::Dot(ac, a);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return keepVertex(0);
+	}
+
+	float d3 = -Vector3::Dot(ab, b);
+	float d4 = -Vector3::Dot(ac, b);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return keepVertex(1);
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		return keepEdge(0, 1, d1 / (d1 - d3));
+	}
+
+	float d5 = -Vector3::Dot(ab, c);
+	float d6 = -Vector3::Dot(ac, c);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return keepVertex(2);
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		return keepEdge(0, 2, d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		return keepEdge(1, 2, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denom = va + vb + vc;
+	if (denom <= 0.0f) { //degenerate triangle, fall back to its best edge
+		return keepEdge(0, 1, std::clamp(d1 / (d1 - d3), 0.0f, 1.0f));
+	}
+	float v = vb / denom;
+	float w = vc / denom;
+	s.weights[0] = 1.0f - v - w;
+	s.weights[1] = v;
+	s.weights[2] = w;
+	return a + ab * v + ac * w;
+}
+
+/*
+The origin is either inside the tetrahedron, in which case the shapes
+overlap, or closest to one of the faces it lies in front of.
+*/
+Vector3 GJK::ClosestOnTetrahedron(Simplex& s) {
+	static const int faces[4][4] = {
+		{0, 1, 2, 3},
+		{0, 2, 3, 1},
+		{0, 3, 1, 2},
+		{1, 3, 2, 0}
+	};
+
+	Simplex	best;
+	Vector3	bestPoint;
+	float	bestDistSq	= FLT_MAX;
+	bool	inside		= true;
+
+	for (int i = 0; i < 4; ++i) {
+		const SimplexVertex& a = s.vertices[faces[i][0]];
+		const SimplexVertex& b = s.vertices[faces[i][1]];
+		const SimplexVertex& c = s.vertices[faces[i][2]];
+		const SimplexVertex& d = s.vertices[faces[i][3]];
+
+		Vector3 normal		= Vector3::Cross(b.w - a.w, c.w - a.w);
+		float originSide	= -Vector3::Dot(a.w, normal);
+		float oppositeSide	= Vector3::Dot(d.w - a.w, normal);
+
+		//A flat tetrahedron has no inside, so every face gets tested
+		if (originSide * oppositeSide >= 0.0f && fabs(oppositeSide) > FLT_EPSILON) {
+			continue;
+		}
+		inside = false;
+
+		Simplex face;
+		face.vertices[0] = a;
+		face.vertices[1] = b;
+		face.vertices[2] = c;
+		face.count = 3;
+		Vector3 point = ClosestOnTriangle(face);
+		float distSq = Vector3::Dot(point, point);
+		if (distSq < bestDistSq) {
+			bestDistSq	= distSq;
+			bestPoint	= point;
+			best		= face;
+		}
+	}
+	if (inside) {
+		return Vector3();
+	}
+	s = best;
+	return bestPoint;
+}
+
+/*
+Returns true if the origin ended up inside the simplex (the shapes overlap),
+otherwise closest is the point on the Minkowski difference nearest to it.
+*/
+bool GJK::RunGJK(const ConvexShape& a, const ConvexShape& b, bool withMargin, Simplex& s, Vector3& closest) {
+	auto support = withMargin ? FullSupport : CoreSupport;
+
+	Vector3 dir = b.GetPosition() - a.GetPosition();
+	if (Vector3::Dot(dir, dir) < FLT_EPSILON) {
+		dir = Vector3(1, 0, 0);
+	}
+	s.vertices[0]	= support(a, b, dir);
+	s.weights[0]	= 1.0f;
+	s.count			= 1;
+	closest			= s.vertices[0].w;
+
+	for (int i = 0; i < MaxGJKIterations; ++i) {
+		float distSq = Vector3::Dot(closest, closest);
+		if (distSq < FLT_EPSILON * FLT_EPSILON) {
+			return true; //touching the origin counts as overlapping
+		}
+		SimplexVertex next = support(a, b, -closest);
+
+		//Can't get any closer to the origin than we already are
+		if (distSq - Vector3::Dot(next.w, closest) <= GJKTolerance * distSq) {
+			return false;
+		}
+		for (int j = 0; j < s.count; ++j) {
+			if (s.vertices[j].w == next.w) {
+				return false;
+			}
+		}
+		s.vertices[s.count++] = next;
+		closest = ClosestOnSimplex(s);
+		if (s.count == 4) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+EPA needs a tetrahedron to start from, but GJK can bail out as soon as the
+origin touches a lower dimensional simplex. Search along directions that
+aren't in the simplex yet until it has some volume.
+*/
+void GJK::FillTetrahedron(const ConvexShape& a, const ConvexShape& b, Simplex& s) {
+	static const Vector3 axes[6] = {
+		Vector3(1, 0, 0), Vector3(-1, 0, 0),
+		Vector3(0, 1, 0), Vector3(0, -1, 0),
+		Vector3(0, 0, 1), Vector3(0, 0, -1)
+	};
+	const float epsilon = 1e-6f;
+
+	if (s.count == 1) {
+		for (int i = 0; i < 6; ++i) {
+			SimplexVertex v = FullSupport(a, b, axes[i]);
+			if ((v.w - s.vertices[0].w).LengthSquared() > epsilon) {
+				s.vertices[s.count++] = v;
+				break;
+			}
+		}
+	}
+	if (s.count == 2) {
+		Vector3 line = s.vertices[1].w - s.vertices[0].w;
+		int axis = 0;
+		for (int i = 1; i < 3; ++i) {
+			if (fabs(line[i]) < fabs(line[axis])) {
+				axis = i;
+			}
+		}
+		Vector3 side = Vector3::Cross(line, axes[axis * 2]);
+		Vector3 dirs[4] = { side, -side, Vector3::Cross(line, side), -Vector3::Cross(line, side) };
+		for (int i = 0; i < 4; ++i) {
+			SimplexVertex v = FullSupport(a, b, dirs[i]);
+			if (Vector3::Cross(v.w - s.vertices[0].w, line).LengthSquared() > epsilon) {
+				s.vertices[s.count++] = v;
+				break;
+			}
+		}
+	}
+	if (s.count == 3) {
+		Vector3 normal = Vector3::Cross(s.vertices[1].w - s.vertices[0].w, s.vertices[2].w - s.vertices[0].w);
+		for (int i = 0; i < 2; ++i) {
+			SimplexVertex v = FullSupport(a, b, i == 0 ? normal : -normal);
+			if (fabs(Vector3::Dot(v.w - s.vertices[0].w, normal)) > epsilon) {
+				s.vertices[s.count++] = v;
+				break;
+			}
+		}
+	}
+}
+
+/*
+Expanding polytope algorithm - keep pushing out the face of the Minkowski
+difference closest to the origin until it's on the surface. That face's
+normal and distance are the contact normal and penetration depth.
+
+Everything is kept in fixed size arrays on the stack, as this gets called
+from the narrowphase jobs.
+*/
+bool GJK::RunEPA(const ConvexShape& a, const ConvexShape& b, Simplex& s, Vector3& normal, float& depth, Vector3& pointA, Vector3& pointB) {
+	if (s.count < 4) {
+		return false;
+	}
+	struct Face {
+		int		v[3];
+		Vector3	normal;
+		float	distance;
+	};
+	struct Edge {
+		int a;
+		int b;
+	};
+
+	SimplexVertex	vertices[MaxEPAVertices];
+	Face			faces[MaxEPAFaces];
+	Edge			edges[MaxEPAFaces * 3];
+	int				vertexCount	= 4;
+	int				faceCount	= 0;
+
+	Vector3 centre;
+	for (int i = 0; i < 4; ++i) {
+		vertices[i] = s.vertices[i];
+		centre += vertices[i].w * 0.25f;
+	}
+
+	auto addFace = [&](int i0, int i1, int i2) {
+		Vector3 n = Vector3::Cross(vertices[i1].w - vertices[i0].w, vertices[i2].w - vertices[i0].w);
+		float length = n.Length();
+		if (length < FLT_EPSILON || faceCount == MaxEPAFaces) {
+			return false;
+		}
+		Face& f = faces[faceCount++];
+		f.v[0]		= i0;
+		f.v[1]		= i1;
+		f.v[2]		= i2;
+		f.normal	= n / length;
+		f.distance	= Vector3::Dot(f.normal, vertices[i0].w);
+		return true;
+	};
+
+	static const int startFaces[4][3] = { {0, 1, 2}, {0, 3, 1}, {0, 2, 3}, {1, 3, 2} };
+	for (int i = 0; i < 4; ++i) {
+		int i0 = startFaces[i][0];
+		int i1 = startFaces[i][1];
+		int i2 = startFaces[i][2];
+		if (!addFace(i0, i1, i2)) {
+			return false;
+		}
+		Face& f = faces[faceCount - 1];
+		if (Vector3::Dot(f.normal, vertices[i0].w - centre) < 0.0f) { //wound inwards
+			std::swap(f.v[1], f.v[2]);
+			f.normal	= -f.normal;
+			f.distance	= -f.distance;
+		}
+	}
+
+	int closest = 0;
+	for (int iteration = 0; iteration < MaxEPAIterations; ++iteration) {
+		closest = 0;
+		for (int i = 1; i < faceCount; ++i) {
+			if (faces[i].distance < faces[closest].distance) {
+				closest = i;
+			}
+		}
+		Face& nearest = faces[closest];
+		SimplexVertex next = FullSupport(a, b, nearest.normal);
+		if (Vector3::Dot(next.w, nearest.normal) - nearest.distance < EPATolerance || vertexCount == MaxEPAVertices) {
+			break;
+		}
+
+		//Remove every face the new point can see, keeping the edges around the hole
+		int edgeCount = 0;
+		for (int i = 0; i < faceCount;) {
+			Face& f = faces[i];
+			if (Vector3::Dot(f.normal, next.w - vertices[f.v[0]].w) <= 0.0f) {
+				++i;
+				continue;
+			}
+			for (int e = 0; e < 3; ++e) {
+				Edge edge = { f.v[e], f.v[(e + 1) % 3] };
+				bool shared = false;
+				for (int j = 0; j < edgeCount; ++j) {
+					if (edges[j].a == edge.b && edges[j].b == edge.a) {
+						edges[j] = edges[--edgeCount];
+						shared = true;
+						break;
+					}
+				}
+				if (!shared) {
+					edges[edgeCount++] = edge;
+				}
+			}
+			faces[i] = faces[--faceCount];
+		}
+
+		int newIndex = vertexCount++;
+		vertices[newIndex] = next;
+		for (int i = 0; i < edgeCount; ++i) {
+			addFace(edges[i].a, edges[i].b, newIndex);
+		}
+		if (faceCount == 0) {
+			return false;
+		}
+	}
+
+	const Face& f = faces[closest];
+	const SimplexVertex& v0 = vertices[f.v[0]];
+	const SimplexVertex& v1 = vertices[f.v[1]];
+	const SimplexVertex& v2 = vertices[f.v[2]];
+
+	//Barycentric coordinates of the origin's projection onto the face
+	Vector3 p	= f.normal * f.distance;
+	Vector3 e0	= v1.w - v0.w;
+	Vector3 e1	= v2.w - v0.w;
+	Vector3 e2	= p - v0.w;
+	float d00	= Vector3::Dot(e0, e0);
+	float d01	= Vector3::Dot(e0, e1);
+	float d11	= Vector3::Dot(e1, e1);
+	float d20	= Vector3::Dot(e2, e0);
+	float d21	= Vector3::Dot(e2, e1);
+	float denom	= d00 * d11 - d01 * d01;
+
+	float u = 1.0f, v = 0.0f, w = 0.0f;
+	if (denom > FLT_EPSILON) {
+		v = (d11 * d20 - d01 * d21) / denom;
+		w = (d00 * d21 - d01 * d20) / denom;
+		u = 1.0f - v - w;
+	}
+	pointA	= v0.a * u + v1.a * v + v2.a * w;
+	pointB	= v0.b * u + v1.b * v + v2.b * w;
+	normal	= f.normal;
+	depth	= f.distance;
+	return true;
+}
+
+float GJK::Distance(const ConvexShape& a, const ConvexShape& b, Vector3& closestA, Vector3& closestB) {
+	Simplex s;
+	Vector3 closest;
+	if (RunGJK(a, b, false, s, closest)) {
+		closestA = closestB = Vector3();
+		return 0.0f;
+	}
+	closestA = Vector3();
+	closestB = Vector3();
+	for (int i = 0; i < s.count; ++i) {
+		closestA += s.vertices[i].a * s.weights[i];
+		closestB += s.vertices[i].b * s.weights[i];
+	}
+	return closest.Length();
+}
+
+bool GJK::Intersection(const ConvexShape& a, const ConvexShape& b, CollisionDetection::CollisionInfo& collisionInfo) {
+	float margins = a.GetMargin() + b.GetMargin();
+
+	Vector3 closestA;
+	Vector3 closestB;
+	float distance = Distance(a, b, closestA, closestB);
+	if (distance >= margins && (distance > 0.0f || margins > 0.0f)) {
+		return false;
+	}
+
+	//Only the rounded parts overlap - the contact comes straight from the cores
+	if (distance > TouchingDistance) {
+		Vector3 normal = (closestB - closestA) / distance;
+		Vector3 pointA = closestA + normal * a.GetMargin();
+		Vector3 pointB = closestB - normal * b.GetMargin();
+		collisionInfo.AddContactPoint(pointA - a.GetPosition(), pointB - b.GetPosition(), normal, margins - distance);
+		return true;
+	}
+
+	//The cores themselves overlap, so expand out the whole shapes instead
+	Simplex s;
+	Vector3 closest;
+	if (!RunGJK(a, b, true, s, closest) && Vector3::Dot(closest, closest) > TouchingDistance * TouchingDistance) {
+		return false;
+	}
+	FillTetrahedron(a, b, s);
+
+	Vector3 normal;
+	float	depth;
+	Vector3 pointA;
+	Vector3 pointB;
+	if (!RunEPA(a, b, s, normal, depth, pointA, pointB) || depth <= 0.0f) {
+		return false;
+	}
+	collisionInfo.AddContactPoint(pointA - a.GetPosition(), pointB - b.GetPosition(), normal, depth);
+	return true;
+}
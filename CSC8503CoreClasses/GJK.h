@@ -0,0 +1,90 @@
+#pragma once
+#include "CollisionDetection.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+
+	/*
+	Any convex collision volume, described only by its support function - the
+	point on the shape furthest along a given direction. That's all GJK and EPA
+	need to know about a shape, so supporting a new volume type only means
+	adding a case to Support, rather than a new test for every other type.
+
+	Spheres and capsules are treated as a 'core' (a point or a line segment)
+	with a rounded margin around it. Running GJK on the cores, and adding the
+	margins back on afterwards, is both faster and more accurate than trying
+	to converge on a curved surface.
+	*/
+	class ConvexShape {
+	public:
+		ConvexShape(const CollisionVolume* volume, const Transform& transform);
+
+		//A set of points in the transform's local space, such as one triangle of a mesh
+		ConvexShape(const Vector3* points, int pointCount, const Transform& transform);
+
+		//Furthest point of the core along dir
+		Vector3 Support(const Vector3& dir) const;
+
+		//Furthest point of the whole shape, margin included
+		Vector3 SupportWithMargin(const Vector3& dir) const;
+
+		float GetMargin() const {
+			return margin;
+		}
+
+		Vector3 GetPosition() const {
+			return position;
+		}
+
+	protected:
+		VolumeType		type;
+		Vector3			position;
+		Matrix3			rotation;	//local to world
+		Vector3			halfSizes;	//boxes only
+		float			halfLength;	//capsule core only
+		float			margin;
+		const Vector3*	points;		//hulls only
+		int				pointCount;
+	};
+
+	class GJK {
+	public:
+		/*
+		Distance between the two shapes' cores, along with the closest point
+		on each. Returns 0 if the cores overlap.
+		*/
+		static float Distance(const ConvexShape& a, const ConvexShape& b, Vector3& closestA, Vector3& closestB);
+
+		/*
+		Full contact test. Separated cores within the margins give the contact
+		straight from the distance query, and overlapping shapes have EPA find
+		the shallowest way of separating them. Normal points from a to b, as
+		with the rest of the collision tests.
+		*/
+		static bool Intersection(const ConvexShape& a, const ConvexShape& b, CollisionDetection::CollisionInfo& collisionInfo);
+
+	protected:
+		struct SimplexVertex {
+			Vector3 w;	//a - b
+			Vector3 a;
+			Vector3 b;
+		};
+
+		struct Simplex {
+			SimplexVertex	vertices[4];
+			float			weights[4];
+			int				count = 0;
+		};
+
+		static SimplexVertex CoreSupport(const ConvexShape& a, const ConvexShape& b, const Vector3& dir);
+		static SimplexVertex FullSupport(const ConvexShape& a, const ConvexShape& b, const Vector3& dir);
+
+		static Vector3	ClosestOnSimplex(Simplex& s);
+		static Vector3	ClosestOnTriangle(Simplex& s);
+		static Vector3	ClosestOnTetrahedron(Simplex& s);
+
+		static bool		RunGJK(const ConvexShape& a, const ConvexShape& b, bool withMargin, Simplex& s, Vector3& closest);
+		static void		FillTetrahedron(const ConvexShape& a, const ConvexShape& b, Simplex& s);
+		static bool		RunEPA(const ConvexShape& a, const ConvexShape& b, Simplex& s, Vector3& normal, float& depth, Vector3& pointA, Vector3& pointB);
+	};
+}
@@ -9,6 +9,7 @@ using namespace NCL::CSC8503;
 GameObject::GameObject(const std::string& objectName)	{
 	name			= objectName;
 	worldID			= -1;
+	layer			= 0;
 	isActive		= true;
 	boundingVolume	= nullptr;
 	physicsObject	= nullptr;
@@ -48,4 +49,18 @@ void GameObject::UpdateBroadphaseAABB() {
 		Vector3 halfSizes = ((OBBVolume&)*boundingVolume).GetHalfDimensions();
 		broadphaseAABB = mat * halfSizes;
 	}
+	else if (boundingVolume->type == VolumeType::Capsule) {
+		Matrix3 mat = Matrix3(transform.GetOrientation());
+		mat = mat.Absolute();
+		const CapsuleVolume& capsule = (const CapsuleVolume&)*boundingVolume;
+		float r = capsule.GetRadius();
+		broadphaseAABB = mat * Vector3(r, std::max(capsule.GetHalfHeight(), r), r); //the half height includes the end caps
+	}
+	else if (boundingVolume->type == VolumeType::ConvexHull || boundingVolume->type == VolumeType::Mesh) {
+		Matrix3 mat = Matrix3(transform.GetOrientation());
+		mat = mat.Absolute();
+		Vector3 halfSizes = boundingVolume->type == VolumeType::Mesh ?
+			((TriangleMeshVolume&)*boundingVolume).GetHalfDimensions() : ((ConvexHullVolume&)*boundingVolume).GetHalfDimensions();
+		broadphaseAABB = mat * halfSizes;
+	}
 }
\ No newline at end of file
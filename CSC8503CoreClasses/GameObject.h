@@ -81,6 +81,19 @@ namespace NCL::CSC8503 {
 			return worldID;
 		}
 
+		//Which of the 32 layers the object is on - queries take a mask of the layers they want
+		void SetLayer(int newLayer) {
+			layer = newLayer;
+		}
+
+		int GetLayer() const {
+			return layer;
+		}
+
+		unsigned int GetLayerMask() const {
+			return 1u << layer;
+		}
+
 	protected:
 		Transform			transform;
 
@@ -91,6 +104,7 @@ namespace NCL::CSC8503 {
 
 		bool		isActive;
 		int			worldID;
+		int			layer;
 		std::string	name;
 
 		Vector3 broadphaseAABB;
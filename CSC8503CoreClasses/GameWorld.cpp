@@ -1,8 +1,13 @@
 #include "GameWorld.h"
 #include "GameObject.h"
+#include "PhysicsObject.h"
 #include "Constraint.h"
 #include "CollisionDetection.h"
 #include "Camera.h"
+#include "RayPacket.h"
+#include "SphereVolume.h"
+#include "AABBVolume.h"
+#include "CapsuleVolume.h"
 
 
 using namespace NCL;
@@ -14,6 +19,8 @@ GameWorld::GameWorld()	{
 	shuffleObjects		= false;
 	worldIDCounter		= 0;
 	worldStateCounter	= 0;
+	interpolationAlpha	= 1.0f;
+	randomEngine.seed((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
 }
 
 GameWorld::~GameWorld()	{
@@ -22,6 +29,8 @@ GameWorld::~GameWorld()	{
 void GameWorld::Clear() {
 	gameObjects.clear();
 	constraints.clear();
+	queryTree.Clear();
+	queryProxies.clear();
 	worldIDCounter		= 0;
 	worldStateCounter	= 0;
 }
@@ -44,6 +53,11 @@ void GameWorld::AddGameObject(GameObject* o) {
 
 void GameWorld::RemoveGameObject(GameObject* o, bool andDelete) {
 	gameObjects.erase(std::remove(gameObjects.begin(), gameObjects.end(), o), gameObjects.end());
+	int id = o->GetWorldID();
+	if (id >= 0 && id < (int)queryProxies.size() && queryProxies[id] != DynamicAABBTree<GameObject*>::NullNode) {
+		queryTree.DestroyProxy(queryProxies[id]);
+		queryProxies[id] = DynamicAABBTree<GameObject*>::NullNode;
+	}
 	if (andDelete) {
 		delete o;
 	}
@@ -65,55 +79,324 @@ void GameWorld::OperateOnContents(GameObjectFunc f) {
 }
 
 void GameWorld::UpdateWorld(float dt) {
-	auto rng = std::default_random_engine{};
-
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::default_random_engine e(seed);
-
 	if (shuffleObjects) {
-		std::shuffle(gameObjects.begin(), gameObjects.end(), e);
+		std::shuffle(gameObjects.begin(), gameObjects.end(), randomEngine);
 	}
 
 	if (shuffleConstraints) {
-		std::shuffle(constraints.begin(), constraints.end(), e);
+		std::shuffle(constraints.begin(), constraints.end(), randomEngine);
 	}
+	UpdateQueryTree();
 }
 
-bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObject, GameObject* ignoreThis) const {
-	//The simplest raycast just goes through each object and sees if there's a collision
-	RayCollision collision;
+/*
+Objects stay in the tree with a slightly fat box, so only those that have
+moved a fair way since last time actually need to be reinserted. Static
+bodies never move, so once they're in, they're left alone.
+*/
+void GameWorld::UpdateQueryTree() {
+	for (GameObject* g : gameObjects) {
+		int id = g->GetWorldID();
+		if (id >= (int)queryProxies.size()) {
+			queryProxies.resize(id + 1, DynamicAABBTree<GameObject*>::NullNode);
+		}
+		int& proxy = queryProxies[id];
 
-	for (auto& i : gameObjects) {
-		if (!i->GetBoundingVolume()) { //objects might not be collideable etc...
+		PhysicsObject* phys = g->GetPhysicsObject();
+		if (phys && phys->IsStatic() && proxy != DynamicAABBTree<GameObject*>::NullNode) {
 			continue;
 		}
-		if (i == ignoreThis) {
+
+		Vector3 halfSizes;
+		g->UpdateBroadphaseAABB();
+		if (!g->GetBroadphaseAABB(halfSizes)) {
+			if (proxy != DynamicAABBTree<GameObject*>::NullNode) {
+				queryTree.DestroyProxy(proxy); //lost its volume
+				proxy = DynamicAABBTree<GameObject*>::NullNode;
+			}
 			continue;
 		}
+		TreeAABB box = TreeAABB::FromHalfSizes(g->GetTransform().GetPosition(), halfSizes);
+		if (proxy == DynamicAABBTree<GameObject*>::NullNode) {
+			proxy = queryTree.CreateProxy(box, g);
+		}
+		else {
+			queryTree.MoveProxy(proxy, box);
+		}
+	}
+}
+
+/*
+Rather than testing the ray against every object, we walk the query tree,
+nearest boxes first. Once something has been hit, any box further away
+than it can be skipped, and if we'll take any hit at all, the first one
+found ends the search.
+*/
+bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObject, GameObject* ignoreThis, unsigned int layerMask) const {
+	RayCollision collision;
+
+	queryTree.RayQuery(r.GetPosition(), r.GetDirection(), FLT_MAX, [&](int proxy) {
+		GameObject* i = queryTree.GetObject(proxy);
+		if (i == ignoreThis || !(i->GetLayerMask() & layerMask) || !i->GetBoundingVolume()) {
+			return collision.rayDistance;
+		}
 		RayCollision thisCollision;
-		if (CollisionDetection::RayIntersection(r, *i, thisCollision)) {
-				
-			if (!closestObject) {	
-				closestCollision		= collision;
-				closestCollision.node = i;
-				return true;
+		if (CollisionDetection::RayIntersection(r, *i, thisCollision) && thisCollision.rayDistance < collision.rayDistance) {
+			thisCollision.node = i;
+			collision = thisCollision;
+			if (!closestObject) {
+				return -1.0f;
+			}
+		}
+		return collision.rayDistance;
+	});
+
+	if (collision.node) {
+		closestCollision = collision;
+		return true;
+	}
+	return false;
+}
+
+
+/*
+Axis aligned boxes and spheres are tested against all four rays of a packet
+at once - anything else falls back to the single ray tests, for just the
+rays that reach it.
+*/
+int GameWorld::RaycastBatch(const Ray* rays, RayCollision* results, int count, unsigned int layerMask) const {
+	int hitCount = 0;
+
+	for (int first = 0; first < count; first += RayPacket::Width) {
+		int lanes = std::min(RayPacket::Width, count - first);
+		RayPacket packet(rays + first, lanes);
+		RayCollision* packetResults = results + first;
+		for (int lane = 0; lane < lanes; ++lane) {
+			packetResults[lane] = RayCollision();
+		}
+
+		queryTree.PacketQuery(packet, [&](int proxy, int mask) {
+			GameObject* o = queryTree.GetObject(proxy);
+			const CollisionVolume* volume = o->GetBoundingVolume();
+			if (!volume || !(o->GetLayerMask() & layerMask)) {
+				return;
+			}
+			float distances[RayPacket::Width];
+			int hitMask = 0;
+			if (volume->type == VolumeType::AABB) {
+				hitMask = packet.IntersectBox(o->GetTransform().GetPosition(), ((const AABBVolume&)*volume).GetHalfDimensions(), distances);
+			}
+			else if (volume->type == VolumeType::Sphere) {
+				hitMask = packet.IntersectSphere(o->GetTransform().GetPosition(), ((const SphereVolume&)*volume).GetRadius(), distances);
 			}
 			else {
-				if (thisCollision.rayDistance < collision.rayDistance) {
-					thisCollision.node = i;
-					collision = thisCollision;
+				for (int lane = 0; lane < lanes; ++lane) {
+					RayCollision laneCollision;
+					if ((mask & (1 << lane)) && CollisionDetection::RayIntersection(rays[first + lane], *o, laneCollision)) {
+						distances[lane] = laneCollision.rayDistance;
+						hitMask |= 1 << lane;
+					}
+				}
+			}
+			hitMask &= mask;
+
+			for (int lane = 0; lane < lanes; ++lane) {
+				if (!(hitMask & (1 << lane)) || distances[lane] >= packetResults[lane].rayDistance) {
+					continue;
 				}
+				packetResults[lane].node		= o;
+				packetResults[lane].rayDistance	= distances[lane];
+				packetResults[lane].collidedAt	= packet.GetOrigin(lane) + packet.GetDirection(lane) * distances[lane];
+				packet.SetMaxDistance(lane, distances[lane]);
+			}
+		});
+
+		for (int lane = 0; lane < lanes; ++lane) {
+			if (packetResults[lane].node) {
+				hitCount++;
 			}
 		}
 	}
-	if (collision.node) {
-		closestCollision		= collision;
-		closestCollision.node	= collision.node;
-		return true;
+	return hitCount;
+}
+
+/*
+The overlap queries get their candidates from the query tree, and then use the
+same pair tests as the physics, against a volume that only lives on the stack.
+*/
+int GameWorld::OverlapSphere(const Vector3& centre, float radius, GameObject** results, int maxResults, unsigned int layerMask) const {
+	SphereVolume sphere(radius);
+	Transform shape;
+	shape.SetPosition(centre);
+
+	if (maxResults <= 0) {
+		return 0;
 	}
-	return false;
+	int count = 0;
+	queryTree.Query(TreeAABB::FromHalfSizes(centre, Vector3(radius, radius, radius)), [&](int proxy) {
+		GameObject* o = queryTree.GetObject(proxy);
+		CollisionDetection::CollisionInfo info;
+		if ((o->GetLayerMask() & layerMask) &&
+			CollisionDetection::VolumeIntersection((const CollisionVolume*)&sphere, shape, o->GetBoundingVolume(), o->GetTransform(), info)) {
+			results[count++] = o;
+		}
+		return count < maxResults;
+	});
+	return count;
+}
+
+int GameWorld::OverlapAABB(const Vector3& centre, const Vector3& halfSizes, GameObject** results, int maxResults, unsigned int layerMask) const {
+	AABBVolume box(halfSizes);
+	Transform shape;
+	shape.SetPosition(centre);
+
+	if (maxResults <= 0) {
+		return 0;
+	}
+	int count = 0;
+	queryTree.Query(TreeAABB::FromHalfSizes(centre, halfSizes), [&](int proxy) {
+		GameObject* o = queryTree.GetObject(proxy);
+		CollisionDetection::CollisionInfo info;
+		if ((o->GetLayerMask() & layerMask) &&
+			CollisionDetection::VolumeIntersection((const CollisionVolume*)&box, shape, o->GetBoundingVolume(), o->GetTransform(), info)) {
+			results[count++] = o;
+		}
+		return count < maxResults;
+	});
+	return count;
+}
+
+//The results buffer is kept sorted as we go, with the furthest dropping off the end once it's full
+int GameWorld::NearestObjects(const Vector3& point, float maxDistance, GameObject** results, int maxResults, unsigned int layerMask) const {
+	if (maxResults <= 0) {
+		return 0;
+	}
+	int count = 0;
+	float limitSq = maxDistance * maxDistance;
+
+	queryTree.Query(TreeAABB::FromHalfSizes(point, Vector3(maxDistance, maxDistance, maxDistance)), [&](int proxy) {
+		GameObject* o = queryTree.GetObject(proxy);
+		if (!(o->GetLayerMask() & layerMask)) {
+			return true;
+		}
+		float distanceSq = (o->GetTransform().GetPosition() - point).LengthSquared();
+		if (distanceSq > limitSq) {
+			return true;
+		}
+		int slot = count < maxResults ? count++ : maxResults - 1;
+		while (slot > 0 && (results[slot - 1]->GetTransform().GetPosition() - point).LengthSquared() > distanceSq) {
+			results[slot] = results[slot - 1];
+			slot--;
+		}
+		results[slot] = o;
+		if (count == maxResults) {
+			//nothing further than the furthest we're keeping can get in now
+			limitSq = (results[count - 1]->GetTransform().GetPosition() - point).LengthSquared();
+		}
+		return true;
+	});
+	return count;
+}
+
+bool GameWorld::SphereCast(const Vector3& start, float radius, const Vector3& direction, float maxDistance, RayCollision& hit,
+						   unsigned int layerMask, GameObject* ignore) const {
+	SphereVolume sphere(radius);
+	Transform shape;
+	shape.SetPosition(start);
+	return ShapeCast((const CollisionVolume&)sphere, shape, Vector3(radius, radius, radius), direction, maxDistance, radius * 0.5f, hit, layerMask, ignore);
+}
+
+bool GameWorld::CapsuleCast(const Vector3& start, const Quaternion& orientation, float halfHeight, float radius, const Vector3& direction,
+							float maxDistance, RayCollision& hit, unsigned int layerMask, GameObject* ignore) const {
+	CapsuleVolume capsule(halfHeight, radius);
+	Transform shape;
+	shape.SetPosition(start).SetOrientation(orientation);
+
+	Vector3 axis = orientation * Vector3(0, halfHeight - radius, 0);
+	Vector3 halfSizes(abs(axis.x) + radius, abs(axis.y) + radius, abs(axis.z) + radius);
+	return ShapeCast(capsule, shape, halfSizes, direction, maxDistance, radius * 0.5f, hit, layerMask, ignore);
 }
 
+/*
+Shapes are swept by stepping them along the path, a fraction of their
+radius at a time (so nothing thicker than that can be skipped over),
+and then closing in on the exact distance by bisection once they touch.
+Each candidate is only stepped through for the part of the path where
+the boxes around them overlap, and never past the closest hit so far.
+*/
+bool GameWorld::ShapeCast(const CollisionVolume& volume, Transform shape, const Vector3& halfSizes, const Vector3& direction,
+						  float maxDistance, float stepSize, RayCollision& hit, unsigned int layerMask, GameObject* ignore) const {
+	Vector3 start = shape.GetPosition();
+	Vector3 inverseDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	stepSize = std::max(stepSize, 0.001f);
+
+	TreeAABB path = TreeAABB::Merge(TreeAABB::FromHalfSizes(start, halfSizes),
+									TreeAABB::FromHalfSizes(start + direction * maxDistance, halfSizes));
+	hit = RayCollision();
+
+	queryTree.Query(path, [&](int proxy) {
+		GameObject* o = queryTree.GetObject(proxy);
+		Vector3 otherHalfSizes;
+		if (o == ignore || !(o->GetLayerMask() & layerMask) || !o->GetBroadphaseAABB(otherHalfSizes)) {
+			return true;
+		}
+		float limit = std::min(maxDistance, hit.rayDistance);
+		float entry;
+		TreeAABB reach = TreeAABB::FromHalfSizes(o->GetTransform().GetPosition(), otherHalfSizes + halfSizes);
+		if (!reach.RayEntry(start, inverseDir, limit, entry)) {
+			return true;
+		}
+		CollisionDetection::CollisionInfo info;
+		auto touchingAt = [&](float distance) {
+			shape.SetPosition(start + direction * distance);
+			info = CollisionDetection::CollisionInfo();
+			info.b = o;
+			return CollisionDetection::VolumeIntersection(&volume, shape, o->GetBoundingVolume(), o->GetTransform(), info);
+		};
+
+		float free = entry;
+		float touching = -1.0f;
+		if (touchingAt(entry)) {
+			touching = entry;
+		}
+		for (float d = entry; touching < 0.0f && d < limit; ) {
+			d = std::min(d + stepSize, limit);
+			if (touchingAt(d)) {
+				touching = d;
+			}
+			else {
+				free = d;
+			}
+		}
+		if (touching < 0.0f) {
+			return true;
+		}
+		if (touching > entry) {
+			for (int i = 0; i < 10; ++i) {
+				float middle = (free + touching) * 0.5f;
+				if (touchingAt(middle)) {
+					touching = middle;
+				}
+				else {
+					free = middle;
+				}
+			}
+		}
+		touchingAt(touching);
+
+		//the collision normal points from a to b, and the test may have swapped them round
+		Vector3 normal = -direction;
+		if (info.pointCount > 0) {
+			normal = info.a == o ? info.points[0].normal : -info.points[0].normal;
+		}
+		hit.node			= o;
+		hit.rayDistance		= touching;
+		hit.collidedAt		= start + direction * touching;
+		hit.collidedNormal	= normal;
+		return true;
+	});
+	return hit.node != nullptr;
+}
 
 /*
 Constraint Tutorial Stuff
@@ -4,6 +4,7 @@
 #include "Ray.h"
 #include "CollisionDetection.h"
 #include "QuadTree.h"
+#include "DynamicAABBTree.h"
 namespace NCL {
 		class Camera;
 		using Maths::Ray;
@@ -12,6 +13,8 @@ namespace NCL {
 		class Constraint;
 
 		typedef std::function<void(GameObject*)> GameObjectFunc;
+
+		const unsigned int AllLayers = ~0u;
 		typedef std::vector<GameObject*>::const_iterator GameObjectIterator;
 
 		class GameWorld	{
@@ -46,7 +49,50 @@ namespace NCL {
 				shuffleObjects = state;
 			}
 
-			bool Raycast(Ray& r, RayCollision& closestCollision, bool closestObject = false, GameObject* ignore = nullptr) const;
+			//The shuffles are seeded from the clock, unless a run needs to be repeatable
+			void SetRandomSeed(unsigned int seed) {
+				randomEngine.seed(seed);
+			}
+
+			//Only objects on one of the layers in layerMask can be hit
+			bool Raycast(Ray& r, RayCollision& closestCollision, bool closestObject = false, GameObject* ignore = nullptr, unsigned int layerMask = AllLayers) const;
+
+			/*
+			Queries use a bounding volume tree of every object, refreshed by
+			UpdateWorld and the physics. Anything moved by hand in between
+			(by more than the tree's margin) should refresh it before querying.
+			*/
+			void UpdateQueryTree();
+
+			/*
+			Finds the closest hit for each of a whole array of rays, filling in
+			one result per ray, and returns how many of them hit anything. Rays
+			are processed four at a time, so nearby rays heading the same way
+			(lots of visibility checks from one agent, say) are best kept together.
+			*/
+			int RaycastBatch(const Ray* rays, RayCollision* results, int count, unsigned int layerMask = AllLayers) const;
+
+			/*
+			Shape queries. The overlap and nearest queries write up to maxResults
+			objects into the caller's buffer, and return how many they found, so
+			they can be run every frame without allocating anything.
+			*/
+			int OverlapSphere(const Vector3& centre, float radius, GameObject** results, int maxResults, unsigned int layerMask = AllLayers) const;
+			int OverlapAABB(const Vector3& centre, const Vector3& halfSizes, GameObject** results, int maxResults, unsigned int layerMask = AllLayers) const;
+
+			//Closest first, by distance between centres
+			int NearestObjects(const Vector3& point, float maxDistance, GameObject** results, int maxResults, unsigned int layerMask = AllLayers) const;
+
+			/*
+			Sweeps a shape from start along direction (which should be normalised),
+			and finds the first thing it would touch. The hit distance is how far
+			the shape got, collidedAt is where its centre was at the time, and
+			collidedNormal points out of the object that was hit.
+			*/
+			bool SphereCast(const Vector3& start, float radius, const Vector3& direction, float maxDistance, RayCollision& hit,
+							unsigned int layerMask = AllLayers, GameObject* ignore = nullptr) const;
+			bool CapsuleCast(const Vector3& start, const Quaternion& orientation, float halfHeight, float radius, const Vector3& direction,
+							 float maxDistance, RayCollision& hit, unsigned int layerMask = AllLayers, GameObject* ignore = nullptr) const;
 
 			virtual void UpdateWorld(float dt);
 
@@ -64,7 +110,19 @@ namespace NCL {
 				return worldStateCounter;
 			}
 
+			//How far between the last two physics steps the current frame is
+			void SetInterpolationAlpha(float alpha) {
+				interpolationAlpha = alpha;
+			}
+
+			float GetInterpolationAlpha() const {
+				return interpolationAlpha;
+			}
+
 		protected:
+			bool ShapeCast(const CollisionVolume& volume, Transform shape, const Vector3& halfSizes, const Vector3& direction,
+						   float maxDistance, float stepSize, RayCollision& hit, unsigned int layerMask, GameObject* ignore) const;
+
 			std::vector<GameObject*> gameObjects;
 			std::vector<Constraint*> constraints;
 
@@ -72,8 +130,13 @@ namespace NCL {
 
 			bool shuffleConstraints;
 			bool shuffleObjects;
+			std::default_random_engine randomEngine;
 			int		worldIDCounter;
 			int		worldStateCounter;
+			float	interpolationAlpha;
+
+			DynamicAABBTree<GameObject*>	queryTree;
+			std::vector<int>				queryProxies; //indexed by world ID
 		};
 	}
 }
@@ -0,0 +1,92 @@
+#include "JobSystem.h"
+
+using namespace NCL;
+using namespace NCL::CSC8503;
+
+JobSystem::JobSystem(int threadCount) {
+	if (threadCount <= 0) {
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	jobGeneration	= 0;
+	quit			= false;
+	jobFunc			= nullptr;
+	jobCount		= 0;
+	jobBatchSize	= 1;
+	nextIndex		= 0;
+	pendingWorkers	= 0;
+
+	//The calling thread is thread 0, so we only need to make the rest
+	for (int i = 1; i < threadCount; ++i) {
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		quit = true;
+	}
+	jobStart.notify_all();
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
+void JobSystem::ParallelFor(int count, const ParallelForFunc& func, int minBatch) {
+	if (count <= 0) {
+		return;
+	}
+	minBatch = std::max(1, minBatch);
+	if (workers.empty() || count <= minBatch) {
+		func(0, count, 0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobFunc			= &func;
+		jobCount		= count;
+		//A few batches per thread, so that a thread with expensive pairs doesn't hold everyone up
+		jobBatchSize	= std::max(minBatch, count / (GetThreadCount() * 4));
+		nextIndex		= 0;
+		pendingWorkers	= (int)workers.size();
+		jobGeneration++;
+	}
+	jobStart.notify_all();
+
+	RunBatches(0);
+
+	std::unique_lock<std::mutex> lock(jobMutex);
+	jobDone.wait(lock, [&] { return pendingWorkers == 0; });
+	jobFunc = nullptr;
+}
+
+void JobSystem::WorkerLoop(int threadIndex) {
+	int seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobStart.wait(lock, [&] { return quit || jobGeneration != seenGeneration; });
+			if (quit) {
+				return;
+			}
+			seenGeneration = jobGeneration;
+		}
+		RunBatches(threadIndex);
+
+		if (--pendingWorkers == 0) {
+			std::lock_guard<std::mutex> lock(jobMutex);
+			jobDone.notify_one();
+		}
+	}
+}
+
+void JobSystem::RunBatches(int threadIndex) {
+	while (true) {
+		int begin = nextIndex.fetch_add(jobBatchSize);
+		if (begin >= jobCount) {
+			return;
+		}
+		int end = std::min(begin + jobBatchSize, jobCount);
+		(*jobFunc)(begin, end, threadIndex);
+	}
+}
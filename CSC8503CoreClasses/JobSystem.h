@@ -0,0 +1,54 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+
+namespace NCL {
+	namespace CSC8503 {
+		//func(begin, end, threadIndex) - threadIndex is 0 for the calling thread, and below GetThreadCount()
+		typedef std::function<void(int, int, int)> ParallelForFunc;
+
+		/*
+		A small pool of persistent worker threads, for splitting a loop over
+		lots of independent items (collision pairs, constraint batches) across
+		all of the cores. The threads sleep between jobs, rather than being
+		created each time, and the calling thread joins in with the work too.
+
+		Only one ParallelFor can be running at once, so it should only be
+		called from whichever thread owns the JobSystem.
+		*/
+		class JobSystem	{
+		public:
+			JobSystem(int threadCount = 0); //0 means one thread per hardware core
+			~JobSystem();
+
+			int GetThreadCount() const {
+				return (int)workers.size() + 1;
+			}
+
+			/*
+			Calls func over [0, count) in chunks of (at least) minBatch items,
+			and returns once all of them are done. Small jobs are just run on
+			the calling thread, as waking the workers would cost more.
+			*/
+			void ParallelFor(int count, const ParallelForFunc& func, int minBatch = 16);
+
+		protected:
+			void WorkerLoop(int threadIndex);
+			void RunBatches(int threadIndex);
+
+			std::vector<std::thread>	workers;
+
+			std::mutex				jobMutex;
+			std::condition_variable	jobStart;
+			std::condition_variable	jobDone;
+			int						jobGeneration;
+			bool					quit;
+
+			const ParallelForFunc*	jobFunc;
+			int						jobCount;
+			int						jobBatchSize;
+			std::atomic<int>		nextIndex;
+			std::atomic<int>		pendingWorkers;
+		};
+	}
+}
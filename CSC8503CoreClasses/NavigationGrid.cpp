@@ -2,6 +2,7 @@
 #include "Assets.h"
 
 #include <fstream>
+#include <algorithm>
 
 using namespace NCL;
 using namespace CSC8503;
@@ -14,11 +15,37 @@ const int BOTTOM_NODE = 3;
 const char WALL_NODE = 'x';
 const char FLOOR_NODE = '.';
 
+// a run of open nodes along a cluster border longer than this gets an entrance at each end
+const int MAX_SINGLE_ENTRANCE = 5;
+
+// the 8 directions jump point search can move in - straight ones first
+const int JUMP_DIRECTIONS = 8;
+const int DIRECTION_X[JUMP_DIRECTIONS] = {1, -1, 0, 0, 1, -1, 1, -1};
+const int DIRECTION_Y[JUMP_DIRECTIONS] = {0, 0, 1, -1, 1, 1, -1, -1};
+
+static int DirectionIndex(int dx, int dy) {
+    for (int i = 0; i < JUMP_DIRECTIONS; ++i) {
+        if (DIRECTION_X[i] == dx && DIRECTION_Y[i] == dy) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int Sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
 NavigationGrid::NavigationGrid() {
     nodeSize = 0;
     gridWidth = 0;
     gridHeight = 0;
     allNodes = nullptr;
+    searchMode = GridSearchMode::AStar;
+    diagonalMovement = false;
+    clusterSize = 10;
+    clustersX = 0;
+    clustersY = 0;
 }
 
 NavigationGrid::NavigationGrid(const std::string &filename) : NavigationGrid() {
@@ -49,134 +76,857 @@ NavigationGrid::NavigationGrid(const std::string &filename) : NavigationGrid() {
     //now to build the connectivity between the nodes
     for (int y = 0; y < gridHeight; ++y) {
         for (int x = 0; x < gridWidth; ++x) {
-            GridNode &n = allNodes[(gridWidth * y) + x];
+            ConnectNode(x, y);
+        }
+    }
+}
 
-            if (y > 0) { //get the above node
-                n.connected[0] = &allNodes[(gridWidth * (y - 1)) + x];
-            }
-            if (y < gridHeight - 1) { //get the below node
-                n.connected[1] = &allNodes[(gridWidth * (y + 1)) + x];
-            }
-            if (x > 0) { //get left node
-                n.connected[2] = &allNodes[(gridWidth * (y)) + (x - 1)];
-            }
-            if (x < gridWidth - 1) { //get right node
-                n.connected[3] = &allNodes[(gridWidth * (y)) + (x + 1)];
+NavigationGrid::~NavigationGrid() {
+    delete[] allNodes;
+}
+
+void NavigationGrid::ConnectNode(int x, int y) {
+    GridNode &n = allNodes[(gridWidth * y) + x];
+    for (int i = 0; i < 4; ++i) {
+        n.connected[i] = nullptr;
+        n.costs[i] = 0;
+    }
+
+    if (y > 0) { //get the above node
+        n.connected[0] = &allNodes[(gridWidth * (y - 1)) + x];
+    }
+    if (y < gridHeight - 1) { //get the below node
+        n.connected[1] = &allNodes[(gridWidth * (y + 1)) + x];
+    }
+    if (x > 0) { //get left node
+        n.connected[2] = &allNodes[(gridWidth * (y)) + (x - 1)];
+    }
+    if (x < gridWidth - 1) { //get right node
+        n.connected[3] = &allNodes[(gridWidth * (y)) + (x + 1)];
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (n.connected[i]) {
+            if (n.connected[i]->type == '.') {
+                n.costs[i] = 1;
             }
-            for (int i = 0; i < 4; ++i) {
-                if (n.connected[i]) {
-                    if (n.connected[i]->type == '.') {
-                        n.costs[i] = 1;
-                    }
-                    if (n.connected[i]->type == 'x') {
-                        n.connected[i] = nullptr; //actually a wall, disconnect!
-                    }
-                }
+            if (n.connected[i]->type == 'x') {
+                n.connected[i] = nullptr; //actually a wall, disconnect!
             }
         }
     }
 }
 
-NavigationGrid::~NavigationGrid() {
-    delete[] allNodes;
+void NavigationGrid::SetSearchMode(GridSearchMode mode) {
+    searchMode = mode;
+    if (searchMode == GridSearchMode::JumpPointPlus && jumpDistances.empty()) {
+        BuildJumpDistances();
+    }
+    if (searchMode == GridSearchMode::Hierarchical && clusters.empty()) {
+        BuildAbstraction();
+    }
 }
 
-bool NavigationGrid::FindPath(const Vector3 &from, const Vector3 &to, NavigationPath &outPath) {
-    //need to work out which node 'from' sits in, and 'to' sits in
-    int fromX = ((int) from.x / nodeSize);
-    int fromZ = ((int) from.z / nodeSize);
+void NavigationGrid::SetDiagonalMovement(bool state) {
+    if (diagonalMovement == state) {
+        return;
+    }
+    diagonalMovement = state;
+    jumpDistances.clear(); // what counts as a jump point depends on how we can move
+    if (searchMode == GridSearchMode::JumpPointPlus) {
+        BuildJumpDistances();
+    }
+}
 
-    int toX = ((int) to.x / nodeSize);
-    int toZ = ((int) to.z / nodeSize);
+void NavigationGrid::SetTile(int x, int y, char type) {
+    if (x < 0 || x > gridWidth - 1 || y < 0 || y > gridHeight - 1) {
+        return;
+    }
+    allNodes[(gridWidth * y) + x].type = type;
+    grid[y][x] = type;
 
-    if (fromX < 0 || fromX > gridWidth - 1 ||
-        fromZ < 0 || fromZ > gridHeight - 1) {
-        return false; //outside of map region!
+    ConnectNode(x, y);
+    if (y > 0) {
+        ConnectNode(x, y - 1);
+    }
+    if (y < gridHeight - 1) {
+        ConnectNode(x, y + 1);
+    }
+    if (x > 0) {
+        ConnectNode(x - 1, y);
+    }
+    if (x < gridWidth - 1) {
+        ConnectNode(x + 1, y);
     }
 
-    if (toX < 0 || toX > gridWidth - 1 ||
-        toZ < 0 || toZ > gridHeight - 1) {
-        return false; //outside of map region!
+    if (!jumpDistances.empty()) {
+        BuildJumpDistances(); // a wall can change jump distances right across the map
+    }
+    if (!clusters.empty()) {
+        UpdateAbstraction(x, y);
     }
+}
 
-    GridNode *startNode = &allNodes[(fromZ * gridWidth) + fromX];
-    GridNode *endNode = &allNodes[(toZ * gridWidth) + toX];
+void NavigationGrid::SetClusterSize(int size) {
+    if (size < 1 || size == clusterSize) {
+        return;
+    }
+    clusterSize = size;
+    if (!clusters.empty()) {
+        BuildAbstraction();
+    }
+}
 
-    std::vector<GridNode *> openList;
-    std::vector<GridNode *> closedList;
+bool NavigationGrid::GetNodeIndex(const Vector3 &position, int &index) const {
+    int x = ((int) position.x / nodeSize);
+    int z = ((int) position.z / nodeSize);
 
-    openList.push_back(startNode);
+    if (x < 0 || x > gridWidth - 1 ||
+        z < 0 || z > gridHeight - 1) {
+        return false; //outside of map region!
+    }
+    index = (z * gridWidth) + x;
+    return true;
+}
 
-    startNode->f = 0;
-    startNode->g = 0;
-    startNode->parent = nullptr;
+bool NavigationGrid::FindPath(const Vector3 &from, const Vector3 &to, NavigationPath &outPath) {
+    return FindPath(from, to, outPath, scratch);
+}
 
-    GridNode *currentBestNode = nullptr;
+bool NavigationGrid::FindPath(const Vector3 &from, const Vector3 &to, NavigationPath &outPath,
+                              GridSearchScratch &search) const {
+    //need to work out which node 'from' sits in, and 'to' sits in
+    int startIndex;
+    int endIndex;
+    if (!GetNodeIndex(from, startIndex) || !GetNodeIndex(to, endIndex)) {
+        return false;
+    }
+    const GridNode *endNode = &allNodes[endIndex];
 
-    while (!openList.empty()) {
-        currentBestNode = RemoveBestNode(openList);
+    if (searchMode == GridSearchMode::Hierarchical && !clusters.empty()) {
+        GridAbstractPath path;
+        if (!FindAbstractPath(startIndex, endIndex, path.nodes, search)) {
+            return false;
+        }
+        return RefinePath(path, outPath, (int) path.nodes.size(), search);
+    }
+    if (searchMode == GridSearchMode::JumpPoint || searchMode == GridSearchMode::JumpPointPlus) {
+        return FindJumpPointPath(startIndex, endIndex, outPath, search);
+    }
+
+    search.Begin(gridWidth * gridHeight);
+    search.Open(startIndex, 0.0f, 0.0f, -1);
 
-        if (currentBestNode == endNode) {            //we've found the path!
-            GridNode *node = endNode;
-            while (node != nullptr) {
-                outPath.PushWaypoint(node->position);
-                node = node->parent;
+    while (!search.IsOpenEmpty()) {
+        int current = search.PopBest();
+
+        if (current == endIndex) {            //we've found the path!
+            for (int node = endIndex; node >= 0; node = search.GetParent(node)) {
+                outPath.PushWaypoint(allNodes[node].position);
             }
             return true;
-        } else {
-            for (int i = 0; i < 4; ++i) {
-                GridNode *neighbour = currentBestNode->connected[i];
-                if (!neighbour) { //might not be connected...
-                    continue;
+        }
+        search.Close(current);
+
+        const GridNode &currentNode = allNodes[current];
+        for (int i = 0; i < 4; ++i) {
+            const GridNode *neighbour = currentNode.connected[i];
+            if (!neighbour) { //might not be connected...
+                continue;
+            }
+            int index = (int) (neighbour - allNodes);
+            if (search.IsClosed(index)) {
+                continue; //already discarded this neighbour...
+            }
+            float g = search.GetG(current) + currentNode.costs[i];
+            //first time we've seen this neighbour, or a better route to it
+            if (!search.IsVisited(index) || g < search.GetG(index)) {
+                search.Open(index, g, g + Heuristic(neighbour, endNode), current);
+            }
+        }
+    }
+    return false; //open list emptied out with no path!
+}
+
+float NavigationGrid::Heuristic(const GridNode *hNode, const GridNode *endNode) const {
+    return (hNode->position - endNode->position).Length();
+}
+
+/*
+Jump point search (Harabor and Grastien) - on a uniform cost grid, there
+are lots of equally short paths between two nodes, and we only need to look
+at one of them. Moving in a straight line, there's no need to stop at a node
+unless a wall beside it opens up a way that couldn't have been reached more
+directly - a 'forced' neighbour. Diagonal moves (and vertical ones, on a 4-way
+grid) stop wherever a straight jump from them would find something. So only
+those jump points go on the open list, with whole runs of open floor between
+them skipped over.
+*/
+bool NavigationGrid::FindJumpPointPath(int startIndex, int endIndex, NavigationPath &outPath,
+                                       GridSearchScratch &search) const {
+    if (allNodes[endIndex].type == WALL_NODE) {
+        return false;
+    }
+    int endX = endIndex % gridWidth;
+    int endY = endIndex / gridWidth;
+    auto heuristic = [&](int node) {
+        int dx = abs(node % gridWidth - endX);
+        int dy = abs(node / gridWidth - endY);
+        if (!diagonalMovement) {
+            return (float) (dx + dy);
+        }
+        return (float) std::max(dx, dy) + 0.41421356f * (float) std::min(dx, dy);
+    };
+    bool usePlus = searchMode == GridSearchMode::JumpPointPlus && !jumpDistances.empty();
+
+    search.Begin(gridWidth * gridHeight);
+    search.Open(startIndex, 0.0f, heuristic(startIndex), -1);
+
+    int directions[JUMP_DIRECTIONS];
+    while (!search.IsOpenEmpty()) {
+        int current = search.PopBest();
+
+        if (current == endIndex) {
+            // only the jump points were stored, so fill in every node between them
+            for (int node = endIndex; node >= 0; node = search.GetParent(node)) {
+                int parent = search.GetParent(node);
+                if (parent < 0) {
+                    outPath.PushWaypoint(allNodes[node].position);
+                    break;
                 }
-                bool inClosed = NodeInList(neighbour, closedList);
-                if (inClosed) {
-                    continue; //already discarded this neighbour...
+                int dx = Sign(parent % gridWidth - node % gridWidth);
+                int dy = Sign(parent / gridWidth - node / gridWidth);
+                for (int step = node; step != parent; step += dy * gridWidth + dx) {
+                    outPath.PushWaypoint(allNodes[step].position);
                 }
+            }
+            return true;
+        }
+        search.Close(current);
+
+        int x = current % gridWidth;
+        int y = current / gridWidth;
+        int count = GetJumpDirections(current, search.GetParent(current), directions);
+        for (int i = 0; i < count; ++i) {
+            int d = directions[i];
+            int steps = 0;
+            int next;
+            if (usePlus) {
+                next = JumpPlus(current, d, endIndex, steps);
+            } else {
+                next = Jump(x + DIRECTION_X[d], y + DIRECTION_Y[d], DIRECTION_X[d], DIRECTION_Y[d], endIndex);
+                if (next >= 0) {
+                    steps = std::max(abs(next % gridWidth - x), abs(next / gridWidth - y));
+                }
+            }
+            if (next < 0 || search.IsClosed(next)) {
+                continue;
+            }
+            float stepCost = (DIRECTION_X[d] != 0 && DIRECTION_Y[d] != 0) ? 1.41421356f : 1.0f;
+            float g = search.GetG(current) + stepCost * (float) steps;
+            if (!search.IsVisited(next) || g < search.GetG(next)) {
+                search.Open(next, g, g + heuristic(next), current);
+            }
+        }
+    }
+    return false;
+}
+
+/*
+Which ways are worth jumping in from a node, given the way we got there. The
+start node tries everything, and other nodes carry on in the same direction,
+plus the ways that might have been forced open by a wall.
+*/
+int NavigationGrid::GetJumpDirections(int node, int parent, int *directions) const {
+    int x = node % gridWidth;
+    int y = node / gridWidth;
+    int count = 0;
+    auto add = [&](int dx, int dy) {
+        if (CanStep(x, y, dx, dy)) {
+            directions[count++] = DirectionIndex(dx, dy);
+        }
+    };
+    if (parent < 0) {
+        for (int i = 0; i < (diagonalMovement ? 8 : 4); ++i) {
+            add(DIRECTION_X[i], DIRECTION_Y[i]);
+        }
+        return count;
+    }
+    int dx = Sign(x - parent % gridWidth);
+    int dy = Sign(y - parent / gridWidth);
+    add(dx, dy);
+    if (dx != 0 && dy != 0) {
+        add(dx, 0);
+        add(0, dy);
+    } else if (dx != 0) {
+        add(0, 1);
+        add(0, -1);
+        if (diagonalMovement) {
+            add(dx, 1);
+            add(dx, -1);
+        }
+    } else {
+        add(1, 0);
+        add(-1, 0);
+        if (diagonalMovement) {
+            add(1, dy);
+            add(-1, dy);
+        }
+    }
+    return count;
+}
 
-                float h = Heuristic(neighbour, endNode);
-                float g = currentBestNode->g + currentBestNode->costs[i];
-                float f = h + g;
+// a wall beside us, that wasn't beside the node we came from, means a side route has just opened up
+bool NavigationGrid::HasForcedNeighbour(int x, int y, int dx, int dy) const {
+    if (dx != 0) {
+        return (IsWalkable(x, y - 1) && !IsWalkable(x - dx, y - 1)) ||
+               (IsWalkable(x, y + 1) && !IsWalkable(x - dx, y + 1));
+    }
+    return (IsWalkable(x - 1, y) && !IsWalkable(x - 1, y - dy)) ||
+           (IsWalkable(x + 1, y) && !IsWalkable(x + 1, y - dy));
+}
 
-                bool inOpen = NodeInList(neighbour, openList);
+//Steps from (x, y) in one direction until it finds a jump point, returning -1 if it hits a wall first
+int NavigationGrid::Jump(int x, int y, int dx, int dy, int endIndex) const {
+    while (IsWalkable(x, y)) {
+        int index = (y * gridWidth) + x;
+        if (index == endIndex) {
+            return index;
+        }
+        if (dx != 0 && dy != 0) {
+            if (Jump(x + dx, y, dx, 0, endIndex) >= 0 || Jump(x, y + dy, 0, dy, endIndex) >= 0) {
+                return index;
+            }
+            if (!CanStep(x, y, dx, dy)) {
+                return -1;
+            }
+        } else {
+            if (HasForcedNeighbour(x, y, dx, dy)) {
+                return index;
+            }
+            // without diagonals, vertical moves take the place of them
+            if (!diagonalMovement && dy != 0 &&
+                (Jump(x + 1, y, 1, 0, endIndex) >= 0 || Jump(x - 1, y, -1, 0, endIndex) >= 0)) {
+                return index;
+            }
+        }
+        x += dx;
+        y += dy;
+    }
+    return -1;
+}
+
+/*
+JPS+ (Rabin) - the same jumps, looked up in jumpDistances instead. As the
+table doesn't know where we're heading, a jump that passes by the end node
+stops next to it: straight at the end node itself, and diagonally (or
+vertically, on a 4-way grid) once it's level with it.
+*/
+int NavigationGrid::JumpPlus(int node, int direction, int endIndex, int &steps) const {
+    int distance = jumpDistances[node * JUMP_DIRECTIONS + direction];
+    int dx = DIRECTION_X[direction];
+    int dy = DIRECTION_Y[direction];
+    int offsetX = endIndex % gridWidth - node % gridWidth;
+    int offsetY = endIndex / gridWidth - node / gridWidth;
+
+    bool diagonalLike = (dx != 0 && dy != 0) || (!diagonalMovement && dy != 0);
+    if (!diagonalLike) {
+        bool inLine = dx != 0 ? (offsetY == 0 && Sign(offsetX) == dx) : (offsetX == 0 && Sign(offsetY) == dy);
+        int toEnd = abs(offsetX) + abs(offsetY);
+        if (inLine && toEnd <= abs(distance)) {
+            steps = toEnd;
+            return endIndex;
+        }
+    } else {
+        bool towards = Sign(offsetY) == dy && (dx == 0 || Sign(offsetX) == dx);
+        int toLevel = dx == 0 ? abs(offsetY) : std::min(abs(offsetX), abs(offsetY));
+        if (towards && toLevel <= abs(distance)) {
+            steps = toLevel;
+            return node + toLevel * (dy * gridWidth + dx);
+        }
+    }
+    if (distance > 0) {
+        steps = distance;
+        return node + distance * (dy * gridWidth + dx);
+    }
+    return -1;
+}
 
-                if (!inOpen) { //first time we've seen this neighbour
-                    openList.emplace_back(neighbour);
+/*
+Each direction is filled in by walking backwards against it, so that every
+node can build on the one in front of it: either that node is a jump point
+(one step away), or we're one step further from whatever it found.
+*/
+void NavigationGrid::BuildJumpDistances() {
+    jumpDistances.assign(gridWidth * gridHeight * JUMP_DIRECTIONS, 0);
+
+    auto fill = [&](int d, auto isJumpPoint) {
+        int dx = DIRECTION_X[d];
+        int dy = DIRECTION_Y[d];
+        for (int row = 0; row < gridHeight; ++row) {
+            int y = dy > 0 ? gridHeight - 1 - row : row;
+            for (int column = 0; column < gridWidth; ++column) {
+                int x = dx > 0 ? gridWidth - 1 - column : column;
+                if (!IsWalkable(x, y) || !CanStep(x, y, dx, dy)) {
+                    continue; // stays at 0 - a wall right next to us
                 }
-                //todo:inOpen?&&
-                if (!inOpen || f < neighbour->f) {//might be a better route to this neighbour
-                    neighbour->parent = currentBestNode;
-                    neighbour->f = f;
-                    neighbour->g = g;
+                int next = ((y + dy) * gridWidth) + x + dx;
+                int ahead = jumpDistances[next * JUMP_DIRECTIONS + d];
+                int &distance = jumpDistances[((y * gridWidth) + x) * JUMP_DIRECTIONS + d];
+                if (isJumpPoint(x + dx, y + dy, next)) {
+                    distance = 1;
+                } else {
+                    distance = ahead > 0 ? ahead + 1 : ahead - 1;
                 }
             }
-            closedList.emplace_back(currentBestNode);
         }
+    };
+    // straight ones first, as the others stop wherever a straight jump would find something
+    for (int d = 0; d < 2; ++d) {
+        fill(d, [&](int x, int y, int) {
+            return HasForcedNeighbour(x, y, DIRECTION_X[d], 0);
+        });
+    }
+    for (int d = 2; d < 4; ++d) {
+        fill(d, [&](int x, int y, int node) {
+            if (HasForcedNeighbour(x, y, 0, DIRECTION_Y[d])) {
+                return true;
+            }
+            return !diagonalMovement && (jumpDistances[node * JUMP_DIRECTIONS + 0] > 0 ||
+                                         jumpDistances[node * JUMP_DIRECTIONS + 1] > 0);
+        });
+    }
+    for (int d = 4; d < JUMP_DIRECTIONS; ++d) {
+        int horizontal = DirectionIndex(DIRECTION_X[d], 0);
+        int vertical = DirectionIndex(0, DIRECTION_Y[d]);
+        fill(d, [&](int, int, int node) {
+            return jumpDistances[node * JUMP_DIRECTIONS + horizontal] > 0 ||
+                   jumpDistances[node * JUMP_DIRECTIONS + vertical] > 0;
+        });
     }
-    return false; //open list emptied out with no path!
 }
 
-bool NavigationGrid::NodeInList(GridNode *n, std::vector<GridNode *> &list) const {
-    std::vector<GridNode *>::iterator i = std::find(list.begin(), list.end(), n);
-    return i == list.end() ? false : true;
+void NavigationGrid::GetClusterBounds(int cluster, int &minX, int &minY, int &maxX, int &maxY) const {
+    minX = (cluster % clustersX) * clusterSize;
+    minY = (cluster / clustersX) * clusterSize;
+    maxX = std::min(minX + clusterSize, gridWidth);
+    maxY = std::min(minY + clusterSize, gridHeight);
+}
+
+/*
+A* that never leaves the given cluster. Without a goal, it carries on until
+it runs out of nodes, leaving the distance to everything it could reach in
+the scratch. Costs are treated as the same in both directions, which they
+are on any grid made of '.' and 'x' nodes.
+*/
+bool NavigationGrid::SearchCluster(int start, int goal, int cluster, GridSearchScratch &search) const {
+    int minX, minY, maxX, maxY;
+    GetClusterBounds(cluster, minX, minY, maxX, maxY);
+    int goalX = goal >= 0 ? goal % gridWidth : 0;
+    int goalY = goal >= 0 ? goal / gridWidth : 0;
+
+    search.Begin(gridWidth * gridHeight);
+    search.Open(start, 0.0f, 0.0f, -1);
+
+    while (!search.IsOpenEmpty()) {
+        int current = search.PopBest();
+        if (current == goal) {
+            return true;
+        }
+        search.Close(current);
+
+        const GridNode &currentNode = allNodes[current];
+        for (int i = 0; i < 4; ++i) {
+            const GridNode *neighbour = currentNode.connected[i];
+            if (!neighbour) {
+                continue;
+            }
+            int index = (int) (neighbour - allNodes);
+            int x = index % gridWidth;
+            int y = index / gridWidth;
+            if (x < minX || x >= maxX || y < minY || y >= maxY || search.IsClosed(index)) {
+                continue;
+            }
+            float g = search.GetG(current) + currentNode.costs[i];
+            if (!search.IsVisited(index) || g < search.GetG(index)) {
+                float h = goal >= 0 ? (float) (abs(x - goalX) + abs(y - goalY)) : 0.0f;
+                search.Open(index, g, g + h, current);
+            }
+        }
+    }
+    return goal < 0;
 }
 
-GridNode *NavigationGrid::RemoveBestNode(std::vector<GridNode *> &list) const {
-    std::vector<GridNode *>::iterator bestI = list.begin();
+bool NavigationGrid::FindAbstractPath(const Vector3 &from, const Vector3 &to, GridAbstractPath &outPath,
+                                      GridSearchScratch &search) const {
+    outPath.Clear();
+    int startIndex;
+    int endIndex;
+    if (clusters.empty() || !GetNodeIndex(from, startIndex) || !GetNodeIndex(to, endIndex)) {
+        return false;
+    }
+    return FindAbstractPath(startIndex, endIndex, outPath.nodes, search);
+}
 
-    GridNode *bestNode = *list.begin();
+/*
+The start and end nodes usually aren't entrances themselves, so they're
+linked in to the graph for just this search, by searching out from each
+of them to the entrances of their own cluster. Past that, every step is
+either across a cluster, using the stored distances, or over a border to
+the entrance on the other side.
+*/
+bool NavigationGrid::FindAbstractPath(int startIndex, int endIndex, std::vector<int> &nodes,
+                                      GridSearchScratch &search) const {
+    if (allNodes[endIndex].type == WALL_NODE) {
+        return false;
+    }
+    int startCluster = GetCluster(startIndex);
+    int endCluster = GetCluster(endIndex);
+
+    std::vector<std::pair<int, float>> startLinks;
+    SearchCluster(startIndex, -1, startCluster, search);
+    for (int entrance : clusters[startCluster].entrances) {
+        if (search.IsVisited(entrance)) {
+            startLinks.emplace_back(entrance, search.GetG(entrance));
+        }
+    }
+    if (startCluster == endCluster && search.IsVisited(endIndex)) {
+        startLinks.emplace_back(endIndex, search.GetG(endIndex));
+    }
 
-    for (auto i = list.begin(); i != list.end(); ++i) {
-        if ((*i)->f < bestNode->f) {
-            bestNode = (*i);
-            bestI = i;
+    const std::vector<int> &endEntrances = clusters[endCluster].entrances;
+    std::vector<float> endLinks(endEntrances.size(), -1.0f);
+    SearchCluster(endIndex, -1, endCluster, search);
+    for (size_t i = 0; i < endEntrances.size(); ++i) {
+        if (search.IsVisited(endEntrances[i])) {
+            endLinks[i] = search.GetG(endEntrances[i]);
         }
     }
-    list.erase(bestI);
 
-    return bestNode;
+    int endX = endIndex % gridWidth;
+    int endY = endIndex / gridWidth;
+    auto heuristic = [&](int node) {
+        return (float) (abs(node % gridWidth - endX) + abs(node / gridWidth - endY));
+    };
+
+    search.Begin(gridWidth * gridHeight);
+    search.Open(startIndex, 0.0f, heuristic(startIndex), -1);
+
+    auto tryLink = [&](int current, int next, float cost) {
+        if (search.IsClosed(next)) {
+            return;
+        }
+        float g = search.GetG(current) + cost;
+        if (!search.IsVisited(next) || g < search.GetG(next)) {
+            search.Open(next, g, g + heuristic(next), current);
+        }
+    };
+
+    while (!search.IsOpenEmpty()) {
+        int current = search.PopBest();
+
+        if (current == endIndex) {
+            nodes.clear();
+            for (int node = endIndex; node >= 0; node = search.GetParent(node)) {
+                nodes.push_back(node);
+            }
+            std::reverse(nodes.begin(), nodes.end());
+            return true;
+        }
+        search.Close(current);
+
+        if (current == startIndex) {
+            for (const auto &link : startLinks) {
+                tryLink(current, link.first, link.second);
+            }
+        }
+        int slot = entranceSlot[current];
+        if (slot < 0) {
+            continue;
+        }
+        int cluster = GetCluster(current);
+        const GridCluster &currentCluster = clusters[cluster];
+        int entranceCount = (int) currentCluster.entrances.size();
+        for (int i = 0; i < entranceCount; ++i) {
+            float distance = currentCluster.distances[(slot * entranceCount) + i];
+            if (i != slot && distance >= 0.0f) {
+                tryLink(current, currentCluster.entrances[i], distance);
+            }
+        }
+        const GridNode &currentNode = allNodes[current];
+        for (int i = 0; i < 4; ++i) {
+            if (borderLinks[current] & (1 << i)) {
+                tryLink(current, (int) (currentNode.connected[i] - allNodes), (float) currentNode.costs[i]);
+            }
+        }
+        if (cluster == endCluster && endLinks[slot] >= 0.0f) {
+            tryLink(current, endIndex, endLinks[slot]);
+        }
+    }
+    return false;
 }
 
-float NavigationGrid::Heuristic(GridNode *hNode, GridNode *endNode) const {
-    return (hNode->position - endNode->position).Length();
-}
\ No newline at end of file
+bool NavigationGrid::RefinePath(GridAbstractPath &path, NavigationPath &outPath, int segmentCount,
+                                GridSearchScratch &search) const {
+    if (path.IsFullyRefined()) {
+        return false;
+    }
+    std::vector<int> cells;
+    if (path.nextNode == 0) {
+        cells.push_back(path.nodes[0]);
+        path.nextNode = 1;
+    }
+    for (int i = 0; i < segmentCount && !path.IsFullyRefined(); ++i, ++path.nextNode) {
+        if (!RefineSegment(path.nodes[path.nextNode - 1], path.nodes[path.nextNode], cells, search)) {
+            return false;
+        }
+    }
+    for (auto i = cells.rbegin(); i != cells.rend(); ++i) {
+        outPath.PushWaypoint(allNodes[*i].position);
+    }
+    return true;
+}
+
+//Adds the nodes after 'from', up to and including 'to', which are either side of a border, or in the same cluster
+bool NavigationGrid::RefineSegment(int from, int to, std::vector<int> &cells, GridSearchScratch &search) const {
+    const GridNode &fromNode = allNodes[from];
+    for (int i = 0; i < 4; ++i) {
+        if ((borderLinks[from] & (1 << i)) && fromNode.connected[i] == &allNodes[to]) {
+            cells.push_back(to);
+            return true;
+        }
+    }
+    if (!SearchCluster(from, to, GetCluster(from), search)) {
+        return false;
+    }
+    size_t first = cells.size();
+    for (int node = to; node != from; node = search.GetParent(node)) {
+        cells.push_back(node);
+    }
+    std::reverse(cells.begin() + first, cells.end());
+    return true;
+}
+
+void NavigationGrid::BuildAbstraction() {
+    clustersX = (gridWidth + clusterSize - 1) / clusterSize;
+    clustersY = (gridHeight + clusterSize - 1) / clusterSize;
+    clusters.assign(clustersX * clustersY, GridCluster());
+    borderLinks.assign(gridWidth * gridHeight, 0);
+    entranceSlot.assign(gridWidth * gridHeight, -1);
+
+    for (int i = 0; i < (int) clusters.size(); ++i) {
+        BuildBorder(i, true);
+        BuildBorder(i, false);
+    }
+    for (int i = 0; i < (int) clusters.size(); ++i) {
+        BuildCluster(i);
+    }
+}
+
+/*
+Finds the entrances along the border between a cluster and the one to
+its right (or below it) - each unbroken run of open nodes on both sides
+gets one in the middle, or one at each end if it's a wide one.
+*/
+void NavigationGrid::BuildBorder(int cluster, bool rightSide) {
+    int clusterX = cluster % clustersX;
+    int clusterY = cluster / clustersX;
+    int minX, minY, maxX, maxY;
+    GetClusterBounds(cluster, minX, minY, maxX, maxY);
+
+    int first, along, across, length;
+    unsigned char outLink, inLink;
+    if (rightSide) {
+        if (clusterX == clustersX - 1) {
+            return; //edge of the map
+        }
+        first = (minY * gridWidth) + maxX - 1;
+        along = gridWidth;
+        across = 1;
+        length = maxY - minY;
+        outLink = 1 << 3; //right
+        inLink = 1 << 2;  //left
+    } else {
+        if (clusterY == clustersY - 1) {
+            return;
+        }
+        first = ((maxY - 1) * gridWidth) + minX;
+        along = 1;
+        across = gridWidth;
+        length = maxX - minX;
+        outLink = 1 << 1; //below
+        inLink = 1 << 0;  //above
+    }
+
+    auto isOpen = [&](int i) {
+        int node = first + (i * along);
+        return allNodes[node].type != WALL_NODE && allNodes[node + across].type != WALL_NODE;
+    };
+    auto addEntrance = [&](int i) {
+        int node = first + (i * along);
+        borderLinks[node] |= outLink;
+        borderLinks[node + across] |= inLink;
+    };
+
+    for (int i = 0; i < length; ++i) {
+        int node = first + (i * along);
+        borderLinks[node] &= ~outLink;
+        borderLinks[node + across] &= ~inLink;
+    }
+    for (int i = 0; i < length;) {
+        if (!isOpen(i)) {
+            ++i;
+            continue;
+        }
+        int runStart = i;
+        while (i < length && isOpen(i)) {
+            ++i;
+        }
+        if (i - runStart > MAX_SINGLE_ENTRANCE) {
+            addEntrance(runStart);
+            addEntrance(i - 1);
+        } else {
+            addEntrance(runStart + (i - runStart) / 2);
+        }
+    }
+}
+
+void NavigationGrid::BuildCluster(int cluster) {
+    GridCluster &c = clusters[cluster];
+    for (int entrance : c.entrances) {
+        entranceSlot[entrance] = -1;
+    }
+    c.entrances.clear();
+
+    int minX, minY, maxX, maxY;
+    GetClusterBounds(cluster, minX, minY, maxX, maxY);
+    for (int y = minY; y < maxY; ++y) {
+        for (int x = minX; x < maxX; ++x) {
+            int node = (y * gridWidth) + x;
+            if (borderLinks[node]) {
+                entranceSlot[node] = (int) c.entrances.size();
+                c.entrances.push_back(node);
+            }
+        }
+    }
+
+    int entranceCount = (int) c.entrances.size();
+    c.distances.assign(entranceCount * entranceCount, -1.0f);
+    for (int i = 0; i < entranceCount; ++i) {
+        SearchCluster(c.entrances[i], -1, cluster, scratch);
+        for (int j = 0; j < entranceCount; ++j) {
+            if (scratch.IsVisited(c.entrances[j])) {
+                c.distances[(i * entranceCount) + j] = scratch.GetG(c.entrances[j]);
+            }
+        }
+    }
+}
+
+/*
+A changed node can only move the entrances on its own cluster's borders,
+so only that cluster, and the ones on the other side of those borders,
+need their distances worked out again.
+*/
+void NavigationGrid::UpdateAbstraction(int x, int y) {
+    int clusterX = x / clusterSize;
+    int clusterY = y / clusterSize;
+    int cluster = (clusterY * clustersX) + clusterX;
+
+    BuildBorder(cluster, true);
+    BuildBorder(cluster, false);
+    if (clusterX > 0) {
+        BuildBorder(cluster - 1, true);
+    }
+    if (clusterY > 0) {
+        BuildBorder(cluster - clustersX, false);
+    }
+
+    BuildCluster(cluster);
+    if (clusterX > 0) {
+        BuildCluster(cluster - 1);
+    }
+    if (clusterX < clustersX - 1) {
+        BuildCluster(cluster + 1);
+    }
+    if (clusterY > 0) {
+        BuildCluster(cluster - clustersX);
+    }
+    if (clusterY < clustersY - 1) {
+        BuildCluster(cluster + clustersX);
+    }
+}
+
+void GridSearchScratch::Begin(int nodeCount) {
+    if ((int) stamps.size() < nodeCount) {
+        stamps.resize(nodeCount, 0);
+        g.resize(nodeCount);
+        f.resize(nodeCount);
+        parent.resize(nodeCount);
+        heapIndex.resize(nodeCount);
+    }
+    if (++generation == 0) { //wrapped around, so old stamps could look current
+        std::fill(stamps.begin(), stamps.end(), 0);
+        generation = 1;
+    }
+    closed.assign((nodeCount + 63) / 64, 0);
+    heap.clear();
+}
+
+void GridSearchScratch::Open(int node, float newG, float newF, int newParent) {
+    g[node] = newG;
+    f[node] = newF;
+    parent[node] = newParent;
+    if (!IsVisited(node)) {
+        stamps[node] = generation;
+        heapIndex[node] = (int) heap.size();
+        heap.push_back(node);
+    }
+    SiftUp(heapIndex[node]); //f can only have gone down
+}
+
+int GridSearchScratch::PopBest() {
+    int best = heap[0];
+    heap[0] = heap.back();
+    heapIndex[heap[0]] = 0;
+    heap.pop_back();
+    if (!heap.empty()) {
+        SiftDown(0);
+    }
+    return best;
+}
+
+void GridSearchScratch::SiftUp(int position) {
+    int node = heap[position];
+    while (position > 0) {
+        int up = (position - 1) / 2;
+        if (f[heap[up]] <= f[node]) {
+            break;
+        }
+        heap[position] = heap[up];
+        heapIndex[heap[position]] = position;
+        position = up;
+    }
+    heap[position] = node;
+    heapIndex[node] = position;
+}
+
+void GridSearchScratch::SiftDown(int position) {
+    int node = heap[position];
+    int count = (int) heap.size();
+    while (true) {
+        int child = position * 2 + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && f[heap[child + 1]] < f[heap[child]]) {
+            child++;
+        }
+        if (f[node] <= f[heap[child]]) {
+            break;
+        }
+        heap[position] = heap[child];
+        heapIndex[heap[position]] = position;
+        position = child;
+    }
+    heap[position] = node;
+    heapIndex[node] = position;
+}
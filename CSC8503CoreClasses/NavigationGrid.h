@@ -4,16 +4,11 @@
 namespace NCL {
 	namespace CSC8503 {
 		struct GridNode {
-			GridNode* parent;
-
 			GridNode* connected[4];
 			int		  costs[4];
 
 			Vector3		position;
 
-			float f;
-			float g;
-
 			int type;
 
 			GridNode() {
@@ -21,14 +16,112 @@ namespace NCL {
 					connected[i] = nullptr;
 					costs[i] = 0;
 				}
-				f = 0;
-				g = 0;
 				type = 0;
-				parent = nullptr;
 			}
 			~GridNode() {	}
 		};
 
+		/*
+		Everything a search writes to as it goes, kept apart from the grid, so
+		the grid itself is never changed, and any number of searches can run
+		over it at once - as long as each has a scratch of its own.
+
+		Rather than being cleared, each search gets a new generation number,
+		and a node stamped with an older one counts as unvisited, so starting
+		a search doesn't cost anything per node. The open list is a binary heap
+		of node indices, with each node remembering where in the heap it is,
+		so a better route to a node can move it up without searching for it.
+		*/
+		class GridSearchScratch {
+		public:
+			void Begin(int nodeCount);
+
+			bool IsVisited(int node) const {
+				return stamps[node] == generation;
+			}
+
+			bool IsClosed(int node) const {
+				return (closed[node >> 6] >> (node & 63)) & 1;
+			}
+
+			void Close(int node) {
+				closed[node >> 6] |= 1ULL << (node & 63);
+			}
+
+			//Adds a node to the open list, or moves it up if it's already there
+			void Open(int node, float g, float f, int parent);
+
+			//Takes the open node with the lowest f off the heap
+			int PopBest();
+
+			bool IsOpenEmpty() const {
+				return heap.empty();
+			}
+
+			float GetG(int node) const {
+				return g[node];
+			}
+
+			int GetParent(int node) const {
+				return parent[node];
+			}
+
+		protected:
+			void SiftUp(int position);
+			void SiftDown(int position);
+
+			unsigned int					generation = 0;
+			std::vector<unsigned int>		stamps;
+			std::vector<float>				g;
+			std::vector<float>				f;
+			std::vector<int>				parent;
+			std::vector<int>				heapIndex;
+			std::vector<int>				heap;
+			std::vector<unsigned long long>	closed; //a bit per node - small enough to just clear
+		};
+
+		/*
+		Jump point search only works on uniform cost grids (which all of the
+		'.' / 'x' grid files are), but skips over the long runs of open nodes
+		that A* would have to add to its open list one by one. JPS+ goes one
+		further, with how far each node can jump in every direction worked
+		out up front, rather than stepping there during the search.
+
+		Hierarchical (HPA*) splits the grid into square clusters, and searches
+		a much smaller graph of the entrances between them, with the distances
+		across each cluster worked out up front. The result is near optimal,
+		rather than the shortest path possible.
+		*/
+		enum class GridSearchMode {
+			AStar,
+			JumpPoint,
+			JumpPointPlus,
+			Hierarchical
+		};
+
+		/*
+		A path through the cluster graph - just the entrances it passes through,
+		which can be turned into proper waypoints a few at a time, as they're
+		needed, rather than all of them up front.
+		*/
+		class GridAbstractPath {
+		public:
+			void Clear() {
+				nodes.clear();
+				nextNode = 0;
+			}
+
+			bool IsFullyRefined() const {
+				return nextNode >= nodes.size();
+			}
+
+		protected:
+			friend class NavigationGrid;
+
+			std::vector<int>	nodes;		//grid node indices, from start to end
+			size_t				nextNode = 0;
+		};
+
 		class NavigationGrid : public NavigationMap	{
 		public:
 			NavigationGrid();
@@ -37,15 +130,83 @@ namespace NCL {
 
 			bool FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath) override;
 
+			//Only reads the grid, so this can be called from several threads at once, with a scratch each
+			bool FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath, GridSearchScratch& search) const;
+
             int** GetGrid() { return grid; }
             int GetWidth() { return gridWidth; }
             int GetHeight() { return gridHeight; }
             int GetSize() { return nodeSize; }
 
+			void SetSearchMode(GridSearchMode mode);
+			GridSearchMode GetSearchMode() const {
+				return searchMode;
+			}
+
+			/*
+			Lets the jump point modes move diagonally, as long as they don't cut
+			the corner of a wall. A* sticks to the grid's own 4-way connections.
+			*/
+			void SetDiagonalMovement(bool state);
+			bool GetDiagonalMovement() const {
+				return diagonalMovement;
+			}
+
+			//Which node a position falls in, as an index into the grid, or false if it's off the map
+			bool GetNodeIndex(const Vector3& position, int& index) const;
+
+			//Changes a node's type ('.' or 'x'), updating its links and any search data built from them
+			void SetTile(int x, int y, char type);
+
+			void SetClusterSize(int size);
+			int GetClusterSize() const {
+				return clusterSize;
+			}
+
+			/*
+			The hierarchical search, split into its two halves - the route across
+			the clusters, and then the waypoints for the next few steps of it.
+			RefinePath fills outPath with those waypoints each time it's called,
+			and returns false once there's nothing left to refine, or if the grid
+			has changed so the rest of the path can no longer be followed.
+			*/
+			bool FindAbstractPath(const Vector3& from, const Vector3& to, GridAbstractPath& outPath, GridSearchScratch& search) const;
+			bool RefinePath(GridAbstractPath& path, NavigationPath& outPath, int segmentCount, GridSearchScratch& search) const;
+
 		protected:
-			bool		NodeInList(GridNode* n, std::vector<GridNode*>& list) const;
-			GridNode*	RemoveBestNode(std::vector<GridNode*>& list) const;
-			float		Heuristic(GridNode* hNode, GridNode* endNode) const;
+			float		Heuristic(const GridNode* hNode, const GridNode* endNode) const;
+
+			bool FindJumpPointPath(int startIndex, int endIndex, NavigationPath& outPath, GridSearchScratch& search) const;
+			int  Jump(int x, int y, int dx, int dy, int endIndex) const;
+			int  JumpPlus(int node, int direction, int endIndex, int& steps) const;
+			int  GetJumpDirections(int node, int parent, int* directions) const;
+			void BuildJumpDistances();
+
+			bool IsWalkable(int x, int y) const {
+				return x >= 0 && x < gridWidth && y >= 0 && y < gridHeight && allNodes[(y * gridWidth) + x].type != 'x';
+			}
+			//Diagonal steps can't squeeze between two walls, or clip the corner of one
+			bool CanStep(int x, int y, int dx, int dy) const {
+				return IsWalkable(x + dx, y + dy) && (dx == 0 || dy == 0 || (IsWalkable(x + dx, y) && IsWalkable(x, y + dy)));
+			}
+			bool HasForcedNeighbour(int x, int y, int dx, int dy) const;
+
+			void ConnectNode(int x, int y);
+
+			int  GetCluster(int node) const {
+				return ((node / gridWidth) / clusterSize) * clustersX + (node % gridWidth) / clusterSize;
+			}
+			void GetClusterBounds(int cluster, int& minX, int& minY, int& maxX, int& maxY) const;
+
+			bool SearchCluster(int start, int goal, int cluster, GridSearchScratch& search) const;
+			bool FindAbstractPath(int startIndex, int endIndex, std::vector<int>& nodes, GridSearchScratch& search) const;
+			bool RefineSegment(int from, int to, std::vector<int>& cells, GridSearchScratch& search) const;
+
+			void BuildAbstraction();
+			void BuildBorder(int cluster, bool rightSide);
+			void BuildCluster(int cluster);
+			void UpdateAbstraction(int x, int y);
+
 			int nodeSize;
 			int gridWidth;
 			int gridHeight;
@@ -54,6 +215,29 @@ namespace NCL {
 
             int **grid;
 
+			GridSearchScratch	scratch; //for the single threaded FindPath
+
+			GridSearchMode		searchMode;
+			bool				diagonalMovement;
+
+			/*
+			For JPS+, 8 per node (in the same order as allNodes) - how many steps
+			in each direction to the next jump point, or if there isn't one before
+			a wall, minus how many steps there are to the wall.
+			*/
+			std::vector<int>	jumpDistances;
+
+			struct GridCluster {
+				std::vector<int>	entrances;	//grid node indices, all on the cluster's edge
+				std::vector<float>	distances;	//between each pair of entrances, -1 if there's no way across
+			};
+
+			int							clusterSize;
+			int							clustersX;
+			int							clustersY;
+			std::vector<GridCluster>	clusters;
+			std::vector<unsigned char>	borderLinks;	//per node, a bit for each connection that crosses into another cluster
+			std::vector<int>			entranceSlot;	//per node, where it is in its cluster's entrances, or -1
 		};
 	}
 }
@@ -2,15 +2,40 @@
 #include "Assets.h"
 #include "Maths.h"
 #include <fstream>
+#include <algorithm>
 using namespace NCL;
 using namespace CSC8503;
 using namespace std;
 
+//Twice the signed area of abc, looking down on the XZ plane
+static float TriArea2(const Vector3& a, const Vector3& b, const Vector3& c) {
+	float ax = b.x - a.x;
+	float az = b.z - a.z;
+	float bx = c.x - a.x;
+	float bz = c.z - a.z;
+	return bx * az - ax * bz;
+}
+
+static Vector3 MinVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static Vector3 MaxVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+static bool SamePoint(const Vector3& a, const Vector3& b) {
+	return (a - b).LengthSquared() < 0.000001f;
+}
+
 NavigationMesh::NavigationMesh()
 {
+	lookupCellSize	= 1.0f;
+	lookupWidth		= 0;
+	lookupDepth		= 0;
 }
 
-NavigationMesh::NavigationMesh(const std::string&filename)
+NavigationMesh::NavigationMesh(const std::string&filename) : NavigationMesh()
 {
 	ifstream file(Assets::DATADIR + filename);
 
@@ -59,6 +84,7 @@ NavigationMesh::NavigationMesh(const std::string&filename)
 			}
 		}
 	}
+	BuildTriLookup();
 }
 
 NavigationMesh::~NavigationMesh()
@@ -66,31 +92,277 @@ NavigationMesh::~NavigationMesh()
 }
 
 bool NavigationMesh::FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath) {
+	return FindPath(from, to, outPath, scratch);
+}
+
+/*
+A* across the triangles, moving between their centroids, which gives the
+corridor of triangles the path goes through. The path itself is then
+pulled tight through the corridor by the funnel algorithm, so it only
+turns at the corners it actually has to go round.
+*/
+bool NavigationMesh::FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath, GridSearchScratch& search) const {
 	const NavTri* start	= GetTriForPosition(from);
 	const NavTri* end	= GetTriForPosition(to);
 
-	return false;
+	if (!start || !end) {
+		return false;
+	}
+	int startIndex	= (int)(start - allTris.data());
+	int endIndex	= (int)(end - allTris.data());
+
+	auto position = [&](int tri) {
+		if (tri == startIndex) {
+			return from;
+		}
+		if (tri == endIndex) {
+			return to;
+		}
+		return allTris[tri].centroid;
+	};
+
+	search.Begin((int)allTris.size());
+	search.Open(startIndex, 0.0f, (to - from).Length(), -1);
+
+	bool found = false;
+	while (!search.IsOpenEmpty()) {
+		int current = search.PopBest();
+		if (current == endIndex) {
+			found = true;
+			break;
+		}
+		search.Close(current);
+
+		Vector3 currentPos = position(current);
+		for (const NavTri* n : allTris[current].neighbours) {
+			if (!n) {
+				continue;
+			}
+			int index = (int)(n - allTris.data());
+			if (search.IsClosed(index)) {
+				continue;
+			}
+			Vector3 neighbourPos = position(index);
+			float g = search.GetG(current) + (neighbourPos - currentPos).Length();
+			if (!search.IsVisited(index) || g < search.GetG(index)) {
+				search.Open(index, g, g + (to - neighbourPos).Length(), current);
+			}
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	std::vector<int> corridor;
+	for (int tri = endIndex; tri >= 0; tri = search.GetParent(tri)) {
+		corridor.push_back(tri);
+	}
+	std::reverse(corridor.begin(), corridor.end());
+
+	std::vector<Portal> portals;
+	portals.push_back({ from, from });
+	for (size_t i = 1; i < corridor.size(); ++i) {
+		Portal p;
+		GetPortal(allTris[corridor[i - 1]], allTris[corridor[i]], p);
+		portals.push_back(p);
+	}
+	portals.push_back({ to, to });
+
+	std::vector<Vector3> points;
+	StringPull(portals, points);
+	for (auto i = points.rbegin(); i != points.rend(); ++i) {
+		outPath.PushWaypoint(*i);
+	}
+	return true;
+}
+
+//The edge the two triangles share, with its ends sorted into left and right, heading from one into the other
+void NavigationMesh::GetPortal(const NavTri& from, const NavTri& to, Portal& portal) const {
+	int shared[2] = { from.indices[0], from.indices[1] };
+	int sharedCount = 0;
+	for (int i = 0; i < 3 && sharedCount < 2; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			if (from.indices[i] == to.indices[j]) {
+				shared[sharedCount++] = from.indices[i];
+				break;
+			}
+		}
+	}
+	portal.left		= allVerts[shared[0]];
+	portal.right	= allVerts[shared[1]];
+	if (TriArea2(from.centroid, portal.left, portal.right) < 0.0f) {
+		std::swap(portal.left, portal.right);
+	}
 }
 
 /*
-If you have triangles on top of triangles in a full 3D environment, you'll need to change this slightly,
-as it is currently ignoring height. You might find tri/plane raycasting is handy.
+The 'simple stupid funnel algorithm' (Mononen). A funnel from the last
+corner is narrowed down portal by portal, and once one of its sides would
+have to cross over the other, the path must turn around that side's end,
+which becomes the next corner. Only works on the XZ plane, but the corners
+are mesh vertices, so they keep their proper heights.
 */
+void NavigationMesh::StringPull(const std::vector<Portal>& portals, std::vector<Vector3>& points) const {
+	Vector3 apex	= portals[0].left;
+	Vector3 left	= portals[0].left;
+	Vector3 right	= portals[0].right;
+	int apexIndex	= 0;
+	int leftIndex	= 0;
+	int rightIndex	= 0;
 
-const NavigationMesh::NavTri* NavigationMesh::GetTriForPosition(const Vector3& pos) const {
+	points.push_back(apex);
+
+	for (int i = 1; i < (int)portals.size(); ++i) {
+		const Vector3& newLeft	= portals[i].left;
+		const Vector3& newRight	= portals[i].right;
+
+		if (TriArea2(apex, right, newRight) <= 0.0f) {
+			if (SamePoint(apex, right) || TriArea2(apex, left, newRight) > 0.0f) {
+				right		= newRight; //tighten the funnel
+				rightIndex	= i;
+			}
+			else { //right has crossed over left, so the path goes round left
+				apex		= left;
+				apexIndex	= leftIndex;
+				if (!SamePoint(points.back(), apex)) {
+					points.push_back(apex);
+				}
+				left		= apex;
+				right		= apex;
+				leftIndex	= apexIndex;
+				rightIndex	= apexIndex;
+				i			= apexIndex;
+				continue;
+			}
+		}
+		if (TriArea2(apex, left, newLeft) >= 0.0f) {
+			if (SamePoint(apex, left) || TriArea2(apex, right, newLeft) < 0.0f) {
+				left		= newLeft;
+				leftIndex	= i;
+			}
+			else {
+				apex		= right;
+				apexIndex	= rightIndex;
+				if (!SamePoint(points.back(), apex)) {
+					points.push_back(apex);
+				}
+				left		= apex;
+				right		= apex;
+				leftIndex	= apexIndex;
+				rightIndex	= apexIndex;
+				i			= apexIndex;
+				continue;
+			}
+		}
+	}
+	const Vector3& end = portals.back().left;
+	if (!SamePoint(points.back(), end)) {
+		points.push_back(end);
+	}
+}
+
+void NavigationMesh::BuildTriLookup() {
+	lookupCellStart.clear();
+	lookupTris.clear();
+	if (allTris.empty()) {
+		return;
+	}
+	Vector3 minBounds = allVerts[allTris[0].indices[0]];
+	Vector3 maxBounds = minBounds;
+	for (const NavTri& t : allTris) {
+		for (int index : t.indices) {
+			minBounds = MinVector(minBounds, allVerts[index]);
+			maxBounds = MaxVector(maxBounds, allVerts[index]);
+		}
+	}
+	//Roughly a triangle per cell
+	float width		= std::max(maxBounds.x - minBounds.x, 0.001f);
+	float depth		= std::max(maxBounds.z - minBounds.z, 0.001f);
+	lookupCellSize	= sqrtf((width * depth) / (float)allTris.size());
+	lookupOrigin	= minBounds;
+	lookupWidth		= std::max(1, (int)(width / lookupCellSize) + 1);
+	lookupDepth		= std::max(1, (int)(depth / lookupCellSize) + 1);
+
+	auto cellRange = [&](const NavTri& t, int& minX, int& minZ, int& maxX, int& maxZ) {
+		Vector3 triMin = MinVector(MinVector(allVerts[t.indices[0]], allVerts[t.indices[1]]), allVerts[t.indices[2]]);
+		Vector3 triMax = MaxVector(MaxVector(allVerts[t.indices[0]], allVerts[t.indices[1]]), allVerts[t.indices[2]]);
+		minX = std::clamp((int)((triMin.x - lookupOrigin.x) / lookupCellSize), 0, lookupWidth - 1);
+		minZ = std::clamp((int)((triMin.z - lookupOrigin.z) / lookupCellSize), 0, lookupDepth - 1);
+		maxX = std::clamp((int)((triMax.x - lookupOrigin.x) / lookupCellSize), 0, lookupWidth - 1);
+		maxZ = std::clamp((int)((triMax.z - lookupOrigin.z) / lookupCellSize), 0, lookupDepth - 1);
+	};
+
+	//Count first, then fill, so each cell's list is one run of a single array
+	lookupCellStart.assign((lookupWidth * lookupDepth) + 1, 0);
 	for (const NavTri& t : allTris) {
-		Vector3 planePoint = t.triPlane.ProjectPointOntoPlane(pos);
+		int minX, minZ, maxX, maxZ;
+		cellRange(t, minX, minZ, maxX, maxZ);
+		for (int z = minZ; z <= maxZ; ++z) {
+			for (int x = minX; x <= maxX; ++x) {
+				lookupCellStart[(z * lookupWidth) + x + 1]++;
+			}
+		}
+	}
+	for (size_t i = 1; i < lookupCellStart.size(); ++i) {
+		lookupCellStart[i] += lookupCellStart[i - 1];
+	}
+	lookupTris.resize(lookupCellStart.back());
+	std::vector<int> fill(lookupCellStart.begin(), lookupCellStart.end() - 1);
+	for (int i = 0; i < (int)allTris.size(); ++i) {
+		int minX, minZ, maxX, maxZ;
+		cellRange(allTris[i], minX, minZ, maxX, maxZ);
+		for (int z = minZ; z <= maxZ; ++z) {
+			for (int x = minX; x <= maxX; ++x) {
+				lookupTris[fill[(z * lookupWidth) + x]++] = i;
+			}
+		}
+	}
+}
 
-		float ta = Maths::AreaofTri3D(allVerts[t.indices[0]], allVerts[t.indices[1]], planePoint);
-		float tb = Maths::AreaofTri3D(allVerts[t.indices[1]], allVerts[t.indices[2]], planePoint);
-		float tc = Maths::AreaofTri3D(allVerts[t.indices[2]], allVerts[t.indices[0]], planePoint);
+bool NavigationMesh::IsInsideTri(const NavTri& t, const Vector3& pos) const {
+	const Vector3& a = allVerts[t.indices[0]];
+	const Vector3& b = allVerts[t.indices[1]];
+	const Vector3& c = allVerts[t.indices[2]];
 
-		float areaSum = ta + tb + tc;
+	float ab = TriArea2(a, b, pos);
+	float bc = TriArea2(b, c, pos);
+	float ca = TriArea2(c, a, pos);
 
-		if (abs(areaSum - t.area)  > 0.001f) { //floating points are annoying! Are we more or less inside the triangle?
-			continue;
+	const float epsilon = 0.001f; //floating points are annoying! Points right on an edge count as in
+	return (ab >= -epsilon && bc >= -epsilon && ca >= -epsilon) ||
+		   (ab <= epsilon && bc <= epsilon && ca <= epsilon);
+}
+
+/*
+Only the triangles sharing pos's lookup cell are tested, from above. If
+triangles are stacked on top of each other (a bridge over a path, say),
+the one whose surface is closest in height to pos wins.
+*/
+const NavigationMesh::NavTri* NavigationMesh::GetTriForPosition(const Vector3& pos) const {
+	if (lookupCellStart.empty()) {
+		return nullptr;
+	}
+	int x = (int)floorf((pos.x - lookupOrigin.x) / lookupCellSize);
+	int z = (int)floorf((pos.z - lookupOrigin.z) / lookupCellSize);
+	if (x < 0 || x >= lookupWidth || z < 0 || z >= lookupDepth) {
+		return nullptr;
+	}
+	int cell = (z * lookupWidth) + x;
+
+	const NavTri* best = nullptr;
+	float bestHeight = FLT_MAX;
+	for (int i = lookupCellStart[cell]; i < lookupCellStart[cell + 1]; ++i) {
+		const NavTri& t = allTris[lookupTris[i]];
+		Vector3 normal = t.triPlane.GetNormal();
+		if (fabs(normal.y) < 0.0001f || !IsInsideTri(t, pos)) {
+			continue; //walls can't be stood on
+		}
+		float surfaceY = -(normal.x * pos.x + normal.z * pos.z + t.triPlane.GetDistance()) / normal.y;
+		float height = fabs(surfaceY - pos.y);
+		if (height < bestHeight) {
+			bestHeight	= height;
+			best		= &t;
 		}
-		return &t;
 	}
-	return nullptr;
-}
\ No newline at end of file
+	return best;
+}
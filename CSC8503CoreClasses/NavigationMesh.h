@@ -1,5 +1,6 @@
 #pragma once
 #include "NavigationMap.h"
+#include "NavigationGrid.h"
 #include "Plane.h"
 #include <string>
 #include <vector>
@@ -12,8 +13,16 @@ namespace NCL {
 			~NavigationMesh();
 
 			bool FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath) override;
-		
+
+			//Only reads the mesh, so this can be called from several threads at once, with a scratch each (indexed by triangle)
+			bool FindPath(const Vector3& from, const Vector3& to, NavigationPath& outPath, GridSearchScratch& search) const;
+
 		protected:
+			struct Portal {
+				Vector3 left;
+				Vector3 right;
+			};
+
 			struct NavTri {
 				Plane   triPlane;
 				Vector3 centroid;
@@ -35,9 +44,28 @@ namespace NCL {
 			};
 
 			const NavTri* GetTriForPosition(const Vector3& pos) const;
+			bool IsInsideTri(const NavTri& t, const Vector3& pos) const;
+			void BuildTriLookup();
+
+			void GetPortal(const NavTri& from, const NavTri& to, Portal& portal) const;
+			void StringPull(const std::vector<Portal>& portals, std::vector<Vector3>& points) const;
 
 			std::vector<NavTri>		allTris;
 			std::vector<Vector3>	allVerts;
+
+			/*
+			A uniform grid over the mesh, seen from above, with each cell listing
+			the triangles whose bounds overlap it - so finding the triangle under
+			a point only has to check the few triangles in its cell.
+			*/
+			Vector3				lookupOrigin;
+			float				lookupCellSize;
+			int					lookupWidth;
+			int					lookupDepth;
+			std::vector<int>	lookupCellStart;	//where each cell's triangles start in lookupTris, plus one past the end
+			std::vector<int>	lookupTris;
+
+			GridSearchScratch	scratch; //for the single threaded FindPath
 		};
 	}
 }
\ No newline at end of file
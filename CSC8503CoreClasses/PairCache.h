@@ -0,0 +1,263 @@
+#pragma once
+
+#include <vector>
+
+namespace NCL {
+    namespace CSC8503 {
+        /*
+        An open addressing hash set of object pairs, keyed by a pair of ids
+        (usually GameObject world IDs). The pair is unordered - (a, b) and
+        (b, a) are the same entry - but the value can store whichever order
+        it likes.
+
+        Entries are kept contiguously in insertion order, and removing entries
+        never reorders the ones that are left, so iteration order is stable
+        from frame to frame. The hash table itself just holds indices into the
+        entry array, using linear probing. Single removals just mark the entry
+        as dead, and the array is compacted once enough of them build up.
+
+        Each entry remembers the generation it was created and last touched
+        in, so callers can expire stale pairs without per-entry countdowns.
+        */
+        template<class T>
+        class PairCache {
+        public:
+            struct Entry {
+                unsigned long long  key;
+                int                 firstGeneration;
+                int                 lastGeneration;
+                T                   value;
+
+                int FirstID() const {
+                    return (int)(key >> 32);
+                }
+                int SecondID() const {
+                    return (int)(key & 0xFFFFFFFF);
+                }
+            };
+
+            template<class E, class V>
+            class Iterator {
+            public:
+                Iterator(V* v, size_t i) : vec(v), index(i) {
+                    SkipDead();
+                }
+                E& operator*() const {
+                    return (*vec)[index];
+                }
+                E* operator->() const {
+                    return &(*vec)[index];
+                }
+                Iterator& operator++() {
+                    index++;
+                    SkipDead();
+                    return *this;
+                }
+                bool operator!=(const Iterator& other) const {
+                    return index != other.index;
+                }
+                bool operator==(const Iterator& other) const {
+                    return index == other.index;
+                }
+            protected:
+                void SkipDead() {
+                    while (index < vec->size() && (*vec)[index].key == DeadKey) {
+                        index++;
+                    }
+                }
+                V*      vec;
+                size_t  index;
+            };
+
+            typedef Iterator<Entry, std::vector<Entry>>             iterator;
+            typedef Iterator<const Entry, const std::vector<Entry>> const_iterator;
+
+            PairCache() {
+                Clear();
+            }
+
+            ~PairCache() {
+            }
+
+            void Clear() {
+                entries.clear();
+                slots.assign(16, EmptySlot);
+                deadCount = 0;
+            }
+
+            static unsigned long long MakeKey(int idA, int idB) {
+                unsigned int a = (unsigned int)idA;
+                unsigned int b = (unsigned int)idB;
+                if (a > b) {
+                    std::swap(a, b);
+                }
+                return ((unsigned long long)a << 32) | b;
+            }
+
+            Entry* Find(int idA, int idB) {
+                int index = FindIndex(MakeKey(idA, idB));
+                return index == EmptySlot ? nullptr : &entries[index];
+            }
+
+            const Entry* Find(int idA, int idB) const {
+                int index = FindIndex(MakeKey(idA, idB));
+                return index == EmptySlot ? nullptr : &entries[index];
+            }
+
+            /*
+            Returns the entry for this pair, adding a default one if it isn't
+            there yet. isNew tells the caller which of the two happened.
+            */
+            Entry& Insert(int idA, int idB, int generation, bool& isNew) {
+                unsigned long long key = MakeKey(idA, idB);
+                unsigned int mask = (unsigned int)slots.size() - 1;
+                unsigned int slot = Hash(key) & mask;
+                while (slots[slot] != EmptySlot) {
+                    if (entries[slots[slot]].key == key) {
+                        isNew = false;
+                        return entries[slots[slot]];
+                    }
+                    slot = (slot + 1) & mask;
+                }
+                isNew = true;
+                slots[slot] = (int)entries.size();
+                entries.push_back({ key, generation, generation, T() });
+
+                if (entries.size() * 2 > slots.size()) {
+                    Rehash(slots.size() * 2);
+                }
+                return entries.back();
+            }
+
+            Entry& Insert(int idA, int idB, int generation) {
+                bool isNew;
+                return Insert(idA, idB, generation, isNew);
+            }
+
+            bool Remove(int idA, int idB) {
+                unsigned long long key = MakeKey(idA, idB);
+                unsigned int mask = (unsigned int)slots.size() - 1;
+                unsigned int slot = Hash(key) & mask;
+                while (slots[slot] != EmptySlot && entries[slots[slot]].key != key) {
+                    slot = (slot + 1) & mask;
+                }
+                if (slots[slot] == EmptySlot) {
+                    return false;
+                }
+                entries[slots[slot]].key = DeadKey;
+                deadCount++;
+
+                //Shift any later entries in this probe run back, so lookups don't stop early
+                unsigned int hole = slot;
+                unsigned int next = slot;
+                while (true) {
+                    next = (next + 1) & mask;
+                    if (slots[next] == EmptySlot) {
+                        break;
+                    }
+                    unsigned int home = Hash(entries[slots[next]].key) & mask;
+                    bool between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+                    if (!between) {
+                        slots[hole] = slots[next];
+                        hole = next;
+                    }
+                }
+                slots[hole] = EmptySlot;
+
+                if (deadCount * 2 > entries.size()) {
+                    Compact();
+                }
+                return true;
+            }
+
+            /*
+            Removes every entry the predicate returns true for, in one pass.
+            The predicate is given each entry in order, so it can also be used
+            to fire off events for entries that are kept.
+            */
+            template<class F>
+            int RemoveIf(F&& pred) {
+                size_t before = size();
+                size_t out = 0;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    if (entries[i].key == DeadKey || pred(entries[i])) {
+                        continue;
+                    }
+                    if (out != i) {
+                        entries[out] = std::move(entries[i]);
+                    }
+                    out++;
+                }
+                if (out != entries.size()) {
+                    entries.resize(out);
+                    deadCount = 0;
+                    Rehash(slots.size());
+                }
+                return (int)(before - out);
+            }
+
+            //Squeezes out any dead entries, keeping the live ones in order
+            void Compact() {
+                if (deadCount > 0) {
+                    RemoveIf([](const Entry&) { return false; });
+                }
+            }
+
+            size_t size() const {
+                return entries.size() - deadCount;
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            iterator        begin()         { return iterator(&entries, 0); }
+            iterator        end()           { return iterator(&entries, entries.size()); }
+            const_iterator  begin() const   { return const_iterator(&entries, 0); }
+            const_iterator  end()   const   { return const_iterator(&entries, entries.size()); }
+
+        protected:
+            static const int EmptySlot = -1;
+            static const unsigned long long DeadKey = ~0ULL;
+
+            static unsigned int Hash(unsigned long long key) {
+                //64 to 32 bit mix, so that neighbouring ids spread out across the table
+                key ^= key >> 33;
+                key *= 0xff51afd7ed558ccdULL;
+                key ^= key >> 33;
+                return (unsigned int)key;
+            }
+
+            int FindIndex(unsigned long long key) const {
+                unsigned int mask = (unsigned int)slots.size() - 1;
+                unsigned int slot = Hash(key) & mask;
+                while (slots[slot] != EmptySlot) {
+                    if (entries[slots[slot]].key == key) {
+                        return slots[slot];
+                    }
+                    slot = (slot + 1) & mask;
+                }
+                return EmptySlot;
+            }
+
+            void Rehash(size_t newSize) {
+                slots.assign(newSize, EmptySlot);
+                unsigned int mask = (unsigned int)newSize - 1;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    if (entries[i].key == DeadKey) {
+                        continue;
+                    }
+                    unsigned int slot = Hash(entries[i].key) & mask;
+                    while (slots[slot] != EmptySlot) {
+                        slot = (slot + 1) & mask;
+                    }
+                    slots[slot] = (int)i;
+                }
+            }
+
+            std::vector<Entry>  entries;
+            std::vector<int>    slots;
+            size_t              deadCount;
+        };
+    }
+}
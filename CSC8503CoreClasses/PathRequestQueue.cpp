@@ -0,0 +1,169 @@
+#include "PathRequestQueue.h"
+
+using namespace NCL;
+using namespace NCL::CSC8503;
+
+PathRequestQueue::PathRequestQueue(NavigationGrid& grid, int threadCount) : grid(grid) {
+	quit			= false;
+	nextTicket		= 1;
+	deliveryBudget	= 0;
+
+	for (int i = 0; i < std::max(1, threadCount); ++i) {
+		workers.emplace_back(&PathRequestQueue::WorkerLoop, this);
+	}
+}
+
+PathRequestQueue::~PathRequestQueue() {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		quit = true;
+	}
+	jobReady.notify_all();
+	for (auto& t : workers) {
+		t.join();
+	}
+	//once the workers have stopped, every job is in exactly one of these
+	for (PathJob* job : waiting) {
+		delete job;
+	}
+	for (PathJob* job : finished) {
+		delete job;
+	}
+}
+
+int PathRequestQueue::RequestPath(const Vector3& from, const Vector3& to, const PathRequestCallback& callback) {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	int ticket = nextTicket++;
+
+	int startNode;
+	int endNode;
+	if (!grid.GetNodeIndex(from, startNode) || !grid.GetNodeIndex(to, endNode)) {
+		//off the map, so there's nothing to search - but it still fails on a later frame, like any other
+		PathJob* job = new PathJob();
+		job->key = -1;
+		job->callbacks.emplace_back(ticket, callback);
+		finished.push_back(job);
+		tickets[ticket] = job;
+		return ticket;
+	}
+	long long key = ((long long)startNode << 32) | (unsigned int)endNode;
+
+	PathJob* job;
+	auto i = inFlight.find(key);
+	if (i != inFlight.end()) {
+		job = i->second;
+	}
+	else {
+		job = new PathJob();
+		job->from	= from;
+		job->to		= to;
+		job->key	= key;
+		inFlight[key] = job;
+		waiting.push_back(job);
+		jobReady.notify_one();
+	}
+	job->callbacks.emplace_back(ticket, callback);
+	tickets[ticket] = job;
+	return ticket;
+}
+
+void PathRequestQueue::Cancel(int ticket) {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	auto i = tickets.find(ticket);
+	if (i == tickets.end()) {
+		return;
+	}
+	auto& callbacks = i->second->callbacks;
+	for (auto c = callbacks.begin(); c != callbacks.end(); ++c) {
+		if (c->first == ticket) {
+			callbacks.erase(c);
+			break;
+		}
+	}
+	tickets.erase(i);
+}
+
+void PathRequestQueue::Update() {
+	std::vector<PathJob*> ready;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		//the budget is in callbacks, so one shared search can't blow it
+		bool	limited		= deliveryBudget > 0;
+		int		remaining	= deliveryBudget;
+		size_t	count		= 0;
+		for (; count < finished.size(); ++count) {
+			PathJob* job = finished[count];
+			int callbackCount = (int)job->callbacks.size();
+			if (limited && callbackCount > remaining) {
+				if (remaining > 0) {
+					//only some of its callbacks fit, so the rest stay queued for the next frame
+					PathJob* part = new PathJob();
+					part->found	= job->found;
+					part->path	= job->path;
+					part->callbacks.assign(job->callbacks.begin(), job->callbacks.begin() + remaining);
+					job->callbacks.erase(job->callbacks.begin(), job->callbacks.begin() + remaining);
+					ready.push_back(part);
+				}
+				break;
+			}
+			remaining -= callbackCount;
+			ready.push_back(job);
+		}
+		finished.erase(finished.begin(), finished.begin() + count);
+
+		for (PathJob* job : ready) {
+			for (auto& c : job->callbacks) {
+				tickets.erase(c.first);
+			}
+		}
+	}
+	//Outside of the lock, so that callbacks can make new requests
+	for (PathJob* job : ready) {
+		for (auto& c : job->callbacks) {
+			NavigationPath path = job->path;
+			c.second(job->found, path);
+		}
+		delete job;
+	}
+}
+
+void PathRequestQueue::ModifyGrid(const std::function<void(NavigationGrid&)>& func) {
+	std::unique_lock<std::shared_mutex> lock(gridMutex);
+	func(grid);
+}
+
+int PathRequestQueue::GetPendingCount() {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return (int)(inFlight.size() + finished.size());
+}
+
+void PathRequestQueue::WorkerLoop() {
+	GridSearchScratch search;
+	while (true) {
+		PathJob* job;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			jobReady.wait(lock, [&] { return quit || !waiting.empty(); });
+			if (quit) {
+				return;
+			}
+			job = waiting.front();
+			waiting.pop_front();
+
+			if (job->callbacks.empty()) { //everyone who asked for it has cancelled
+				inFlight.erase(job->key);
+				delete job;
+				continue;
+			}
+		}
+		{
+			std::shared_lock<std::shared_mutex> lock(gridMutex);
+			job->found = grid.FindPath(job->from, job->to, job->path, search);
+		}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			inFlight.erase(job->key);
+			finished.push_back(job);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "NavigationGrid.h"
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+
+namespace NCL {
+	namespace CSC8503 {
+		//Given its own copy of the path, so it can pop the waypoints off however it likes
+		typedef std::function<void(bool found, NavigationPath& path)> PathRequestCallback;
+
+		/*
+		Runs path searches on worker threads, rather than stalling the frame
+		while an agent works out how to get across the map. Requests go in
+		from the game thread, and the callbacks come back out on it too, from
+		Update, at least a frame later - never from a worker.
+
+		Requests from and to the same pair of grid nodes are the same search,
+		so any made while one is still waiting or running just get added on
+		to it. Lots of agents chasing the same player share a single search.
+
+		The workers only read the grid, each with its own GridSearchScratch, so
+		any changes to it have to go through ModifyGrid, which waits for the
+		searches in progress to finish first.
+		*/
+		class PathRequestQueue {
+		public:
+			PathRequestQueue(NavigationGrid& grid, int threadCount = 1);
+			~PathRequestQueue();
+
+			//Returns a ticket for the request, which can be passed to Cancel
+			int  RequestPath(const Vector3& from, const Vector3& to, const PathRequestCallback& callback);
+
+			//The callback won't be called - needed if whatever it points at is about to be deleted
+			void Cancel(int ticket);
+
+			//Call once per frame, from the same thread as the requests, to run the callbacks of finished searches
+			void Update();
+
+			/*
+			How many callbacks Update can run in a frame, so a burst of results is
+			spread out. A shared search's callbacks count one each, and any over
+			the limit wait for the next frame (and can still be cancelled). 0 for no limit
+			*/
+			void SetDeliveryBudget(int maxPerFrame) {
+				deliveryBudget = maxPerFrame;
+			}
+
+			void ModifyGrid(const std::function<void(NavigationGrid&)>& func);
+
+			//Searches that are waiting, running, or finished but not yet handed back
+			int GetPendingCount();
+
+		protected:
+			struct PathJob {
+				Vector3				from;
+				Vector3				to;
+				long long			key;
+				bool				found = false;
+				NavigationPath		path;
+				std::vector<std::pair<int, PathRequestCallback>> callbacks; //ticket, callback
+			};
+
+			void WorkerLoop();
+
+			NavigationGrid&				grid;
+			std::shared_mutex			gridMutex;
+			std::vector<std::thread>	workers;
+
+			std::mutex					queueMutex;
+			std::condition_variable		jobReady;
+			bool						quit;
+
+			std::deque<PathJob*>						waiting;
+			std::unordered_map<long long, PathJob*>	inFlight;	//waiting or being searched, by start and end node
+			std::vector<PathJob*>						finished;
+			std::unordered_map<int, PathJob*>			tickets;
+
+			int	nextTicket;
+			int	deliveryBudget;
+		};
+	}
+}
@@ -8,40 +8,114 @@ PhysicsObject::PhysicsObject(Transform* parentTransform, const CollisionVolume*
 	transform	= parentTransform;
 	volume		= parentVolume;
 
-	inverseMass = 1.0f;
+	ownStore	= new RigidBodyStore();
+	store		= ownStore;
+	bodySlot	= store->AddBody(parentTransform, this);
 	elasticity	= 0.8f;
 	friction	= 0.8f;
+	continuousCollision = false;
+	trigger = false;
+	bodyType = BodyType::Dynamic;
 }
 
 PhysicsObject::~PhysicsObject()	{
+	store->RemoveBody(bodySlot);
+	delete ownStore;
+}
+
+void PhysicsObject::SetBodyStore(RigidBodyStore* newStore) {
+	if (newStore == store || (!newStore && ownStore)) {
+		return;
+	}
+	RigidBodyStore* oldStore = store;
+	store		= newStore ? newStore : new RigidBodyStore();
+	bodySlot	= store->MoveBody(*oldStore, bodySlot);
+
+	delete ownStore; //nullptr if it was already in a shared store
+	ownStore = newStore ? nullptr : store;
+}
 
+void PhysicsObject::SetBodyType(BodyType type) {
+	bodyType = type;
+	if (type != BodyType::Dynamic) {
+		store->SetInverseMass(bodySlot, 0.0f);
+		store->SetInverseInertia(bodySlot, Vector3());
+		store->UpdateInertiaTensor(bodySlot);
+		store->SetLinearVelocity(bodySlot, Vector3());
+		store->SetAngularVelocity(bodySlot, Vector3());
+		Wake();
+	}
+	kinematicPosition		= transform->GetPosition();
+	kinematicOrientation	= transform->GetOrientation();
 }
 
+void PhysicsObject::UpdateKinematicVelocity(float dt) {
+	Vector3		position	= transform->GetPosition();
+	Quaternion	orientation	= transform->GetOrientation();
+	if (dt > 0.0f) {
+		Quaternion delta = orientation * kinematicOrientation.Conjugate();
+		if (delta.w < 0.0f) {
+			delta = -delta; //the short way round
+		}
+		Vector3 axis(delta.x, delta.y, delta.z);
+		float	sinHalfAngle = axis.Length();
+		Vector3 angular;
+		if (sinHalfAngle > 1e-6f) {
+			angular = axis * (2.0f * atan2(sinHalfAngle, delta.w) / (sinHalfAngle * dt));
+		}
+		store->SetLinearVelocity(bodySlot, (position - kinematicPosition) / dt);
+		store->SetAngularVelocity(bodySlot, angular);
+	}
+	kinematicPosition		= position;
+	kinematicOrientation	= orientation;
+}
+
+/*
+Static bodies are left untouched, so the solver can share them between threads.
+Constraints push their bodies every iteration, even when they're only holding
+them still, so an impulse only wakes a body that's actually asleep - leaving
+the sleep timer to the velocity thresholds, or a rope could never settle.
+*/
 void PhysicsObject::ApplyAngularImpulse(const Vector3& force) {
-	angularVelocity += inverseInteriaTensor * force;
+	if (GetInverseMass() == 0.0f) {
+		return;
+	}
+	if (IsAsleep()) {
+		Wake();
+	}
+	store->ApplyAngularImpulse(bodySlot, force);
 }
 
 void PhysicsObject::ApplyLinearImpulse(const Vector3& force) {
-	linearVelocity += force * inverseMass;
+	if (GetInverseMass() == 0.0f) {
+		return;
+	}
+	if (IsAsleep()) {
+		Wake();
+	}
+	store->ApplyLinearImpulse(bodySlot, force);
 }
 
+//Pushing a body in any way wakes it up, so it'll be integrated next update
 void PhysicsObject::AddForce(const Vector3& addedForce) {
-	force += addedForce;
+	Wake();
+	store->AddForce(bodySlot, addedForce);
 }
 
 void PhysicsObject::AddForceAtPosition(const Vector3& addedForce, const Vector3& position) {
 	Vector3 localPos = position - transform->GetPosition();
-	force  += addedForce;
-	torque += Vector3::Cross(localPos, addedForce);
+	Wake();
+	store->AddForce(bodySlot, addedForce);
+	store->AddTorque(bodySlot, Vector3::Cross(localPos, addedForce));
 }
 
 void PhysicsObject::AddTorque(const Vector3& addedTorque) {
-	torque += addedTorque;
+	Wake();
+	store->AddTorque(bodySlot, addedTorque);
 }
 
 void PhysicsObject::ClearForces() {
-	force				= Vector3();
-	torque				= Vector3();
+	store->ClearForces(bodySlot);
 }
 
 void PhysicsObject::InitCubeInertia() {
@@ -51,23 +125,22 @@ void PhysicsObject::InitCubeInertia() {
 
 	Vector3 dimsSqr		= fullWidth * fullWidth;
 
+	float inverseMass = GetInverseMass();
+
+	Vector3 inverseInertia;
 	inverseInertia.x = (12.0f * inverseMass) / (dimsSqr.y + dimsSqr.z);
 	inverseInertia.y = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.z);
 	inverseInertia.z = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.y);
+	store->SetInverseInertia(bodySlot, inverseInertia);
 }
 
 void PhysicsObject::InitSphereInertia() {
 	float radius	= transform->GetScale().GetMaxElement();
-	float i			= 2.5f * inverseMass / (radius*radius);
+	float i			= 2.5f * GetInverseMass() / (radius*radius);
 
-	inverseInertia	= Vector3(i, i, i);
+	store->SetInverseInertia(bodySlot, Vector3(i, i, i));
 }
 
 void PhysicsObject::UpdateInertiaTensor() {
-	Quaternion q = transform->GetOrientation();
-	
-	Matrix3 invOrientation	= Matrix3(q.Conjugate());
-	Matrix3 orientation		= Matrix3(q);
-
-	inverseInteriaTensor = orientation * Matrix3::Scale(inverseInertia) *invOrientation;
+	store->UpdateInertiaTensor(bodySlot);
 }
\ No newline at end of file
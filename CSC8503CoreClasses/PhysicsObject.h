@@ -1,4 +1,5 @@
 #pragma once
+#include "RigidBodyStore.h"
 using namespace NCL::Maths;
 
 namespace NCL {
@@ -10,33 +11,101 @@ namespace NCL {
             Impulse,
             Spring
         };
+		/*
+		Dynamic bodies are simulated as normal. Kinematic bodies are moved by
+		the game through their Transform, and push dynamic bodies out of the
+		way without being pushed back. Static bodies never move, so they're
+		left out of the simulation, and out of the per-step broadphase work.
+		*/
+		enum class BodyType {
+			Static,
+			Kinematic,
+			Dynamic
+		};
+		/*
+		The simulation state (velocities, forces, mass and inertia) lives in
+		a RigidBodyStore, so a PhysicsObject is mostly a handle to its slot.
+		It keeps a store of its own until it's added to a world, and the
+		world's PhysicsSystem moves it into the system's store.
+		*/
 		class PhysicsObject	{
 		public:
 			PhysicsObject(Transform* parentTransform, const CollisionVolume* parentVolume);
 			~PhysicsObject();
 
+			PhysicsObject(const PhysicsObject&) = delete;
+			PhysicsObject& operator=(const PhysicsObject&) = delete;
+
 			Vector3 GetLinearVelocity() const {
-				return linearVelocity;
+				return store->GetLinearVelocity(bodySlot);
 			}
 
 			Vector3 GetAngularVelocity() const {
-				return angularVelocity;
+				return store->GetAngularVelocity(bodySlot);
 			}
 
 			Vector3 GetTorque() const {
-				return torque;
+				return store->GetTorque(bodySlot);
 			}
 
 			Vector3 GetForce() const {
-				return force;
+				return store->GetForce(bodySlot);
 			}
 
 			void SetInverseMass(float invMass) {
-				inverseMass = invMass;
+				store->SetInverseMass(bodySlot, invMass);
 			}
 
 			float GetInverseMass() const {
-				return inverseMass;
+				return store->GetInverseMass(bodySlot);
+			}
+
+			//Static and kinematic bodies have no mass, so this clears it, along with any velocity
+			void SetBodyType(BodyType type);
+
+			BodyType GetBodyType() const {
+				return bodyType;
+			}
+			bool IsStatic() const {
+				return bodyType == BodyType::Static;
+			}
+			bool IsKinematic() const {
+				return bodyType == BodyType::Kinematic;
+			}
+			bool IsDynamic() const {
+				return bodyType == BodyType::Dynamic;
+			}
+
+			//Gives a kinematic body the velocity it has been moved at since the last call, for the solver to use
+			void UpdateKinematicVelocity(float dt);
+
+			//Where UpdateKinematicVelocity last saw the body, which snapshots need to carry on from
+			void GetKinematicPose(Vector3& position, Quaternion& orientation) const {
+				position	= kinematicPosition;
+				orientation	= kinematicOrientation;
+			}
+			void SetKinematicPose(const Vector3& position, const Quaternion& orientation) {
+				kinematicPosition		= position;
+				kinematicOrientation	= orientation;
+			}
+
+			int GetBodySlot() const {
+				return bodySlot;
+			}
+
+			RigidBodyStore* GetBodyStore() const {
+				return store;
+			}
+
+			//Moves the body's state into the given store, or back into one of its own if given nullptr
+			void SetBodyStore(RigidBodyStore* newStore);
+
+			bool IsAsleep() const {
+				return store->IsAsleep(bodySlot);
+			}
+
+			void Wake() {
+				store->Wake(bodySlot);
 			}
 
 			void ApplyAngularImpulse(const Vector3& force);
@@ -52,11 +121,13 @@ namespace NCL {
 			void ClearForces();
 
 			void SetLinearVelocity(const Vector3& v) {
-				linearVelocity = v;
+				Wake();
+				store->SetLinearVelocity(bodySlot, v);
 			}
 
 			void SetAngularVelocity(const Vector3& v) {
-				angularVelocity = v;
+				Wake();
+				store->SetAngularVelocity(bodySlot, v);
 			}
             Transform*	 GetTransForm(){
                 return transform;
@@ -67,7 +138,38 @@ namespace NCL {
 			void UpdateInertiaTensor();
 
 			Matrix3 GetInertiaTensor() const {
-				return inverseInteriaTensor;
+				return store->GetInertiaTensor(bodySlot);
+			}
+
+			//How bouncy the object is, from 0 to 1 - a contact uses the product of both objects' values
+			void SetElasticity(float e) {
+				elasticity = e;
+			}
+			float GetElasticity() const {
+				return elasticity;
+			}
+
+			void SetFriction(float f) {
+				friction = f;
+			}
+			float GetFriction() const {
+				return friction;
+			}
+
+			//Fast movers can be swept along their path each step, so they can't skip through thin objects
+			void SetContinuousCollision(bool state) {
+				continuousCollision = state;
+			}
+			bool UsesContinuousCollision() const {
+				return continuousCollision;
+			}
+
+			//Triggers get collision events, but nothing is ever pushed out of them
+			void SetTrigger(bool state) {
+				trigger = state;
+			}
+			bool IsTrigger() const {
+				return trigger;
 			}
 
             void SetCollisionType(CollisionType t) { this->collisionType = t; }
@@ -77,19 +179,17 @@ namespace NCL {
 			const CollisionVolume* volume;
 			Transform*		transform;
 
-			float inverseMass;
+			RigidBodyStore* store;
+			RigidBodyStore* ownStore;	//only while it isn't in a PhysicsSystem's store
+			int	  bodySlot;
 			float elasticity;
 			float friction;
+			bool  continuousCollision;
+			bool  trigger;
 
-			//linear stuff
-			Vector3 linearVelocity;
-			Vector3 force;
-			
-			//angular stuff
-			Vector3 angularVelocity;
-			Vector3 torque;
-			Vector3 inverseInertia;
-			Matrix3 inverseInteriaTensor;
+			BodyType	bodyType;
+			Vector3		kinematicPosition;
+			Quaternion	kinematicOrientation;
 
             CollisionType collisionType;
 		};
@@ -13,22 +13,77 @@
 using namespace NCL;
 using namespace CSC8503;
 
-PhysicsSystem::PhysicsSystem(GameWorld &g) : gameWorld(g) {
+PhysicsSystem::PhysicsSystem(GameWorld &g) : gameWorld(g), broadphaseTree(1.0f), broadphaseSAP(3), staticTree(0.0f) {
     applyGravity = false;
     //useBroadPhase = false;
     useBroadPhase = false;
     dTOffset = 0.0f;
+    fixedDeltaTime = 1.0f / 120.0f;
+    maxSubsteps = 8;
+    stepBudget = 1.0f / 120.0f;
+    averageStepCost = 0.0f;
+    interpolationAlpha = 1.0f;
     globalDamping = 0.995f;
+    deterministic = false;
+    stepCounter = 0;
+    useSleeping = true;
+    sleepLinearThreshold = 0.2f;
+    sleepAngularThreshold = 0.2f;
+    timeToSleep = 1.0f;
+    solverIterations = 10;
+    broadphaseStep = 0;
+    broadphaseType = BroadPhaseType::DynamicTree;
+    for (unsigned int &mask: layerCollisions) {
+        mask = ~0u;
+    }
+    narrowphaseContacts.resize(jobSystem.GetThreadCount());
     SetGravity(Vector3(0.0f, -9.8f, 0.0f));
 }
 
 PhysicsSystem::~PhysicsSystem() {
+    // objects can outlive us (whether they're still in the world or not), so they take their bodies back with them
+    for (int slot = 0; slot < bodyStore.GetCapacity(); ++slot) {
+        if (PhysicsObject *object = bodyStore.GetOwner(slot)) {
+            object->SetBodyStore(nullptr);
+        }
+    }
 }
 
 void PhysicsSystem::SetGravity(const Vector3 &g) {
     gravity = g;
 }
 
+void PhysicsSystem::SetLayerCollision(int layerA, int layerB, bool state) {
+    if (state) {
+        layerCollisions[layerA] |= 1u << layerB;
+        layerCollisions[layerB] |= 1u << layerA;
+    } else {
+        layerCollisions[layerA] &= ~(1u << layerB);
+        layerCollisions[layerB] &= ~(1u << layerA);
+    }
+}
+
+void PhysicsSystem::SetLayerCollisionMask(int layer, unsigned int mask) {
+    for (int other = 0; other < 32; ++other) {
+        SetLayerCollision(layer, other, (mask >> other) & 1);
+    }
+}
+
+void PhysicsSystem::SetBroadPhaseType(BroadPhaseType type) {
+    if (type == broadphaseType) {
+        return;
+    }
+    broadphaseType = type;
+    // the proxies belong to whichever structure made them, so start afresh
+    broadphaseCollisions.Clear();
+    broadphaseTree.Clear();
+    broadphaseSAP.Clear();
+    broadphaseProxies.clear();
+    broadphaseStamps.clear();
+    staticTree.Clear();
+    staticProxies.clear();
+}
+
 /*
 
 If the 'game' is ever reset, the PhysicsSystem must be
@@ -40,7 +95,14 @@ any collisions they are in.
 
 */
 void PhysicsSystem::Clear() {
-    allCollisions.clear();
+    allCollisions.Clear();
+    broadphaseCollisions.Clear();
+    broadphaseTree.Clear();
+    broadphaseSAP.Clear();
+    broadphaseProxies.clear();
+    broadphaseStamps.clear();
+    staticTree.Clear();
+    staticProxies.clear();
 }
 
 /*
@@ -49,55 +111,89 @@ This is the core of the physics engine update
 
 */
 
-bool useSimpleContainer = false;
-
-int constraintIterationCount = 10;
-
-//This is the fixed timestep we'd LIKE to have
-const int idealHZ = 120;
-const float idealDT = 1.0f / idealHZ;
-
-/*
-This is the fixed update we actually have...
-If physics takes too long it starts to kill the framerate, it'll drop the 
-iteration count down until the FPS stabilises, even if that ends up
-being at a low rate. 
-*/
-int realHZ = idealHZ;
-float realDT = idealDT;
-
 void PhysicsSystem::Update(float dt) {
     if (Window::GetKeyboard()->KeyPressed(KeyCodes::B)) {
         useBroadPhase = !useBroadPhase;
         std::cout << "Setting broadphase to " << useBroadPhase << std::endl;
     }
     if (Window::GetKeyboard()->KeyPressed(KeyCodes::N)) {
-        useSimpleContainer = !useSimpleContainer;
-        std::cout << "Setting broad container to " << useSimpleContainer << std::endl;
+        bool useSAP = broadphaseType != BroadPhaseType::SweepAndPrune;
+        SetBroadPhaseType(useSAP ? BroadPhaseType::SweepAndPrune : BroadPhaseType::DynamicTree);
+        std::cout << "Setting broad container to " << (useSAP ? "sweep and prune" : "dynamic tree") << std::endl;
     }
     if (Window::GetKeyboard()->KeyPressed(KeyCodes::I)) {
-        constraintIterationCount--;
-        std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
+        SetSolverIterations(solverIterations - 1);
+        std::cout << "Setting constraint iterations to " << solverIterations << std::endl;
     }
     if (Window::GetKeyboard()->KeyPressed(KeyCodes::O)) {
-        constraintIterationCount++;
-        std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
+        SetSolverIterations(solverIterations + 1);
+        std::cout << "Setting constraint iterations to " << solverIterations << std::endl;
     }
 
     dTOffset += dt; //We accumulate time delta here - there might be remainders from previous frame!
 
+    /*
+    Physics always moves forward in steps of fixedDeltaTime, however long
+    the frame took. If a frame is so slow that catching up would take more
+    steps than we can afford, the extra time is thrown away - otherwise
+    each slow frame would queue up even more physics for the next one,
+    and the game would spiral down to a standstill. What we can afford
+    comes from a running average of how long a step has been taking.
+
+    A deterministic system can't throw time away, or a slow frame on one
+    machine would change the result, so it still takes at most maxSubsteps
+    steps in a frame, but carries the rest over to the frames after. Only a
+    few frames' worth is carried, though - a machine that can't keep up at
+    all would otherwise fall further behind every frame. Past that it drops
+    time like anything else, so callers that must never lose a step should
+    decide how many to run themselves, with Simulate.
+    */
+    const int maxBacklogFrames = 4;
+    int stepCount = (int)(dTOffset / fixedDeltaTime);
+    int stepLimit = maxSubsteps;
+    if (averageStepCost > 0.0f && !deterministic) {
+        int affordable = (int)(stepBudget / averageStepCost);
+        stepLimit = std::max(1, std::min(stepLimit, affordable));
+    }
+    if (stepCount > stepLimit) {
+        stepCount = stepLimit;
+        int kept = deterministic ? stepCount * (1 + maxBacklogFrames) : stepCount;
+        dTOffset = std::min(dTOffset, std::fmod(dTOffset, fixedDeltaTime) + kept * fixedDeltaTime);
+    }
+
     GameTimer t;
     t.GetTimeDeltaSeconds();
 
-    if (useBroadPhase) {
-        UpdateObjectAABBs();
+    dTOffset -= stepCount * fixedDeltaTime;
+    Simulate(stepCount);
+
+    t.Tick();
+    if (stepCount > 0) {
+        float stepCost = t.GetTimeDeltaSeconds() / stepCount;
+        averageStepCost = averageStepCost > 0.0f ? averageStepCost + (stepCost - averageStepCost) * 0.1f : stepCost;
     }
-    int iteratorCount = 0;
-    while (dTOffset > realDT) {
-        IntegrateAccel(realDT); //Update accelerations from external forces
+
+    //The renderer blends between the last two steps by however much time is left over
+    interpolationAlpha = std::min(1.0f, dTOffset / fixedDeltaTime);
+    gameWorld.SetInterpolationAlpha(interpolationAlpha);
+}
+
+/*
+Everything that refreshes the simulation's view of the world runs once per
+step, rather than once per call, so Simulate(2) ends up exactly where two
+calls to Simulate(1) would - which is what a replay runs, one step at a time.
+*/
+void PhysicsSystem::Simulate(int stepCount) {
+    for (int step = 0; step < stepCount; ++step) {
+        AttachBodies();
+        UpdateObjectAABBs(); // the continuous collision sweeps need these too, even without a broadphase
+        UpdateActiveBodies();
+        UpdateKinematicBodies(fixedDeltaTime);
+
+        IntegrateAccel(fixedDeltaTime); //Update accelerations from external forces
         if (useBroadPhase) {
             BroadPhase();
-            NarrowPhase(dt);
+            NarrowPhase();
         } else {
             BasicCollisionDetection();
         }
@@ -105,88 +201,185 @@ void PhysicsSystem::Update(float dt) {
         //This is our simple iterative solver -
         //we just run things multiple times, slowly moving things forward
         //and then rechecking that the constraints have been met
-        float constraintDt = realDT / (float) constraintIterationCount;
-        for (int i = 0; i < constraintIterationCount; ++i) {
-            UpdateConstraints(constraintDt);
+        PrepareContacts(fixedDeltaTime);
+        BuildSolverBatches();
+        float constraintDt = fixedDeltaTime / (float) solverIterations;
+        for (int i = 0; i < solverIterations; ++i) {
+            SolveBatches(constraintDt);
         }
-        IntegrateVelocity(realDT); //update positions from new velocity changes
+        StoreContactImpulses();
+        SweepFastBodies(fixedDeltaTime);
+        IntegrateVelocity(fixedDeltaTime); //update positions from new velocity changes
+        stepCounter++;
 
-        dTOffset -= realDT;
-        iteratorCount++;
+        UpdateIslands(fixedDeltaTime); //Put any islands that have come to rest to sleep
+
+        UpdateCollisionList(); //Remove any old collisions
     }
 
     ClearForces();    //Once we've finished with the forces, reset them to zero
 
-    UpdateCollisionList(); //Remove any old collisions
+    //The query tree isn't used by the steps themselves, so once per call is enough
+    if (stepCount > 0) {
+        gameWorld.UpdateQueryTree(); // keep raycasts in step with where things have moved to
+    }
+}
 
-    t.Tick();
-    float updateTime = t.GetTimeDeltaSeconds();
+void PhysicsSystem::CaptureSnapshot(PhysicsSnapshot &snapshot) {
+    AttachBodies(); // anything added since the last step has to be in the snapshot too
+    bodyStore.SaveState(snapshot.bodies);
+    snapshot.collisions = allCollisions;
+
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
+    snapshot.kinematicPoses.clear();
+    for (auto i = first; i != last; ++i) {
+        PhysicsObject *object = (*i)->GetPhysicsObject();
+        if (object && object->IsKinematic()) {
+            PhysicsSnapshot::KinematicPose pose;
+            pose.worldID = (*i)->GetWorldID();
+            object->GetKinematicPose(pose.position, pose.orientation);
+            snapshot.kinematicPoses.push_back(pose);
+        }
+    }
+    snapshot.dTOffset = dTOffset;
+    snapshot.stepCounter = stepCounter;
+    snapshot.collisionGeneration = collisionGeneration;
+}
 
-    //Uh oh, physics is taking too long...
-    if (updateTime > realDT) {
-        realHZ /= 2;
-        realDT *= 2;
-        std::cout << "Dropping iteration count due to long physics time...(now " << realHZ << ")\n";
-    } else if (dt * 2 < realDT) { //we have plenty of room to increase iteration count!
-        int temp = realHZ;
-        realHZ *= 2;
-        realDT /= 2;
+void PhysicsSystem::RestoreSnapshot(const PhysicsSnapshot &snapshot) {
+    bodyStore.RestoreState(snapshot.bodies);
+    dTOffset = snapshot.dTOffset;
+    stepCounter = snapshot.stepCounter;
+    collisionGeneration = snapshot.collisionGeneration;
 
-        if (realHZ > idealHZ) {
-            realHZ = idealHZ;
-            realDT = idealDT;
+    // a pair can only come back if both of its objects are still in the world
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
+    objectsByID.clear();
+    for (auto i = first; i != last; ++i) {
+        int worldID = (*i)->GetWorldID();
+        if (worldID >= (int) objectsByID.size()) {
+            objectsByID.resize(worldID + 1, nullptr);
+        }
+        objectsByID[worldID] = *i;
+    }
+    auto objectAt = [&](int worldID) {
+        return worldID < (int) objectsByID.size() ? objectsByID[worldID] : nullptr;
+    };
+    for (const PhysicsSnapshot::KinematicPose &pose : snapshot.kinematicPoses) {
+        GameObject *object = objectAt(pose.worldID);
+        if (object && object->GetPhysicsObject() && object->GetPhysicsObject()->IsKinematic()) {
+            object->GetPhysicsObject()->SetKinematicPose(pose.position, pose.orientation);
         }
-        if (temp != realHZ) {
-            std::cout << "Raising iteration count due to short physics time...(now " << realHZ << ")\n";
+    }
+    allCollisions = snapshot.collisions;
+    allCollisions.RemoveIf([&](const PairCache<CollisionDetection::CollisionInfo>::Entry &e) {
+        GameObject *first = objectAt(e.FirstID());
+        GameObject *second = objectAt(e.SecondID());
+        bool inWorld = (first == e.value.a && second == e.value.b) || (first == e.value.b && second == e.value.a);
+        return !inWorld;
+    });
+    gameWorld.UpdateQueryTree();
+}
+
+void PhysicsSystem::Resimulate(const PhysicsSnapshot &snapshot, int stepCount, const std::function<void(int)> &beforeStep) {
+    RestoreSnapshot(snapshot);
+    for (int step = 0; step < stepCount; ++step) {
+        if (beforeStep) {
+            beforeStep(step);
         }
+        Simulate(1);
     }
 }
 
+/*
+FNV-1a over the raw bits of each body's state, in world ID order, so it
+doesn't matter what order the world happens to keep its objects in. Any
+difference at all between two runs, down to the last bit of a float,
+gives a different hash.
+*/
+unsigned long long PhysicsSystem::GetStateHash() {
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
+    hashOrder.assign(first, last);
+    std::sort(hashOrder.begin(), hashOrder.end(), [](const GameObject *a, const GameObject *b) {
+        return a->GetWorldID() < b->GetWorldID();
+    });
+
+    unsigned long long hash = 14695981039346656037ULL;
+    auto add = [&](const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    for (GameObject *g: hashOrder) {
+        int worldID = g->GetWorldID();
+        Vector3 position = g->GetTransform().GetPosition();
+        Quaternion orientation = g->GetTransform().GetOrientation();
+        add(&worldID, sizeof(worldID));
+        add(&position, sizeof(position));
+        add(&orientation, sizeof(orientation));
+        if (PhysicsObject *phys = g->GetPhysicsObject()) {
+            Vector3 linear = phys->GetLinearVelocity();
+            Vector3 angular = phys->GetAngularVelocity();
+            bool asleep = phys->IsAsleep();
+            add(&linear, sizeof(linear));
+            add(&angular, sizeof(angular));
+            add(&asleep, sizeof(asleep));
+        }
+    }
+    return hash;
+}
+
 /*
 Later on we're going to need to keep track of collisions
-across multiple frames, so we store them in a set.
+across multiple frames, so we store them in a pair cache.
 
 The first time they are added, we tell the objects they are colliding.
 The frame they are to be removed, we tell them they're no longer colliding.
+Each pair remembers the generation (physics update) it was last seen in,
+so a pair is removed once it hasn't been seen for numCollisionFrames updates.
 
 From this simple mechanism, we we build up gameplay interactions inside the
 OnCollisionBegin / OnCollisionEnd functions (removing health when hit by a 
 rocket launcher, gaining a point when the player hits the gold coin, and so on).
 */
 void PhysicsSystem::UpdateCollisionList() {
-    for (std::set<CollisionDetection::CollisionInfo>::iterator i = allCollisions.begin(); i != allCollisions.end();) {
-        if ((*i).framesLeft == numCollisionFrames) {
-            i->a->OnCollisionBegin(i->b);
-            i->b->OnCollisionBegin(i->a);
+    allCollisions.RemoveIf([&](PairCache<CollisionDetection::CollisionInfo>::Entry &e) {
+        CollisionDetection::CollisionInfo &i = e.value;
+        if (e.firstGeneration == collisionGeneration) {
+            i.a->OnCollisionBegin(i.b);
+            i.b->OnCollisionBegin(i.a);
         }
-
-        CollisionDetection::CollisionInfo &in = const_cast<CollisionDetection::CollisionInfo &>(*i);
-        in.framesLeft--;
-
-        if ((*i).framesLeft < 0) {
-            i->a->OnCollisionEnd(i->b);
-            i->b->OnCollisionEnd(i->a);
-            i = allCollisions.erase(i);
-        } else {
-            ++i;
+        if (collisionGeneration - e.lastGeneration >= numCollisionFrames) {
+            i.a->OnCollisionEnd(i.b);
+            i.b->OnCollisionEnd(i.a);
+            return true;
         }
-    }
+        return false;
+    });
+    collisionGeneration++;
 }
 
 void PhysicsSystem::UpdateObjectAABBs() {
-    gameWorld.OperateOnContents([](GameObject *g) {
-                                    g->UpdateBroadphaseAABB();
-                                }
-    );
-
-    // todo : save one ?
     std::vector<GameObject *>::const_iterator first;
     std::vector<GameObject *>::const_iterator last;
     gameWorld.GetObjectIterators(first, last);
     for (auto i = first; i != last; ++i) {
+        // static bodies can't have turned since they went into the static tree
+        int worldID = (*i)->GetWorldID();
+        PhysicsObject *phys = (*i)->GetPhysicsObject();
+        if (phys && phys->IsStatic() && worldID < (int) staticProxies.size() &&
+            staticProxies[worldID] != DynamicAABBTree<BroadphaseObject>::NullNode) {
+            continue;
+        }
         (*i)->UpdateBroadphaseAABB();
     }
-
 }
 
 /*
@@ -194,9 +387,9 @@ void PhysicsSystem::UpdateObjectAABBs() {
 This is how we'll be doing collision detection in tutorial 4.
 We step thorugh every pair of objects once (the inner for loop offset 
 ensures this), and determine whether they collide, and if so, add them
-to the collision set for later processing. The set will guarantee that
+to the collision cache for later processing. The cache will guarantee that
 a particular pair will only be added once, so objects colliding for
-multiple frames won't flood the set with duplicates.
+multiple frames won't flood it with duplicates.
 */
 void PhysicsSystem::BasicCollisionDetection() {
     std::vector<GameObject *>::const_iterator first;
@@ -208,16 +401,14 @@ void PhysicsSystem::BasicCollisionDetection() {
             continue;
         }
         for (auto j = i + 1; j != last; ++j) {
-            if ((*j)->GetPhysicsObject() == nullptr) {
+            if ((*j)->GetPhysicsObject() == nullptr || !ShouldCollide(*i, *j) || SkipRestingPair(*i, *j)) {
                 continue;
             }
             CollisionDetection::CollisionInfo info;
             if (CollisionDetection::ObjectIntersection(*i, *j, info)) {
                 std::cout << " Collision between " << (*i)->GetName()
                           << " and " << (*j)->GetName() << std::endl;
-                ImpulseResolveCollision(*info.a, *info.b, info.point);
-                info.framesLeft = numCollisionFrames;
-                allCollisions.insert(info);
+                UpdateManifold((*i)->GetWorldID(), (*j)->GetWorldID(), info);
             }
         }
     }
@@ -228,65 +419,283 @@ void PhysicsSystem::BasicCollisionDetection() {
 In tutorial 5, we start determining the correct response to a collision,
 so that objects separate back out. 
 
+Rather than resolving each contact as soon as it's found, the collision
+detection just records each pair's contact manifold, and all of them are
+then solved together using sequential impulses. Each iteration makes every
+contact a little more correct, with the constraints solved in between, and
+the impulses each contact point ends up with are kept in the manifold, so
+that the next step can start from them ('warm starting'). Stacks settle in
+far fewer iterations this way, as the solver isn't starting from scratch.
+
 */
-void PhysicsSystem::ImpulseResolveCollision(GameObject &a, GameObject &b, CollisionDetection::ContactPoint &p) const {
-    PhysicsObject *physA = a.GetPhysicsObject();
-    PhysicsObject *physB = b.GetPhysicsObject();
+void PhysicsSystem::UpdateManifold(int idA, int idB, CollisionDetection::CollisionInfo &info) {
+    bool isNew;
+    auto &entry = allCollisions.Insert(idA, idB, collisionGeneration, isNew);
+
+    // carry the impulses over from any old points that are still in the same place
+    const float matchDistance = 0.1f;
+    CollisionDetection::CollisionInfo &old = entry.value;
+    if (!isNew && old.a == info.a && old.b == info.b) {
+        for (int i = 0; i < info.pointCount; ++i) {
+            CollisionDetection::ContactPoint &p = info.points[i];
+            for (int j = 0; j < old.pointCount; ++j) {
+                const CollisionDetection::ContactPoint &q = old.points[j];
+                if ((p.localA - q.localA).LengthSquared() < matchDistance * matchDistance &&
+                    Vector3::Dot(p.normal, q.normal) > 0.95f) {
+                    p.normalImpulse = q.normalImpulse;
+                    p.tangentImpulse[0] = q.tangentImpulse[0];
+                    p.tangentImpulse[1] = q.tangentImpulse[1];
+                    break;
+                }
+            }
+        }
+    }
+    entry.value = info;
+    entry.lastGeneration = collisionGeneration;
+    solverPairs.emplace_back(idA, idB);
+}
 
-    Transform &transformA = a.GetTransform();
-    Transform &transformB = b.GetTransform();
+static float EffectiveMass(PhysicsObject *physA, PhysicsObject *physB, const Vector3 &relativeA,
+                           const Vector3 &relativeB, const Vector3 &direction) {
+    Vector3 inertiaA = Vector3::Cross(physA->GetInertiaTensor() * Vector3::Cross(relativeA, direction), relativeA);
+    Vector3 inertiaB = Vector3::Cross(physB->GetInertiaTensor() * Vector3::Cross(relativeB, direction), relativeB);
+    float k = physA->GetInverseMass() + physB->GetInverseMass() + Vector3::Dot(inertiaA + inertiaB, direction);
+    return k > 0.0f ? 1.0f / k : 0.0f;
+}
 
-    float totalMass = physA->GetInverseMass() + physB->GetInverseMass();
+static Vector3 RelativeVelocity(const RigidBodyStore &store, int slotA, int slotB, const Vector3 &relativeA,
+                                const Vector3 &relativeB) {
+    Vector3 fullVelocityA = store.GetLinearVelocity(slotA) + Vector3::Cross(store.GetAngularVelocity(slotA), relativeA);
+    Vector3 fullVelocityB = store.GetLinearVelocity(slotB) + Vector3::Cross(store.GetAngularVelocity(slotB), relativeB);
+    return fullVelocityB - fullVelocityA;
+}
 
-    if (totalMass == 0) {
-        return; // two static objects ??
+// static bodies are never written to, so they can be shared between contacts solved in parallel
+static void ApplyContactImpulse(RigidBodyStore &store, int slotA, int slotB, const Vector3 &relativeA,
+                                const Vector3 &relativeB, const Vector3 &impulse) {
+    if (store.GetInverseMass(slotA) > 0.0f) {
+        store.ApplyLinearImpulse(slotA, -impulse);
+        store.ApplyAngularImpulse(slotA, Vector3::Cross(relativeA, -impulse));
+    }
+    if (store.GetInverseMass(slotB) > 0.0f) {
+        store.ApplyLinearImpulse(slotB, impulse);
+        store.ApplyAngularImpulse(slotB, Vector3::Cross(relativeB, impulse));
     }
+}
 
-    // Separate them out using projection
-    transformA.SetPosition(transformA.GetPosition() -
-                           (p.normal * p.penetration * (physA->GetInverseMass() / totalMass)));
+static int DynamicSlot(const RigidBodyStore &store, int slot) {
+    return store.GetInverseMass(slot) > 0.0f ? slot : -1;
+}
 
-    transformB.SetPosition(transformB.GetPosition() +
-                           (p.normal * p.penetration * (physB->GetInverseMass() / totalMass)));
+void PhysicsSystem::PrepareContacts(float dt) {
+    const float baumgarte = 0.2f;             // how much of the penetration to remove per step
+    const float allowedPenetration = 0.01f;   // a little overlap keeps resting contacts stable
+    const float restitutionThreshold = 1.0f;  // slower impacts than this don't bounce
 
-    Vector3 relativeA = p.localA;
-    Vector3 relativeB = p.localB;
+    RigidBodyStore &store = bodyStore;
+    solverContacts.clear();
 
-    Vector3 angVelocityA =
-            Vector3::Cross(physA->GetAngularVelocity(), relativeA);
-    Vector3 angVelocityB =
-            Vector3::Cross(physB->GetAngularVelocity(), relativeB);
+    for (const auto &ids: solverPairs) {
+        auto *entry = allCollisions.Find(ids.first, ids.second);
+        CollisionDetection::CollisionInfo &info = entry->value;
+        PhysicsObject *physA = info.a->GetPhysicsObject();
+        PhysicsObject *physB = info.b->GetPhysicsObject();
 
-    Vector3 fullVelocityA = physA->GetLinearVelocity() + angVelocityA;
-    Vector3 fullVelocityB = physB->GetLinearVelocity() + angVelocityB;
+        if (physA->GetInverseMass() + physB->GetInverseMass() == 0) {
+            continue; // two static objects ??
+        }
+        if (physA->IsTrigger() || physB->IsTrigger()) {
+            continue; // only there for its collision events
+        }
+        float elasticity = physA->GetElasticity() * physB->GetElasticity();
+        float friction = sqrt(physA->GetFriction() * physB->GetFriction());
+
+        for (int i = 0; i < info.pointCount; ++i) {
+            CollisionDetection::ContactPoint &p = info.points[i];
+            SolverContact c;
+            c.slotA = physA->GetBodySlot();
+            c.slotB = physB->GetBodySlot();
+            c.relativeA = p.localA;
+            c.relativeB = p.localB;
+            c.normal = p.normal;
+
+            // any two directions at right angles to the normal will do for friction
+            Vector3 axis = abs(c.normal.x) < 0.57f ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+            c.tangents[0] = Vector3::Cross(c.normal, axis).Normalised();
+            c.tangents[1] = Vector3::Cross(c.normal, c.tangents[0]);
+
+            c.normalMass = EffectiveMass(physA, physB, c.relativeA, c.relativeB, c.normal);
+            c.tangentMass[0] = EffectiveMass(physA, physB, c.relativeA, c.relativeB, c.tangents[0]);
+            c.tangentMass[1] = EffectiveMass(physA, physB, c.relativeA, c.relativeB, c.tangents[1]);
+            c.friction = friction;
+
+            float approachSpeed = Vector3::Dot(RelativeVelocity(store, c.slotA, c.slotB, c.relativeA, c.relativeB),
+                                               c.normal);
+            float positionBias = (baumgarte / dt) * std::max(p.penetration - allowedPenetration, 0.0f);
+            float bounceBias = approachSpeed < -restitutionThreshold ? -elasticity * approachSpeed : 0.0f;
+            c.bias = std::max(positionBias, bounceBias);
+
+            c.normalImpulse = p.normalImpulse;
+            c.tangentImpulse[0] = p.tangentImpulse[0];
+            c.tangentImpulse[1] = p.tangentImpulse[1];
+            c.cached = &p;
+
+            // warm start from whatever this point needed last step
+            Vector3 warmImpulse = c.normal * c.normalImpulse + c.tangents[0] * c.tangentImpulse[0] +
+                                  c.tangents[1] * c.tangentImpulse[1];
+            ApplyContactImpulse(store, c.slotA, c.slotB, c.relativeA, c.relativeB, warmImpulse);
+
+            solverContacts.push_back(c);
+        }
+    }
+    solverPairs.clear();
+}
 
-    Vector3 contactVelocity = fullVelocityB - fullVelocityA;
+void PhysicsSystem::SolveContact(SolverContact &c) {
+    RigidBodyStore &store = bodyStore;
 
+    // friction first, limited by how hard the contact is currently being pushed together
+    float maxFriction = c.friction * c.normalImpulse;
+    for (int t = 0; t < 2; ++t) {
+        Vector3 contactVelocity = RelativeVelocity(store, c.slotA, c.slotB, c.relativeA, c.relativeB);
+        float lambda = -Vector3::Dot(contactVelocity, c.tangents[t]) * c.tangentMass[t];
 
-    float impulseForce = Vector3::Dot(contactVelocity, p.normal);
+        float oldImpulse = c.tangentImpulse[t];
+        c.tangentImpulse[t] = Maths::Clamp(oldImpulse + lambda, -maxFriction, maxFriction);
+        lambda = c.tangentImpulse[t] - oldImpulse;
 
-    // now to work out the effect of inertia ....
-    Vector3 inertiaA = Vector3::Cross(physA->GetInertiaTensor() *
-                                      Vector3::Cross(relativeA, p.normal), relativeA);
-    Vector3 inertiaB = Vector3::Cross(physB->GetInertiaTensor() *
-                                      Vector3::Cross(relativeB, p.normal), relativeB);
-    float angularEffect = Vector3::Dot(inertiaA + inertiaB, p.normal);
+        ApplyContactImpulse(store, c.slotA, c.slotB, c.relativeA, c.relativeB, c.tangents[t] * lambda);
+    }
 
-    float cRestitution = 0.66f; // disperse some kinectic energy
+    // then the normal - the total impulse can only ever push the objects apart
+    Vector3 contactVelocity = RelativeVelocity(store, c.slotA, c.slotB, c.relativeA, c.relativeB);
+    float lambda = (c.bias - Vector3::Dot(contactVelocity, c.normal)) * c.normalMass;
 
-    float j = (-(1.0f + cRestitution) * impulseForce) /
-              (totalMass + angularEffect);
+    float oldImpulse = c.normalImpulse;
+    c.normalImpulse = std::max(oldImpulse + lambda, 0.0f);
+    lambda = c.normalImpulse - oldImpulse;
 
-    Vector3 fullImpulse = p.normal * j;
+    ApplyContactImpulse(store, c.slotA, c.slotB, c.relativeA, c.relativeB, c.normal * lambda);
+}
 
-    physA->ApplyLinearImpulse(-fullImpulse);
-    physB->ApplyLinearImpulse(fullImpulse);
+/*
+As part of the final physics tutorials, we add in the ability
+to constrain objects based on some extra calculation, allowing
+us to model springs and ropes etc. These are solved alongside the
+contacts, by the same iterations.
+
+Gauss-Seidel has each contact and constraint see the velocities left by the
+ones before it, so they can't simply all be solved at once. Two rows that
+don't share a moving body don't affect each other though, so the rows are
+greedily coloured such that no two in the same colour share a body, and
+then each colour is solved in parallel, one after the other. Static bodies
+are never written to, so any number of rows in a colour can lean on the floor.
+
+Rows are coloured in a fixed order, and rows in one colour can't affect
+each other, so the result is the same however the work is split between
+threads. Anything that can't be coloured is solved on its own afterwards.
+*/
+void PhysicsSystem::BuildSolverBatches() {
+    RigidBodyStore &store = bodyStore;
+    solverRows.clear();
 
-    physA->ApplyAngularImpulse(Vector3::Cross(relativeA, -fullImpulse));
+    for (int i = 0; i < (int) solverContacts.size(); ++i) {
+        const SolverContact &c = solverContacts[i];
+        solverRows.push_back({i, nullptr, DynamicSlot(store, c.slotA), DynamicSlot(store, c.slotB), 0});
+    }
 
-    physB->ApplyAngularImpulse(Vector3::Cross(relativeB, fullImpulse));
+    std::vector<Constraint *>::const_iterator first;
+    std::vector<Constraint *>::const_iterator last;
+    gameWorld.GetConstraintIterators(first, last);
+    for (auto i = first; i != last; ++i) {
+        GameObject *a = (*i)->GetObjectA();
+        GameObject *b = (*i)->GetObjectB();
+        if (!a || !b || !a->GetPhysicsObject() || !b->GetPhysicsObject()) {
+            solverRows.push_back({-1, *i, -1, -1, SerialColour}); // we don't know what it touches
+            continue;
+        }
+        if (SkipRestingPair(a, b)) {
+            continue;
+        }
+        int slotA = DynamicSlot(store, a->GetPhysicsObject()->GetBodySlot());
+        int slotB = DynamicSlot(store, b->GetPhysicsObject()->GetBodySlot());
+        solverRows.push_back({-1, *i, slotA, slotB, 0});
+    }
+
+    // each body keeps a bit per colour it has already been used in
+    bodyColours.assign(store.GetCapacity(), 0);
+    for (SolverRow &r: solverRows) {
+        if (r.colour == SerialColour) {
+            continue;
+        }
+        unsigned long long used = (r.slotA >= 0 ? bodyColours[r.slotA] : 0) | (r.slotB >= 0 ? bodyColours[r.slotB] : 0);
+        if (used == ~0ull) {
+            r.colour = SerialColour;
+            continue;
+        }
+        int colour = 0;
+        while (used & (1ull << colour)) {
+            colour++;
+        }
+        r.colour = colour;
+        if (r.slotA >= 0) {
+            bodyColours[r.slotA] |= 1ull << colour;
+        }
+        if (r.slotB >= 0) {
+            bodyColours[r.slotB] |= 1ull << colour;
+        }
+    }
+
+    // a stable counting sort puts the rows into their batches, keeping their order within each
+    solverBatchStarts.assign(SerialColour + 2, 0);
+    for (const SolverRow &r: solverRows) {
+        solverBatchStarts[r.colour + 1]++;
+    }
+    for (int c = 0; c <= SerialColour; ++c) {
+        solverBatchStarts[c + 1] += solverBatchStarts[c];
+    }
+    solverBatchRows.resize(solverRows.size());
+    std::vector<int> next(solverBatchStarts.begin(), solverBatchStarts.end() - 1);
+    for (const SolverRow &r: solverRows) {
+        solverBatchRows[next[r.colour]++] = r;
+    }
+}
 
+void PhysicsSystem::SolveBatches(float dt) {
+    auto solveRow = [&](SolverRow &r) {
+        if (r.contact >= 0) {
+            SolveContact(solverContacts[r.contact]);
+        } else {
+            r.constraint->UpdateConstraint(dt);
+        }
+    };
+    for (int colour = 0; colour <= SerialColour; ++colour) {
+        int start = solverBatchStarts[colour];
+        int count = solverBatchStarts[colour + 1] - start;
+        if (count == 0) {
+            continue;
+        }
+        if (colour == SerialColour) {
+            for (int i = 0; i < count; ++i) {
+                solveRow(solverBatchRows[start + i]);
+            }
+            continue;
+        }
+        jobSystem.ParallelFor(count, [&](int begin, int end, int /*thread*/) {
+            for (int i = begin; i < end; ++i) {
+                solveRow(solverBatchRows[start + i]);
+            }
+        });
+    }
+}
 
+void PhysicsSystem::StoreContactImpulses() {
+    for (const SolverContact &c: solverContacts) {
+        c.cached->normalImpulse = c.normalImpulse;
+        c.cached->tangentImpulse[0] = c.tangentImpulse[0];
+        c.cached->tangentImpulse[1] = c.tangentImpulse[1];
+    }
+    solverContacts.clear();
 }
 
 // Collision resolution by changing the object acceleration, rather than their position and velocity
@@ -327,148 +736,584 @@ and a narrowphase collision detection method. In the broad phase, we
 split the world up using an acceleration structure, so that we can only
 compare the collisions that we absolutely need to. 
 
+Rather than building a new tree every step, we keep a dynamic AABB tree
+around between steps. Each object sits in the tree with a slightly 'fat'
+box, and is only reinserted once it moves outside of it. The pair set also
+persists, with new pairs only found by objects that were reinserted this step.
+
+Static bodies (such as the maze walls) go into a second tree instead, which
+is built up as they're added and then left alone. It's only ever queried by
+the dynamic bodies that move, so statics never look for pairs themselves,
+and never pair up with each other - apart from a new static body looking
+for the dynamic bodies already sat inside it.
+
 */
 void PhysicsSystem::BroadPhase() {
-    broadphaseCollisions.clear();
-    QuadTree<GameObject *> tree(Vector2(1024, 1024), 7, 6);
+    broadphaseStep++;
+    movedProxies.clear();
+    addedStaticProxies.clear();
 
     std::vector<GameObject *>::const_iterator first;
     std::vector<GameObject *>::const_iterator last;
     gameWorld.GetObjectIterators(first, last);
     for (auto i = first; i != last; ++i) {
         Vector3 halfSizes;
-        if (!(*i)->GetBroadphaseAABB(halfSizes)) {
+        if ((*i)->GetPhysicsObject() == nullptr || !(*i)->GetBroadphaseAABB(halfSizes)) {
             continue;
         }
-        Vector3 pos = (*i)->GetTransform().GetPosition();
-        tree.Insert(*i, pos, halfSizes);
-    }
-
-    tree.OperateOnContents(
-            [&](std::list<QuadTreeEntry<GameObject *> > &data) {
-                CollisionDetection::CollisionInfo info;
-                for (auto i = data.begin(); i != data.end(); ++i) {
-                    for (auto j = std::next(i); j != data.end(); ++j) {
-                        // is this pair of items already in the collision set -
-                        // if the same pair is in another quadtree node together etc
-                        info.a = std::min((*i).object, (*j).object);
-                        info.b = std::max((*i).object, (*j).object);
-                        broadphaseCollisions.insert(info);
-                    }
-                }
-            });
+        int worldID = (*i)->GetWorldID();
+        if (worldID >= (int) broadphaseProxies.size()) {
+            broadphaseProxies.resize(worldID + 1, DynamicAABBTree<BroadphaseObject>::NullNode);
+            broadphaseStamps.resize(worldID + 1, 0);
+            staticProxies.resize(worldID + 1, DynamicAABBTree<BroadphaseObject>::NullNode);
+        }
+        broadphaseStamps[worldID] = broadphaseStep;
+
+        TreeAABB box = TreeAABB::FromHalfSizes((*i)->GetTransform().GetPosition(), halfSizes);
+        int &proxy = broadphaseProxies[worldID];
+        int &staticProxy = staticProxies[worldID];
+
+        if (broadphaseType == BroadPhaseType::SweepAndPrune) {
+            if (proxy != SweepAndPrune<BroadphaseObject>::NullProxy && broadphaseSAP.GetObject(proxy).object != *i) {
+                RemoveBroadphaseProxy(worldID);
+            }
+            if (proxy == SweepAndPrune<BroadphaseObject>::NullProxy) {
+                proxy = broadphaseSAP.CreateProxy(box, {*i, worldID});
+            } else if (box.min != broadphaseSAP.GetAABB(proxy).min || box.max != broadphaseSAP.GetAABB(proxy).max) {
+                broadphaseSAP.MoveProxy(proxy, box);
+            }
+            continue;
+        }
+        // the world ID has been handed to a different object, or the body type has changed
+        bool isStatic = (*i)->GetPhysicsObject()->IsStatic();
+        if ((proxy != DynamicAABBTree<BroadphaseObject>::NullNode &&
+             (isStatic || broadphaseTree.GetObject(proxy).object != *i)) ||
+            (staticProxy != DynamicAABBTree<BroadphaseObject>::NullNode &&
+             (!isStatic || staticTree.GetObject(staticProxy).object != *i))) {
+            RemoveBroadphaseProxy(worldID);
+        }
+        if (isStatic) {
+            if (staticProxy == DynamicAABBTree<BroadphaseObject>::NullNode) {
+                staticProxy = staticTree.CreateProxy(box, {*i, worldID});
+                addedStaticProxies.push_back(staticProxy);
+            }
+            continue;
+        }
+        if (proxy == DynamicAABBTree<BroadphaseObject>::NullNode) {
+            proxy = broadphaseTree.CreateProxy(box, {*i, worldID});
+            movedProxies.push_back(proxy);
+        } else if (broadphaseTree.MoveProxy(proxy, box)) {
+            movedProxies.push_back(proxy);
+        }
+    }
+
+    // anything we didn't see this step has left the world (or lost its volume)
+    for (int id = 0; id < (int) broadphaseProxies.size(); ++id) {
+        bool hasProxy = broadphaseProxies[id] != DynamicAABBTree<BroadphaseObject>::NullNode ||
+                        staticProxies[id] != DynamicAABBTree<BroadphaseObject>::NullNode;
+        if (hasProxy && broadphaseStamps[id] != broadphaseStep) {
+            RemoveBroadphaseProxy(id);
+        }
+    }
+
+    if (broadphaseType == BroadPhaseType::SweepAndPrune) {
+        ApplySweepAndPruneEvents();
+        return;
+    }
+
+    auto addPair = [&](const BroadphaseObject &a, const BroadphaseObject &b) {
+        if (!ShouldCollide(a.object, b.object)) {
+            return;
+        }
+        bool isNew;
+        auto &entry = broadphaseCollisions.Insert(a.worldID, b.worldID, broadphaseStep, isNew);
+        if (isNew) {
+            entry.value.a = a.object;
+            entry.value.b = b.object;
+        }
+    };
+
+    // pairs persist between steps, so only objects that left their fat box need to look for new ones
+    for (int proxy : movedProxies) {
+        BroadphaseObject object = broadphaseTree.GetObject(proxy);
+        const TreeAABB &box = broadphaseTree.GetFatAABB(proxy);
+        broadphaseTree.Query(box, [&](int other) {
+            if (other != proxy) {
+                addPair(object, broadphaseTree.GetObject(other));
+            }
+            return true;
+        });
+        staticTree.Query(box, [&](int other) {
+            addPair(object, staticTree.GetObject(other));
+            return true;
+        });
+    }
+    for (int proxy : addedStaticProxies) {
+        BroadphaseObject object = staticTree.GetObject(proxy);
+        broadphaseTree.Query(staticTree.GetFatAABB(proxy), [&](int other) {
+            addPair(object, broadphaseTree.GetObject(other));
+            return true;
+        });
+    }
+
+    // and any pair whose fat boxes have separated can be dropped
+    broadphaseCollisions.RemoveIf([&](const PairCache<CollisionDetection::CollisionInfo>::Entry &e) {
+        return !GetBroadphaseBox(e.FirstID()).Overlaps(GetBroadphaseBox(e.SecondID()));
+    });
+}
+
+const TreeAABB &PhysicsSystem::GetBroadphaseBox(int worldID) const {
+    int proxy = staticProxies[worldID];
+    if (proxy != DynamicAABBTree<BroadphaseObject>::NullNode) {
+        return staticTree.GetFatAABB(proxy);
+    }
+    return broadphaseTree.GetFatAABB(broadphaseProxies[worldID]);
+}
+
+void PhysicsSystem::RemoveBroadphaseProxy(int worldID) {
+    int proxy = broadphaseProxies[worldID];
+    if (broadphaseType == BroadPhaseType::SweepAndPrune) {
+        broadphaseSAP.DestroyProxy(proxy); // this queues up end events for its pairs
+        broadphaseProxies[worldID] = SweepAndPrune<BroadphaseObject>::NullProxy;
+        return;
+    }
+    // the object may already be deleted, so only compare IDs here
+    broadphaseCollisions.RemoveIf([&](const PairCache<CollisionDetection::CollisionInfo>::Entry &e) {
+        return e.FirstID() == worldID || e.SecondID() == worldID;
+    });
+    if (proxy != DynamicAABBTree<BroadphaseObject>::NullNode) {
+        broadphaseTree.DestroyProxy(proxy);
+        broadphaseProxies[worldID] = DynamicAABBTree<BroadphaseObject>::NullNode;
+    }
+    if (staticProxies[worldID] != DynamicAABBTree<BroadphaseObject>::NullNode) {
+        staticTree.DestroyProxy(staticProxies[worldID]);
+        staticProxies[worldID] = DynamicAABBTree<BroadphaseObject>::NullNode;
+    }
+}
+
+/*
+The sweep and prune tells us exactly when pairs start and stop overlapping,
+so the pair set is just kept up to date from its events. A pair that has
+stopped overlapping can't still be touching, so rather than waiting for
+it to age out, we end the collision on the next update.
+*/
+void PhysicsSystem::ApplySweepAndPruneEvents() {
+    for (const auto &e: broadphaseSAP.GetEvents()) {
+        if (e.begin) {
+            if (ShouldCollide(e.a.object, e.b.object)) {
+                auto &entry = broadphaseCollisions.Insert(e.a.worldID, e.b.worldID, broadphaseStep);
+                entry.value.a = e.a.object;
+                entry.value.b = e.b.object;
+            }
+            continue;
+        }
+        broadphaseCollisions.Remove(e.a.worldID, e.b.worldID);
 
+        // only pairs that have already begun - otherwise it would begin and end in the same update
+        auto *existing = allCollisions.Find(e.a.worldID, e.b.worldID);
+        if (existing && existing->firstGeneration != collisionGeneration) {
+            existing->lastGeneration = collisionGeneration - numCollisionFrames;
+        }
+    }
+    broadphaseSAP.ClearEvents();
 }
 
 /*
 
 The broadphase will now only give us likely collisions, so we can now go through them,
 and work out if they are truly colliding, and if so, add them into the main collision list
+
+This is split into two stages. Working out the contacts only reads the objects, so
+the pairs are spread across the job system's threads, each writing into its own
+buffer. The contacts are then put back into pair order and handed to the solver
+on this thread, so the result doesn't depend on how the work was divided up.
 */
-void PhysicsSystem::NarrowPhase(float dt) {
-    for (std::set<CollisionDetection::CollisionInfo>::iterator i = broadphaseCollisions.begin();
-         i != broadphaseCollisions.end(); ++i) {
-        CollisionDetection::CollisionInfo info = *i;
-        if (CollisionDetection::ObjectIntersection(info.a, info.b, info)) {
-            info.framesLeft = numCollisionFrames;
-            ImpulseResolveCollision(*info.a, *info.b, info.point);
-            allCollisions.insert(info); // insert into our main set
+void PhysicsSystem::NarrowPhase() {
+    narrowphasePairs.clear();
+    for (auto &pair: broadphaseCollisions) {
+        // checked again here, as layers can change after a pair is made
+        if (ShouldCollide(pair.value.a, pair.value.b) && !SkipRestingPair(pair.value.a, pair.value.b)) {
+            narrowphasePairs.push_back(&pair);
         }
     }
+    // the pair cache's order depends on its history, not just on what's in it
+    if (deterministic) {
+        std::sort(narrowphasePairs.begin(), narrowphasePairs.end(),
+                  [](const PairCache<CollisionDetection::CollisionInfo>::Entry *a,
+                     const PairCache<CollisionDetection::CollisionInfo>::Entry *b) {
+                      return a->FirstID() != b->FirstID() ? a->FirstID() < b->FirstID() : a->SecondID() < b->SecondID();
+                  });
+    }
+    for (auto &buffer: narrowphaseContacts) {
+        buffer.clear();
+    }
+
+    jobSystem.ParallelFor((int) narrowphasePairs.size(), [&](int begin, int end, int thread) {
+        std::vector<NarrowPhaseContact> &buffer = narrowphaseContacts[thread];
+        for (int i = begin; i < end; ++i) {
+            CollisionDetection::CollisionInfo info;
+            CollisionDetection::CollisionInfo &pair = narrowphasePairs[i]->value;
+            info.separatingAxis = pair.separatingAxis;
+            bool hit = CollisionDetection::ObjectIntersection(pair.a, pair.b, info);
+            pair.separatingAxis = info.separatingAxis; // each pair belongs to one job, so this is safe
+            if (hit) {
+                buffer.push_back({i, info});
+            }
+        }
+    });
+
+    narrowphaseMerged.clear();
+    for (const auto &buffer: narrowphaseContacts) {
+        narrowphaseMerged.insert(narrowphaseMerged.end(), buffer.begin(), buffer.end());
+    }
+    std::sort(narrowphaseMerged.begin(), narrowphaseMerged.end(),
+              [](const NarrowPhaseContact &a, const NarrowPhaseContact &b) {
+                  return a.pairIndex < b.pairIndex;
+              });
+
+    for (NarrowPhaseContact &c: narrowphaseMerged) {
+        const auto *pair = narrowphasePairs[c.pairIndex];
+        // insert into our main cache, or refresh it if it's already there
+        UpdateManifold(pair->FirstID(), pair->SecondID(), c.info);
+    }
 }
 
 /*
-Integration of acceleration and velocity is split up, so that we can
-move objects multiple times during the course of a PhysicsUpdate,
-without worrying about repeated forces accumulating etc. 
+A PhysicsObject keeps its state in a store of its own until it's found in
+the world, then it's moved into ours, where the solver can get at it.
+*/
+void PhysicsSystem::AttachBodies() {
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
 
-This function will update both linear and angular acceleration,
-based on any forces that have been accumulated in the objects during
-the course of the previous game frame.
+    for (auto i = first; i != last; ++i) {
+        PhysicsObject *object = (*i)->GetPhysicsObject();
+        if (object && object->GetBodyStore() != &bodyStore) {
+            object->SetBodyStore(&bodyStore);
+        }
+    }
+}
+
+/*
+Only the bodies of objects that are actually in the world get simulated,
+so each update we mark which slots of the RigidBodyStore are in use.
+Static and kinematic bodies are never integrated, so they're left out.
 */
-void PhysicsSystem::IntegrateAccel(float dt) {
+void PhysicsSystem::UpdateActiveBodies() {
+    RigidBodyStore &store = bodyStore;
+    store.ClearActive();
+
     std::vector<GameObject *>::const_iterator first;
     std::vector<GameObject *>::const_iterator last;
     gameWorld.GetObjectIterators(first, last);
 
     for (auto i = first; i != last; ++i) {
         PhysicsObject *object = (*i)->GetPhysicsObject();
-        if (object == nullptr) {
-            continue; // No physics object for this GameObject !
+        if (object && object->IsDynamic() && !object->IsAsleep()) {
+            store.SetActive(object->GetBodySlot());
         }
-        float inverseMass = object->GetInverseMass();
+    }
+}
 
-        Vector3 linearVel = object->GetLinearVelocity();
-        Vector3 force = object->GetForce();
-        Vector3 accel = force * inverseMass;
+/*
+Kinematic bodies are moved by the game, so the solver is told how fast
+they've been moving, to push anything they run into along with them.
+*/
+void PhysicsSystem::UpdateKinematicBodies(float dt) {
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
 
-        if (applyGravity && inverseMass > 0) {
-            accel += gravity; // don ’t move infinitely heavy things
+    for (auto i = first; i != last; ++i) {
+        PhysicsObject *object = (*i)->GetPhysicsObject();
+        if (object && object->IsKinematic()) {
+            object->UpdateKinematicVelocity(dt);
         }
+    }
+}
 
-        linearVel += accel * dt; // integrate accel !
-        object->SetLinearVelocity(linearVel);
+/*
+Bodies that touch each other, or are linked by a constraint, form an island.
+An island can only go to sleep as a whole, once every body in it has been
+(nearly) still for a while - otherwise a box stack could fall asleep from
+the bottom up, with the top still sliding about. Static bodies (with an
+inverse mass of 0) don't join islands, or everything on the floor would be
+one big island.
+
+Likewise, if anything in a sleeping island has been woken up (by a force,
+or by being hit), the rest of the island is woken up with it.
+*/
+int PhysicsSystem::FindIsland(int slot) {
+    while (islandParent[slot] != slot) {
+        islandParent[slot] = islandParent[islandParent[slot]];
+        slot = islandParent[slot];
+    }
+    return slot;
+}
+
+void PhysicsSystem::UpdateIslands(float dt) {
+    if (!useSleeping) {
+        return;
+    }
+    RigidBodyStore &store = bodyStore;
+    islandParent.assign(store.GetCapacity(), -1);
+    islandTimer.assign(store.GetCapacity(), timeToSleep);
 
+    std::vector<GameObject *>::const_iterator first;
+    std::vector<GameObject *>::const_iterator last;
+    gameWorld.GetObjectIterators(first, last);
 
-        // Angular stuff
-        Vector3 torque = object->GetTorque();
-        Vector3 angVel = object->GetAngularVelocity();
+    for (auto i = first; i != last; ++i) {
+        PhysicsObject *object = (*i)->GetPhysicsObject();
+        if (object && object->GetInverseMass() > 0.0f) {
+            islandParent[object->GetBodySlot()] = object->GetBodySlot();
+        }
+    }
+
+    auto link = [&](GameObject *a, GameObject *b) {
+        if (!a || !b || !a->GetPhysicsObject() || !b->GetPhysicsObject()) {
+            return;
+        }
+        int slotA = a->GetPhysicsObject()->GetBodySlot();
+        int slotB = b->GetPhysicsObject()->GetBodySlot();
+        if (islandParent[slotA] < 0 || islandParent[slotB] < 0) {
+            return;
+        }
+        islandParent[FindIsland(slotA)] = FindIsland(slotB);
+    };
+    for (const auto &pair: allCollisions) {
+        if (!pair.value.a->GetPhysicsObject()->IsTrigger() && !pair.value.b->GetPhysicsObject()->IsTrigger()) {
+            link(pair.value.a, pair.value.b);
+        }
+    }
+    std::vector<Constraint *>::const_iterator firstC;
+    std::vector<Constraint *>::const_iterator lastC;
+    gameWorld.GetConstraintIterators(firstC, lastC);
+    for (auto i = firstC; i != lastC; ++i) {
+        link((*i)->GetObjectA(), (*i)->GetObjectB());
+    }
 
-        object->UpdateInertiaTensor(); // update tensor vs orientation
+    // each island keeps the shortest time any of its bodies has been still for
+    for (int slot = 0; slot < (int) islandParent.size(); ++slot) {
+        if (islandParent[slot] < 0 || store.IsAsleep(slot)) {
+            continue;
+        }
+        float timer = store.UpdateSleepTimer(slot, dt, sleepLinearThreshold, sleepAngularThreshold);
+        int root = FindIsland(slot);
+        islandTimer[root] = std::min(islandTimer[root], timer);
+    }
 
-        Vector3 angAccel = object->GetInertiaTensor() * torque;
+    for (int slot = 0; slot < (int) islandParent.size(); ++slot) {
+        if (islandParent[slot] < 0) {
+            continue;
+        }
+        bool islandResting = islandTimer[FindIsland(slot)] >= timeToSleep;
+        if (islandResting && !store.IsAsleep(slot)) {
+            store.Sleep(slot);
+        } else if (!islandResting && store.IsAsleep(slot)) {
+            store.Wake(slot);
+        }
+    }
+}
 
-        angVel += angAccel * dt; // integrate angular accel !
-        object->SetAngularVelocity(angVel);
+/*
+Filters pairs before they get anywhere near the narrowphase. Objects on layers
+that don't collide are never paired up, and neither are two bodies that can't
+be pushed (static, kinematic or massless), as nothing could happen between them.
+*/
+bool PhysicsSystem::ShouldCollide(GameObject *a, GameObject *b) const {
+    if (!(layerCollisions[a->GetLayer()] & b->GetLayerMask())) {
+        return false;
+    }
+    PhysicsObject *physA = a->GetPhysicsObject();
+    PhysicsObject *physB = b->GetPhysicsObject();
+    return (physA->IsDynamic() && physA->GetInverseMass() > 0.0f) ||
+           (physB->IsDynamic() && physB->GetInverseMass() > 0.0f);
+}
 
+/*
+Pairs where neither body can move don't need testing. A pair that involves a
+sleeping body is skipped, with its existing collision (if any) kept alive, so
+that objects don't get an OnCollisionEnd just for falling asleep. A kinematic
+body that's on the move wakes up anything it might run into, though, as the
+islands never see it.
+*/
+bool PhysicsSystem::SkipRestingPair(GameObject *a, GameObject *b) {
+    PhysicsObject *physA = a->GetPhysicsObject();
+    PhysicsObject *physB = b->GetPhysicsObject();
+
+    bool asleepA = physA->IsAsleep();
+    bool asleepB = physB->IsAsleep();
+    if (!asleepA && !asleepB) {
+        return false;
+    }
+    if ((!asleepA && physA->GetInverseMass() > 0.0f) || (!asleepB && physB->GetInverseMass() > 0.0f)) {
+        return false;
     }
+    auto moving = [](PhysicsObject *phys) {
+        return phys->IsKinematic() &&
+               (phys->GetLinearVelocity().LengthSquared() > 0.0f || phys->GetAngularVelocity().LengthSquared() > 0.0f);
+    };
+    if (moving(physA) || moving(physB)) {
+        physA->Wake();
+        physB->Wake();
+        return false;
+    }
+    if (auto *existing = allCollisions.Find(a->GetWorldID(), b->GetWorldID())) {
+        existing->lastGeneration = collisionGeneration;
+    }
+    return true;
+}
 
+/*
+Integration of acceleration and velocity is split up, so that we can
+move objects multiple times during the course of a PhysicsUpdate,
+without worrying about repeated forces accumulating etc. 
+
+This function will update both linear and angular acceleration,
+based on any forces that have been accumulated in the objects during
+the course of the previous game frame.
+
+The actual maths is done by the RigidBodyStore, which keeps every body's
+state in flat arrays, so it can work through them 4 at a time. It needs
+the current orientations to update the inertia tensors first, though.
+*/
+void PhysicsSystem::IntegrateAccel(float dt) {
+    RigidBodyStore &store = bodyStore;
+    store.GatherTransforms();
+    store.IntegrateAccel(dt, gravity, applyGravity);
 }
 
 /*
-This function integrates linear and angular velocity into
-position and orientation. It may be called multiple times
-throughout a physics update, to slowly move the objects through
-the world, looking for collisions.
+Integration just moves objects by velocity * dt, so anything moving further
+than its own size in a step can end up on the far side of a thin wall, with
+the narrowphase never seeing them overlap. Bodies marked for continuous
+collision are swept along their path first, and if they'd hit something
+on the way, they're only moved as far as the impact this step (plus a
+little, so the narrowphase picks the contact up next step).
+
+Only the part of the velocity heading into the surface is held back, and
+only for the move itself - the solver needs the real speed to bounce it.
 */
-void PhysicsSystem::IntegrateVelocity(float dt) {
+void PhysicsSystem::SweepFastBodies(float dt) {
+    const float contactDepth = 0.02f; // how far into the surface to move, so a contact is made
+
+    RigidBodyStore &store = bodyStore;
+    sweptBodies.clear();
+
     std::vector<GameObject *>::const_iterator first;
     std::vector<GameObject *>::const_iterator last;
     gameWorld.GetObjectIterators(first, last);
-    float frameLinearDamping = 1.0f - (0.4f * dt);
 
     for (auto i = first; i != last; ++i) {
-        PhysicsObject *object = (*i)->GetPhysicsObject();
-        if (object == nullptr) {
+        PhysicsObject *phys = (*i)->GetPhysicsObject();
+        Vector3 halfSizes;
+        if (!phys || !phys->UsesContinuousCollision() || phys->IsAsleep() || phys->GetInverseMass() == 0.0f || phys->IsTrigger() ||
+            !(*i)->GetBroadphaseAABB(halfSizes)) {
             continue;
         }
-        Transform &transform = (*i)->GetTransform();
-        // Position Stuff
-        Vector3 position = transform.GetPosition();
-        Vector3 linearVel = object->GetLinearVelocity();
-        position += linearVel * dt;
-        transform.SetPosition(position);
-        // Linear Damping
-        linearVel = linearVel * frameLinearDamping;
-        object->SetLinearVelocity(linearVel);
-
+        Vector3 velocity = phys->GetLinearVelocity();
+        float minExtent = std::min(halfSizes.x, std::min(halfSizes.y, halfSizes.z));
+        if ((velocity * dt).LengthSquared() < minExtent * minExtent) {
+            continue; // too slow to get past anything in one step
+        }
+        const CollisionVolume *volume = (*i)->GetBoundingVolume();
+        bool isSphere = volume->type == VolumeType::Sphere;
+        Vector3 start = (*i)->GetTransform().GetPosition();
+
+        float earliest = 1.0f;
+        Vector3 earliestNormal;
+        Vector3 earliestMotion;
+
+        auto sweepAgainst = [&](GameObject *other) {
+            Vector3 otherHalfSizes;
+            if (other == *i || !other->GetBroadphaseAABB(otherHalfSizes)) {
+                return;
+            }
+            PhysicsObject *otherPhys = other->GetPhysicsObject();
+            if (!otherPhys || otherPhys->IsTrigger() || !ShouldCollide(*i, other)) {
+                return; // nothing would stop it there anyway
+            }
+            Vector3 otherVelocity = otherPhys->GetLinearVelocity();
+            Vector3 motion = (velocity - otherVelocity) * dt;
+            Vector3 otherPos = other->GetTransform().GetPosition();
+
+            float toi;
+            Vector3 normal;
+            bool hit;
+            if (isSphere && other->GetBoundingVolume()->type == VolumeType::Sphere) {
+                hit = CollisionDetection::SweptSphereIntersection(start, ((SphereVolume &) *volume).GetRadius(), motion,
+                    otherPos, ((SphereVolume &) *other->GetBoundingVolume()).GetRadius(), toi, normal);
+            } else {
+                hit = CollisionDetection::SweptAABBIntersection(start, halfSizes, motion, otherPos, otherHalfSizes, toi,
+                    normal);
+            }
+            if (hit && toi < earliest) {
+                earliest = toi;
+                earliestNormal = normal;
+                earliestMotion = motion;
+            }
+        };
+
+        // only things within the box around the whole path can be hit
+        TreeAABB path = TreeAABB::Merge(TreeAABB::FromHalfSizes(start, halfSizes),
+                                        TreeAABB::FromHalfSizes(start + velocity * dt, halfSizes));
+        if (useBroadPhase && broadphaseType == BroadPhaseType::DynamicTree) {
+            broadphaseTree.Query(path, [&](int proxy) {
+                sweepAgainst(broadphaseTree.GetObject(proxy).object);
+                return true;
+            });
+            staticTree.Query(path, [&](int proxy) {
+                sweepAgainst(staticTree.GetObject(proxy).object);
+                return true;
+            });
+        } else {
+            for (auto j = first; j != last; ++j) {
+                Vector3 otherHalfSizes;
+                if ((*j)->GetBroadphaseAABB(otherHalfSizes) &&
+                    path.Overlaps(TreeAABB::FromHalfSizes((*j)->GetTransform().GetPosition(), otherHalfSizes))) {
+                    sweepAgainst(*j);
+                }
+            }
+        }
+        if (earliest >= 1.0f) {
+            continue;
+        }
+        float approach = -Vector3::Dot(earliestMotion, earliestNormal);
+        float advance = std::min(1.0f, earliest + contactDepth / std::max(approach, 0.0001f));
+        Vector3 normalVelocity = earliestNormal * Vector3::Dot(velocity, earliestNormal);
 
-        // Orientation Stuff
-        Quaternion orientation = transform.GetOrientation();
-        Vector3 angVel = object->GetAngularVelocity();
+        sweptBodies.push_back({phys->GetBodySlot(), velocity});
+        store.SetLinearVelocity(phys->GetBodySlot(), velocity - normalVelocity * (1.0f - advance));
+    }
+}
 
-        orientation = orientation + (Quaternion(angVel * dt * 0.5f, 0.0f) * orientation);
-        orientation.Normalise();
+/*
+This function integrates linear and angular velocity into
+position and orientation. It may be called multiple times
+throughout a physics update, to slowly move the objects through
+the world, looking for collisions.
 
-        transform.SetOrientation(orientation);
+Collision resolution and constraints move objects by their Transform,
+so positions are gathered in again before integrating, and written back
+out afterwards.
+*/
+void PhysicsSystem::IntegrateVelocity(float dt) {
+    RigidBodyStore &store = bodyStore;
+    float frameLinearDamping = 1.0f - (0.4f * dt);
+    float frameAngularDamping = 1.0f - (0.4f * dt);
 
-        // Damp the angular velocity too
-        float frameAngularDamping = 1.0f - (0.4f * dt);
-        angVel = angVel * frameAngularDamping;
-        object->SetAngularVelocity(angVel);
+    store.GatherTransforms();
+    store.IntegrateVelocity(dt, frameLinearDamping, frameAngularDamping);
 
+    // swept bodies only had their velocity held back for the move itself
+    for (const SweptBody &b: sweptBodies) {
+        store.SetLinearVelocity(b.slot, b.velocity * frameLinearDamping);
     }
+    sweptBodies.clear();
 
+    store.ScatterTransforms();
 }
 
 /*
@@ -477,27 +1322,5 @@ clear out any accumulated forces, ready to receive new
 ones in the next 'game' frame.
 */
 void PhysicsSystem::ClearForces() {
-    gameWorld.OperateOnContents(
-            [](GameObject *o) {
-                o->GetPhysicsObject()->ClearForces();
-            }
-    );
+    bodyStore.ClearForces();
 }
-
-
-/*
-
-As part of the final physics tutorials, we add in the ability
-to constrain objects based on some extra calculation, allowing
-us to model springs and ropes etc. 
-
-*/
-void PhysicsSystem::UpdateConstraints(float dt) {
-    std::vector<Constraint *>::const_iterator first;
-    std::vector<Constraint *>::const_iterator last;
-    gameWorld.GetConstraintIterators(first, last);
-
-    for (auto i = first; i != last; ++i) {
-        (*i)->UpdateConstraint(dt);
-    }
-}
\ No newline at end of file
@@ -1,8 +1,54 @@
 #pragma once
 #include "GameWorld.h"
+#include "DynamicAABBTree.h"
+#include "SweepAndPrune.h"
+#include "PairCache.h"
+#include "JobSystem.h"
+#include "RigidBodyStore.h"
 
 namespace NCL {
 	namespace CSC8503 {
+		enum class BroadPhaseType {
+			DynamicTree,
+			SweepAndPrune
+		};
+
+		//What the broadphase structures store per proxy - the ID lets pairs be keyed without touching the object
+		struct BroadphaseObject {
+			GameObject* object;
+			int			worldID;
+		};
+
+		/*
+		Everything the PhysicsSystem needs to carry on from a given step: the
+		body state (and where kinematic bodies were last seen), the contact
+		manifolds (which the solver warm starts from) and the time accumulator. Snapshots are only valid for the world they
+		were taken from, and can be reused for as many captures as needed.
+		*/
+		class PhysicsSnapshot {
+		public:
+			int GetStepCount() const {
+				return stepCounter;
+			}
+
+		protected:
+			friend class PhysicsSystem;
+
+			//Where each kinematic body was last seen, so its velocity comes out the same on a rerun
+			struct KinematicPose {
+				int			worldID;
+				Vector3		position;
+				Quaternion	orientation;
+			};
+
+			RigidBodyState								bodies;
+			std::vector<KinematicPose>					kinematicPoses;
+			PairCache<CollisionDetection::CollisionInfo>	collisions;
+			float	dTOffset			= 0.0f;
+			int		stepCounter			= 0;
+			int		collisionGeneration	= 0;
+		};
+
 		class PhysicsSystem	{
 		public:
 			PhysicsSystem(GameWorld& g);
@@ -12,6 +58,52 @@ namespace NCL {
 
 			void Update(float dt);
 
+			//Runs exactly stepCount fixed steps, however much time has passed - for lockstep and replays
+			void Simulate(int stepCount);
+
+			/*
+			A deterministic system steps the same way on every run given the
+			same inputs. Steps aren't dropped to keep the framerate up (any past
+			maxSubsteps are put off until later frames instead, up to a few
+			frames' worth, so a machine that can't keep up still can't spiral
+			down to a standstill), and pairs are handled in world ID order,
+			rather than whatever order the broadphase happened to find them in.
+			Seed the world's shuffles with GameWorld::SetRandomSeed as well, if
+			either of them is in use.
+			*/
+			void SetDeterministic(bool state) {
+				deterministic = state;
+			}
+
+			bool IsDeterministic() const {
+				return deterministic;
+			}
+
+			//How many fixed steps have been run in total
+			int GetStepCount() const {
+				return stepCounter;
+			}
+
+			//A hash of every body's position, orientation and velocities, for checking two runs still agree
+			unsigned long long GetStateHash();
+
+			void CaptureSnapshot(PhysicsSnapshot& snapshot);
+
+			/*
+			Puts the simulation back how it was when the snapshot was taken.
+			Objects added to the world since then keep their current state,
+			and contacts with objects that have since been removed are dropped.
+			*/
+			void RestoreSnapshot(const PhysicsSnapshot& snapshot);
+
+			/*
+			Restores the snapshot and runs stepCount steps on from it, calling
+			beforeStep (if given) with the step's index before each one, so that
+			inputs can be replayed at the right time. Collision events fire
+			again for the steps being rerun.
+			*/
+			void Resimulate(const PhysicsSnapshot& snapshot, int stepCount, const std::function<void(int)>& beforeStep = nullptr);
+
 			void UseGravity(bool state) {
 				applyGravity = state;
 			}
@@ -20,37 +112,211 @@ namespace NCL {
 				globalDamping = d;
 			}
 
+			void UseSleeping(bool state) {
+				useSleeping = state;
+			}
+
+			//Shared by the contact solver and the constraints
+			void SetSolverIterations(int count) {
+				solverIterations = std::max(1, count);
+			}
+
+			int GetSolverIterations() const {
+				return solverIterations;
+			}
+
 			void SetGravity(const Vector3& g);
+
+			void SetFixedDeltaTime(float dt) {
+				fixedDeltaTime = std::max(0.0001f, dt);
+			}
+
+			float GetFixedDeltaTime() const {
+				return fixedDeltaTime;
+			}
+
+			//The most steps a single frame may take, before time is dropped
+			void SetMaxSubsteps(int count) {
+				maxSubsteps = std::max(1, count);
+			}
+
+			int GetMaxSubsteps() const {
+				return maxSubsteps;
+			}
+
+			//How many seconds of each frame physics is allowed to spend stepping
+			void SetStepBudget(float seconds) {
+				stepBudget = seconds;
+			}
+
+			float GetAverageStepCost() const {
+				return averageStepCost;
+			}
+
+			float GetInterpolationAlpha() const {
+				return interpolationAlpha;
+			}
+
+			/*
+			Whether objects on the two layers (see GameObject::SetLayer) can
+			collide at all. Every layer collides with every other to start with.
+			*/
+			void SetLayerCollision(int layerA, int layerB, bool state);
+
+			//Sets all of the layers that a layer collides with at once
+			void SetLayerCollisionMask(int layer, unsigned int mask);
+
+			bool GetLayerCollision(int layerA, int layerB) const {
+				return (layerCollisions[layerA] >> layerB) & 1;
+			}
+
+			void SetBroadPhaseType(BroadPhaseType type);
+
+			BroadPhaseType GetBroadPhaseType() const {
+				return broadphaseType;
+			}
 		protected:
+			struct SolverContact;
+
 			void BasicCollisionDetection();
 			void BroadPhase();
-			void NarrowPhase(float dt);
+			void NarrowPhase();
 
 			void ClearForces();
+			void AttachBodies();
+			void UpdateActiveBodies();
+			void UpdateKinematicBodies(float dt);
+			void UpdateIslands(float dt);
+
+			bool ShouldCollide(GameObject* a, GameObject* b) const;
+			bool SkipRestingPair(GameObject* a, GameObject* b);
+			int  FindIsland(int slot);
 
 			void IntegrateAccel(float dt);
+			void SweepFastBodies(float dt);
 			void IntegrateVelocity(float dt);
 
-			void UpdateConstraints(float dt);
 
 			void UpdateCollisionList();
 			void UpdateObjectAABBs();
 
-			void ImpulseResolveCollision(GameObject& a , GameObject&b, CollisionDetection::ContactPoint& p) const;
+			void RemoveBroadphaseProxy(int worldID);
+			const TreeAABB& GetBroadphaseBox(int worldID) const;
+			void ApplySweepAndPruneEvents();
+
+			void UpdateManifold(int idA, int idB, CollisionDetection::CollisionInfo& info);
+			void PrepareContacts(float dt);
+			void SolveContact(SolverContact& c);
+			void BuildSolverBatches();
+			void SolveBatches(float dt);
+			void StoreContactImpulses();
             void ResolveSpringCollision(GameObject& a, GameObject&b, CollisionDetection::ContactPoint& p, float dt) const;
 
 			GameWorld& gameWorld;
 
+			//Every body in the world, moved in here by AttachBodies, and handed back to its owner when the system goes
+			RigidBodyStore bodyStore;
+
 			bool	applyGravity;
 			Vector3 gravity;
 			float	dTOffset;
+			float	fixedDeltaTime;
+			int		maxSubsteps;
+			float	stepBudget;
+			float	averageStepCost;
+			float	interpolationAlpha;
 			float	globalDamping;
+			bool	deterministic;
+			int		stepCounter;
+			std::vector<GameObject*>	hashOrder;
+			std::vector<GameObject*>	objectsByID;
+
+			//A bit per layer that each layer collides with, kept symmetric
+			unsigned int	layerCollisions[32];
 
-			std::set<CollisionDetection::CollisionInfo> allCollisions;
-			std::set<CollisionDetection::CollisionInfo> broadphaseCollisions;
-			std::vector<CollisionDetection::CollisionInfo> broadphaseCollisionsVec;
+			//A whole island falls asleep once all of its bodies have been slow for timeToSleep seconds
+			bool	useSleeping;
+			float	sleepLinearThreshold;
+			float	sleepAngularThreshold;
+			float	timeToSleep;
+			std::vector<int>	islandParent;
+			std::vector<float>	islandTimer;
+
+			//Both keyed by the world IDs of the pair
+			PairCache<CollisionDetection::CollisionInfo> allCollisions;
+			PairCache<CollisionDetection::CollisionInfo> broadphaseCollisions;
 			bool useBroadPhase		= true;
 			int numCollisionFrames	= 5;
+			int collisionGeneration	= 0;
+
+			/*
+			One per contact point being solved this step. The impulses are
+			accumulated here over the iterations, then written back into the
+			manifold in allCollisions for the next step to start from.
+			*/
+			struct SolverContact {
+				int			slotA;
+				int			slotB;
+				Vector3		relativeA;
+				Vector3		relativeB;
+				Vector3		normal;
+				Vector3		tangents[2];
+				float		normalMass;
+				float		tangentMass[2];
+				float		bias;
+				float		friction;
+				float		normalImpulse;
+				float		tangentImpulse[2];
+				CollisionDetection::ContactPoint* cached;
+			};
+			int								solverIterations;
+			std::vector<std::pair<int, int>>	solverPairs;
+			std::vector<SolverContact>		solverContacts;
+
+			//A contact or constraint, coloured so that no two rows in a batch share a moving body
+			struct SolverRow {
+				int			contact;	//index into solverContacts, or -1 for a constraint
+				Constraint*	constraint;
+				int			slotA;		//-1 for static bodies, which are never written to
+				int			slotB;
+				int			colour;
+			};
+			static const int				SerialColour = 64;
+			std::vector<SolverRow>			solverRows;
+			std::vector<SolverRow>			solverBatchRows;
+			std::vector<int>				solverBatchStarts;
+			std::vector<unsigned long long>	bodyColours;
+
+			//Persistent broadphase - proxies are indexed by GameObject world ID
+			BroadPhaseType					broadphaseType;
+			DynamicAABBTree<BroadphaseObject>	broadphaseTree;
+			SweepAndPrune<BroadphaseObject>	broadphaseSAP;
+			std::vector<int>				broadphaseProxies;
+			std::vector<int>				broadphaseStamps;
+			std::vector<int>				movedProxies;
+
+			//Static bodies get a tree of their own, which only ever changes when one is added or removed
+			DynamicAABBTree<BroadphaseObject>	staticTree;
+			std::vector<int>				staticProxies;
+			std::vector<int>				addedStaticProxies;
+			int								broadphaseStep;
+
+			//Bodies whose velocity was held back by a sweep, to be put back once they've moved
+			struct SweptBody {
+				int		slot;
+				Vector3	velocity;
+			};
+			std::vector<SweptBody>			sweptBodies;
+
+			//Contacts are generated in parallel, one buffer per thread, then resolved in pair order
+			struct NarrowPhaseContact {
+				int									pairIndex;
+				CollisionDetection::CollisionInfo	info;
+			};
+			JobSystem										jobSystem;
+			std::vector<PairCache<CollisionDetection::CollisionInfo>::Entry*> narrowphasePairs;
+			std::vector<std::vector<NarrowPhaseContact>>	narrowphaseContacts;
+			std::vector<NarrowPhaseContact>					narrowphaseMerged;
 		};
 	}
 }
@@ -0,0 +1,156 @@
+#include "RayPacket.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RAYPACKET_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace NCL;
+using namespace NCL::CSC8503;
+
+RayPacket::RayPacket(const Ray* rays, int count) {
+	activeMask = 0;
+	for (int i = 0; i < Width; ++i) {
+		Vector3 origin;
+		Vector3 dir(1, 0, 0);
+		float	distance = -1.0f; //inactive lanes can't reach anything
+		if (i < count) {
+			origin		= rays[i].GetPosition();
+			dir			= rays[i].GetDirection();
+			distance	= FLT_MAX;
+			activeMask |= 1 << i;
+		}
+		originX[i]	= origin.x;
+		originY[i]	= origin.y;
+		originZ[i]	= origin.z;
+		dirX[i]		= dir.x;
+		dirY[i]		= dir.y;
+		dirZ[i]		= dir.z;
+		invDirX[i]	= 1.0f / dir.x;
+		invDirY[i]	= 1.0f / dir.y;
+		invDirZ[i]	= 1.0f / dir.z;
+		maxDistance[i] = distance;
+	}
+}
+
+#ifdef RAYPACKET_USE_SSE
+namespace {
+	//Narrows [tNear, tFar] down to where the rays are between the two planes on one axis
+	inline void Slab(__m128 origin, __m128 invDir, float slabMin, float slabMax, __m128& tNear, __m128& tFar) {
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(slabMin), origin), invDir);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(slabMax), origin), invDir);
+		tNear	= _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar	= _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+	}
+}
+
+int RayPacket::OverlapsBox(const Vector3& boxMin, const Vector3& boxMax) const {
+	__m128 tNear	= _mm_setzero_ps();
+	__m128 tFar		= _mm_load_ps(maxDistance);
+
+	Slab(_mm_load_ps(originX), _mm_load_ps(invDirX), boxMin.x, boxMax.x, tNear, tFar);
+	Slab(_mm_load_ps(originY), _mm_load_ps(invDirY), boxMin.y, boxMax.y, tNear, tFar);
+	Slab(_mm_load_ps(originZ), _mm_load_ps(invDirZ), boxMin.z, boxMax.z, tNear, tFar);
+
+	return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & activeMask;
+}
+
+int RayPacket::IntersectBox(const Vector3& boxPos, const Vector3& halfSize, float distances[Width]) const {
+	Vector3 boxMin = boxPos - halfSize;
+	Vector3 boxMax = boxPos + halfSize;
+
+	__m128 tNear	= _mm_set1_ps(-FLT_MAX);
+	__m128 tFar		= _mm_set1_ps(FLT_MAX);
+
+	Slab(_mm_load_ps(originX), _mm_load_ps(invDirX), boxMin.x, boxMax.x, tNear, tFar);
+	Slab(_mm_load_ps(originY), _mm_load_ps(invDirY), boxMin.y, boxMax.y, tNear, tFar);
+	Slab(_mm_load_ps(originZ), _mm_load_ps(invDirZ), boxMin.z, boxMax.z, tNear, tFar);
+
+	//no backwards rays, same as the single ray version
+	__m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmpge_ps(tNear, _mm_setzero_ps()));
+	_mm_storeu_ps(distances, tNear);
+	return _mm_movemask_ps(hit) & activeMask;
+}
+
+int RayPacket::IntersectSphere(const Vector3& centre, float radius, float distances[Width]) const {
+	__m128 toCentreX = _mm_sub_ps(_mm_set1_ps(centre.x), _mm_load_ps(originX));
+	__m128 toCentreY = _mm_sub_ps(_mm_set1_ps(centre.y), _mm_load_ps(originY));
+	__m128 toCentreZ = _mm_sub_ps(_mm_set1_ps(centre.z), _mm_load_ps(originZ));
+
+	__m128 projection = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(toCentreX, _mm_load_ps(dirX)),
+		_mm_mul_ps(toCentreY, _mm_load_ps(dirY))),
+		_mm_mul_ps(toCentreZ, _mm_load_ps(dirZ)));
+
+	//squared distance from the sphere centre to the closest point on each ray
+	__m128 lengthSq = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(toCentreX, toCentreX),
+		_mm_mul_ps(toCentreY, toCentreY)),
+		_mm_mul_ps(toCentreZ, toCentreZ));
+	__m128 closestSq = _mm_sub_ps(lengthSq, _mm_mul_ps(projection, projection));
+
+	__m128 radiusSq = _mm_set1_ps(radius * radius);
+	__m128 hit = _mm_and_ps(_mm_cmpge_ps(projection, _mm_setzero_ps()), _mm_cmple_ps(closestSq, radiusSq));
+
+	__m128 offset = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(radiusSq, closestSq), _mm_setzero_ps()));
+	_mm_storeu_ps(distances, _mm_sub_ps(projection, offset));
+	return _mm_movemask_ps(hit) & activeMask;
+}
+#else
+int RayPacket::OverlapsBox(const Vector3& boxMin, const Vector3& boxMax) const {
+	int mask = 0;
+	for (int i = 0; i < Width; ++i) {
+		float tNear = 0.0f;
+		float tFar	= maxDistance[i];
+		const float origin[3]	= { originX[i], originY[i], originZ[i] };
+		const float invDir[3]	= { invDirX[i], invDirY[i], invDirZ[i] };
+		for (int axis = 0; axis < 3; ++axis) {
+			float t0 = (boxMin[axis] - origin[axis]) * invDir[axis];
+			float t1 = (boxMax[axis] - origin[axis]) * invDir[axis];
+			tNear	= std::max(tNear, std::min(t0, t1));
+			tFar	= std::min(tFar, std::max(t0, t1));
+		}
+		if (tNear <= tFar) {
+			mask |= 1 << i;
+		}
+	}
+	return mask & activeMask;
+}
+
+int RayPacket::IntersectBox(const Vector3& boxPos, const Vector3& halfSize, float distances[Width]) const {
+	Vector3 boxMin = boxPos - halfSize;
+	Vector3 boxMax = boxPos + halfSize;
+	int mask = 0;
+	for (int i = 0; i < Width; ++i) {
+		float tNear = -FLT_MAX;
+		float tFar	= FLT_MAX;
+		const float origin[3]	= { originX[i], originY[i], originZ[i] };
+		const float invDir[3]	= { invDirX[i], invDirY[i], invDirZ[i] };
+		for (int axis = 0; axis < 3; ++axis) {
+			float t0 = (boxMin[axis] - origin[axis]) * invDir[axis];
+			float t1 = (boxMax[axis] - origin[axis]) * invDir[axis];
+			tNear	= std::max(tNear, std::min(t0, t1));
+			tFar	= std::min(tFar, std::max(t0, t1));
+		}
+		distances[i] = tNear;
+		if (tNear <= tFar && tNear >= 0.0f) {
+			mask |= 1 << i;
+		}
+	}
+	return mask & activeMask;
+}
+
+int RayPacket::IntersectSphere(const Vector3& centre, float radius, float distances[Width]) const {
+	int mask = 0;
+	for (int i = 0; i < Width; ++i) {
+		Vector3 toCentre	= centre - GetOrigin(i);
+		float projection	= Vector3::Dot(toCentre, GetDirection(i));
+		float closestSq		= Vector3::Dot(toCentre, toCentre) - projection * projection;
+		distances[i] = projection - sqrt(std::max(radius * radius - closestSq, 0.0f));
+		if (projection >= 0.0f && closestSq <= radius * radius) {
+			mask |= 1 << i;
+		}
+	}
+	return mask & activeMask;
+}
+#endif
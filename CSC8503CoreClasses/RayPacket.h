@@ -0,0 +1,69 @@
+#pragma once
+#include "Ray.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace CSC8503 {
+		/*
+		Four rays stored side by side (one float array per component), so
+		that a box or sphere can be tested against all of them at once with
+		SSE. Each ray has its own maximum distance, which is shrunk as hits
+		are found, so boxes beyond every ray's closest hit can be skipped.
+
+		Packets work best when the rays are coherent - starting near each
+		other and heading the same way - as then they all tend to want the
+		same parts of the tree.
+		*/
+		class RayPacket {
+		public:
+			static const int Width = 4;
+
+			//Any lanes past count are left inactive, and never hit anything
+			RayPacket(const Ray* rays, int count);
+			~RayPacket() {}
+
+			int GetActiveMask() const {
+				return activeMask;
+			}
+
+			Vector3 GetOrigin(int lane) const {
+				return Vector3(originX[lane], originY[lane], originZ[lane]);
+			}
+
+			Vector3 GetDirection(int lane) const {
+				return Vector3(dirX[lane], dirY[lane], dirZ[lane]);
+			}
+
+			float GetMaxDistance(int lane) const {
+				return maxDistance[lane];
+			}
+
+			void SetMaxDistance(int lane, float distance) {
+				maxDistance[lane] = distance;
+			}
+
+			//Returns a bit per ray whose segment from its origin to its max distance touches the box
+			int OverlapsBox(const Vector3& boxMin, const Vector3& boxMax) const;
+
+			/*
+			These match RayBoxIntersection and RaySphereIntersection, returning a
+			bit per ray that hits, with the distance to each hit in distances.
+			*/
+			int IntersectBox(const Vector3& boxPos, const Vector3& halfSize, float distances[Width]) const;
+			int IntersectSphere(const Vector3& centre, float radius, float distances[Width]) const;
+
+		protected:
+			alignas(16) float originX[Width];
+			alignas(16) float originY[Width];
+			alignas(16) float originZ[Width];
+			alignas(16) float dirX[Width];
+			alignas(16) float dirY[Width];
+			alignas(16) float dirZ[Width];
+			alignas(16) float invDirX[Width];
+			alignas(16) float invDirY[Width];
+			alignas(16) float invDirZ[Width];
+			alignas(16) float maxDistance[Width];
+			int activeMask;
+		};
+	}
+}
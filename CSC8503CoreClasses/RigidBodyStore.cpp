@@ -0,0 +1,460 @@
+#include "RigidBodyStore.h"
+#include "Transform.h"
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RIGIDBODY_USE_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace NCL;
+using namespace NCL::CSC8503;
+
+RigidBodyStore::RigidBodyStore() {
+	capacity = 0;
+}
+
+RigidBodyStore::~RigidBodyStore() {
+}
+
+int RigidBodyStore::AddBody(Transform* transform, PhysicsObject* owner) {
+	if (freeSlots.empty()) {
+		Grow();
+	}
+	int slot = freeSlots.back();
+	freeSlots.pop_back();
+	ResetSlot(slot);
+	transforms[slot]	= transform;
+	owners[slot]		= owner;
+	return slot;
+}
+
+void RigidBodyStore::RemoveBody(int slot) {
+	ResetSlot(slot);
+	freeSlots.push_back(slot);
+}
+
+int RigidBodyStore::MoveBody(RigidBodyStore& from, int fromSlot) {
+	int slot = AddBody(from.transforms[fromSlot], from.owners[fromSlot]);
+
+	std::vector<std::vector<float>*> source;
+	from.ForEachArray([&](std::vector<float>& a) {
+		source.push_back(&a);
+	});
+	int i = 0;
+	ForEachArray([&](std::vector<float>& a) {
+		a[slot] = (*source[i++])[fromSlot];
+	});
+	asleep[slot] = from.asleep[fromSlot];
+
+	from.RemoveBody(fromSlot);
+	return slot;
+}
+
+void RigidBodyStore::Grow() {
+	int oldCapacity = capacity;
+	capacity = std::max(16, capacity * 2); //always a multiple of 4, for the SSE kernels
+
+	ForEachArray([&](std::vector<float>& a) {
+		a.resize(capacity, 0.0f);
+	});
+	transforms.resize(capacity, nullptr);
+	owners.resize(capacity, nullptr);
+	active.resize(capacity, 0);
+	asleep.resize(capacity, 0);
+
+	//Hand out the lowest slots first
+	for (int i = capacity - 1; i >= oldCapacity; --i) {
+		ResetSlot(i);
+		freeSlots.push_back(i);
+	}
+}
+
+void RigidBodyStore::ResetSlot(int slot) {
+	transforms[slot]	= nullptr;
+	owners[slot]		= nullptr;
+	active[slot]		= 0;
+
+	posX[slot] = posY[slot] = posZ[slot] = 0.0f;
+	rotX[slot] = rotY[slot] = rotZ[slot] = 0.0f;
+	rotW[slot] = 1.0f;
+
+	linVelX[slot] = linVelY[slot] = linVelZ[slot] = 0.0f;
+	angVelX[slot] = angVelY[slot] = angVelZ[slot] = 0.0f;
+	ClearForces(slot);
+
+	inverseMass[slot] = 1.0f;
+	inertiaX[slot] = inertiaY[slot] = inertiaZ[slot] = 0.0f;
+
+	tensorXX[slot] = tensorYY[slot] = tensorZZ[slot] = 1.0f;
+	tensorXY[slot] = tensorXZ[slot] = tensorYZ[slot] = 0.0f;
+
+	Wake(slot);
+}
+
+void RigidBodyStore::Sleep(int slot) {
+	asleep[slot] = 1;
+	transforms[slot]->ResetInterpolation();
+	linVelX[slot] = linVelY[slot] = linVelZ[slot] = 0.0f;
+	angVelX[slot] = angVelY[slot] = angVelZ[slot] = 0.0f;
+}
+
+float RigidBodyStore::UpdateSleepTimer(int slot, float dt, float linearThreshold, float angularThreshold) {
+	float linSq = linVelX[slot] * linVelX[slot] + linVelY[slot] * linVelY[slot] + linVelZ[slot] * linVelZ[slot];
+	float angSq = angVelX[slot] * angVelX[slot] + angVelY[slot] * angVelY[slot] + angVelZ[slot] * angVelZ[slot];
+
+	if (linSq > linearThreshold * linearThreshold || angSq > angularThreshold * angularThreshold) {
+		sleepTimer[slot] = 0.0f;
+	}
+	else {
+		sleepTimer[slot] += dt;
+	}
+	return sleepTimer[slot];
+}
+
+Matrix3 RigidBodyStore::GetInertiaTensor(int slot) const {
+	Matrix3 m;
+	m.array[0][0] = tensorXX[slot];
+	m.array[1][1] = tensorYY[slot];
+	m.array[2][2] = tensorZZ[slot];
+	m.array[0][1] = m.array[1][0] = tensorXY[slot];
+	m.array[0][2] = m.array[2][0] = tensorXZ[slot];
+	m.array[1][2] = m.array[2][1] = tensorYZ[slot];
+	return m;
+}
+
+void RigidBodyStore::UpdateInertiaTensor(int slot) {
+	Quaternion q = transforms[slot] ? transforms[slot]->GetOrientation() : Quaternion();
+	rotX[slot] = q.x;
+	rotY[slot] = q.y;
+	rotZ[slot] = q.z;
+	rotW[slot] = q.w;
+	ComputeInertiaTensor(slot);
+}
+
+void RigidBodyStore::ClearForces(int slot) {
+	forceX[slot]  = forceY[slot]  = forceZ[slot]  = 0.0f;
+	torqueX[slot] = torqueY[slot] = torqueZ[slot] = 0.0f;
+}
+
+void RigidBodyStore::ClearForces() {
+	std::fill(forceX.begin(), forceX.end(), 0.0f);
+	std::fill(forceY.begin(), forceY.end(), 0.0f);
+	std::fill(forceZ.begin(), forceZ.end(), 0.0f);
+	std::fill(torqueX.begin(), torqueX.end(), 0.0f);
+	std::fill(torqueY.begin(), torqueY.end(), 0.0f);
+	std::fill(torqueZ.begin(), torqueZ.end(), 0.0f);
+}
+
+void RigidBodyStore::SaveState(RigidBodyState& state) {
+	//only the active bodies' positions are kept up to date in here
+	for (int i = 0; i < capacity; ++i) {
+		if (transforms[i]) {
+			const Vector3&		p = transforms[i]->GetPosition();
+			const Quaternion&	q = transforms[i]->GetOrientation();
+			posX[i] = p.x; posY[i] = p.y; posZ[i] = p.z;
+			rotX[i] = q.x; rotY[i] = q.y; rotZ[i] = q.z; rotW[i] = q.w;
+		}
+	}
+	state.capacity		= capacity;
+	state.transforms	= transforms;
+	state.asleep		= asleep;
+	state.data.resize(0);
+	ForEachArray([&](std::vector<float>& a) {
+		state.data.insert(state.data.end(), a.begin(), a.end());
+	});
+}
+
+void RigidBodyStore::RestoreState(const RigidBodyState& state) {
+	int count = std::min(capacity, state.capacity);
+	bool sameBodies = capacity == state.capacity && transforms == state.transforms;
+
+	const float* source = state.data.data();
+	ForEachArray([&](std::vector<float>& a) {
+		if (sameBodies) {
+			memcpy(a.data(), source, capacity * sizeof(float));
+		}
+		else {
+			for (int i = 0; i < count; ++i) {
+				if (transforms[i] && transforms[i] == state.transforms[i]) {
+					a[i] = source[i];
+				}
+			}
+		}
+		source += state.capacity;
+	});
+	for (int i = 0; i < count; ++i) {
+		if (transforms[i] && transforms[i] == state.transforms[i]) {
+			asleep[i] = state.asleep[i];
+			transforms[i]->SetPosition(Vector3(posX[i], posY[i], posZ[i]));
+			transforms[i]->SetOrientation(Quaternion(rotX[i], rotY[i], rotZ[i], rotW[i]));
+		}
+	}
+}
+
+void RigidBodyStore::ClearActive() {
+	std::fill(active.begin(), active.end(), 0u);
+}
+
+void RigidBodyStore::GatherTransforms() {
+	for (int i = 0; i < capacity; ++i) {
+		if (!active[i]) {
+			continue;
+		}
+		const Vector3&		p = transforms[i]->GetPosition();
+		const Quaternion&	q = transforms[i]->GetOrientation();
+		posX[i] = p.x; posY[i] = p.y; posZ[i] = p.z;
+		rotX[i] = q.x; rotY[i] = q.y; rotZ[i] = q.z; rotW[i] = q.w;
+	}
+}
+
+void RigidBodyStore::ScatterTransforms() {
+	for (int i = 0; i < capacity; ++i) {
+		if (!active[i]) {
+			continue;
+		}
+		transforms[i]->StepTo(Vector3(posX[i], posY[i], posZ[i]), Quaternion(rotX[i], rotY[i], rotZ[i], rotW[i]));
+	}
+}
+
+/*
+The world space inverse inertia tensor is R * I * R^T, where R is the
+rotation matrix of the body's orientation, and I is the diagonal local
+inverse inertia. As it's symmetric, Tij = sum over k of Rik * Ik * Rjk.
+*/
+void RigidBodyStore::ComputeInertiaTensor(int i) {
+	float x = rotX[i], y = rotY[i], z = rotZ[i], w = rotW[i];
+
+	float r00 = 1 - 2 * y * y - 2 * z * z;
+	float r01 = 2 * x * y - 2 * z * w;
+	float r02 = 2 * x * z + 2 * y * w;
+	float r10 = 2 * x * y + 2 * z * w;
+	float r11 = 1 - 2 * x * x - 2 * z * z;
+	float r12 = 2 * y * z - 2 * x * w;
+	float r20 = 2 * x * z - 2 * y * w;
+	float r21 = 2 * y * z + 2 * x * w;
+	float r22 = 1 - 2 * x * x - 2 * y * y;
+
+	float ix = inertiaX[i], iy = inertiaY[i], iz = inertiaZ[i];
+
+	tensorXX[i] = r00 * ix * r00 + r01 * iy * r01 + r02 * iz * r02;
+	tensorYY[i] = r10 * ix * r10 + r11 * iy * r11 + r12 * iz * r12;
+	tensorZZ[i] = r20 * ix * r20 + r21 * iy * r21 + r22 * iz * r22;
+	tensorXY[i] = r00 * ix * r10 + r01 * iy * r11 + r02 * iz * r12;
+	tensorXZ[i] = r00 * ix * r20 + r01 * iy * r21 + r02 * iz * r22;
+	tensorYZ[i] = r10 * ix * r20 + r11 * iy * r21 + r12 * iz * r22;
+}
+
+void RigidBodyStore::IntegrateAccelScalar(int begin, int end, float dt, const Vector3& gravity, bool applyGravity) {
+	for (int i = begin; i < end; ++i) {
+		ComputeInertiaTensor(i);
+		if (!active[i]) {
+			continue;
+		}
+		float invMass = inverseMass[i];
+		Vector3 accel(forceX[i] * invMass, forceY[i] * invMass, forceZ[i] * invMass);
+		if (applyGravity && invMass > 0) {
+			accel += gravity; //don't move infinitely heavy things
+		}
+		linVelX[i] += accel.x * dt;
+		linVelY[i] += accel.y * dt;
+		linVelZ[i] += accel.z * dt;
+
+		float tx = torqueX[i], ty = torqueY[i], tz = torqueZ[i];
+		angVelX[i] += (tensorXX[i] * tx + tensorXY[i] * ty + tensorXZ[i] * tz) * dt;
+		angVelY[i] += (tensorXY[i] * tx + tensorYY[i] * ty + tensorYZ[i] * tz) * dt;
+		angVelZ[i] += (tensorXZ[i] * tx + tensorYZ[i] * ty + tensorZZ[i] * tz) * dt;
+	}
+}
+
+/*
+Orientation is integrated as q' = q + (0.5 * w * dt) * q, treating the
+angular velocity w as a pure quaternion, and then renormalised.
+*/
+void RigidBodyStore::IntegrateVelocityScalar(int begin, int end, float dt, float linearDamping, float angularDamping) {
+	for (int i = begin; i < end; ++i) {
+		if (!active[i]) {
+			continue;
+		}
+		posX[i] += linVelX[i] * dt;
+		posY[i] += linVelY[i] * dt;
+		posZ[i] += linVelZ[i] * dt;
+
+		linVelX[i] *= linearDamping;
+		linVelY[i] *= linearDamping;
+		linVelZ[i] *= linearDamping;
+
+		float ax = angVelX[i] * dt * 0.5f;
+		float ay = angVelY[i] * dt * 0.5f;
+		float az = angVelZ[i] * dt * 0.5f;
+
+		float qx = rotX[i], qy = rotY[i], qz = rotZ[i], qw = rotW[i];
+
+		float x = qx + ax * qw + ay * qz - az * qy;
+		float y = qy + ay * qw + az * qx - ax * qz;
+		float z = qz + az * qw + ax * qy - ay * qx;
+		float w = qw - (ax * qx + ay * qy + az * qz);
+
+		float magnitude = sqrt(x * x + y * y + z * z + w * w);
+		if (magnitude > 0.0f) {
+			float t = 1.0f / magnitude;
+			x *= t; y *= t; z *= t; w *= t;
+		}
+		rotX[i] = x; rotY[i] = y; rotZ[i] = z; rotW[i] = w;
+
+		angVelX[i] *= angularDamping;
+		angVelY[i] *= angularDamping;
+		angVelZ[i] *= angularDamping;
+	}
+}
+
+#ifdef RIGIDBODY_USE_SSE
+namespace {
+	//Picks b where the mask is set, and a where it isn't
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+	}
+
+	inline __m128 Load(const std::vector<float>& v, int i) {
+		return _mm_loadu_ps(&v[i]);
+	}
+
+	inline void Store(std::vector<float>& v, int i, __m128 value) {
+		_mm_storeu_ps(&v[i], value);
+	}
+}
+
+void RigidBodyStore::IntegrateAccel(float dt, const Vector3& gravity, bool applyGravity) {
+	const __m128 one	= _mm_set1_ps(1.0f);
+	const __m128 two	= _mm_set1_ps(2.0f);
+	const __m128 zero	= _mm_setzero_ps();
+	const __m128 vdt	= _mm_set1_ps(dt);
+	const __m128 gx		= _mm_set1_ps(applyGravity ? gravity.x : 0.0f);
+	const __m128 gy		= _mm_set1_ps(applyGravity ? gravity.y : 0.0f);
+	const __m128 gz		= _mm_set1_ps(applyGravity ? gravity.z : 0.0f);
+
+	for (int i = 0; i < capacity; i += 4) {
+		__m128 x = Load(rotX, i), y = Load(rotY, i), z = Load(rotZ, i), w = Load(rotW, i);
+
+		__m128 xx = _mm_mul_ps(two, _mm_mul_ps(x, x));
+		__m128 yy = _mm_mul_ps(two, _mm_mul_ps(y, y));
+		__m128 zz = _mm_mul_ps(two, _mm_mul_ps(z, z));
+		__m128 xy = _mm_mul_ps(two, _mm_mul_ps(x, y));
+		__m128 xz = _mm_mul_ps(two, _mm_mul_ps(x, z));
+		__m128 yz = _mm_mul_ps(two, _mm_mul_ps(y, z));
+		__m128 xw = _mm_mul_ps(two, _mm_mul_ps(x, w));
+		__m128 yw = _mm_mul_ps(two, _mm_mul_ps(y, w));
+		__m128 zw = _mm_mul_ps(two, _mm_mul_ps(z, w));
+
+		__m128 r00 = _mm_sub_ps(_mm_sub_ps(one, yy), zz);
+		__m128 r01 = _mm_sub_ps(xy, zw);
+		__m128 r02 = _mm_add_ps(xz, yw);
+		__m128 r10 = _mm_add_ps(xy, zw);
+		__m128 r11 = _mm_sub_ps(_mm_sub_ps(one, xx), zz);
+		__m128 r12 = _mm_sub_ps(yz, xw);
+		__m128 r20 = _mm_sub_ps(xz, yw);
+		__m128 r21 = _mm_add_ps(yz, xw);
+		__m128 r22 = _mm_sub_ps(_mm_sub_ps(one, xx), yy);
+
+		__m128 ix = Load(inertiaX, i), iy = Load(inertiaY, i), iz = Load(inertiaZ, i);
+
+		//R * I, then multiplied against the rows of R again
+		__m128 a00 = _mm_mul_ps(r00, ix), a01 = _mm_mul_ps(r01, iy), a02 = _mm_mul_ps(r02, iz);
+		__m128 a10 = _mm_mul_ps(r10, ix), a11 = _mm_mul_ps(r11, iy), a12 = _mm_mul_ps(r12, iz);
+		__m128 a20 = _mm_mul_ps(r20, ix), a21 = _mm_mul_ps(r21, iy), a22 = _mm_mul_ps(r22, iz);
+
+		__m128 txx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r00), _mm_mul_ps(a01, r01)), _mm_mul_ps(a02, r02));
+		__m128 tyy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, r10), _mm_mul_ps(a11, r11)), _mm_mul_ps(a12, r12));
+		__m128 tzz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a20, r20), _mm_mul_ps(a21, r21)), _mm_mul_ps(a22, r22));
+		__m128 txy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r10), _mm_mul_ps(a01, r11)), _mm_mul_ps(a02, r12));
+		__m128 txz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r20), _mm_mul_ps(a01, r21)), _mm_mul_ps(a02, r22));
+		__m128 tyz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, r20), _mm_mul_ps(a11, r21)), _mm_mul_ps(a12, r22));
+
+		Store(tensorXX, i, txx);
+		Store(tensorYY, i, tyy);
+		Store(tensorZZ, i, tzz);
+		Store(tensorXY, i, txy);
+		Store(tensorXZ, i, txz);
+		Store(tensorYZ, i, tyz);
+
+		__m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&active[i]));
+
+		//Linear - gravity only applies to things that can move
+		__m128 invMass		= Load(inverseMass, i);
+		__m128 hasMass		= _mm_cmpgt_ps(invMass, zero);
+		__m128 ax = _mm_add_ps(_mm_mul_ps(Load(forceX, i), invMass), _mm_and_ps(hasMass, gx));
+		__m128 ay = _mm_add_ps(_mm_mul_ps(Load(forceY, i), invMass), _mm_and_ps(hasMass, gy));
+		__m128 az = _mm_add_ps(_mm_mul_ps(Load(forceZ, i), invMass), _mm_and_ps(hasMass, gz));
+
+		__m128 vx = Load(linVelX, i), vy = Load(linVelY, i), vz = Load(linVelZ, i);
+		Store(linVelX, i, Select(mask, vx, _mm_add_ps(vx, _mm_mul_ps(ax, vdt))));
+		Store(linVelY, i, Select(mask, vy, _mm_add_ps(vy, _mm_mul_ps(ay, vdt))));
+		Store(linVelZ, i, Select(mask, vz, _mm_add_ps(vz, _mm_mul_ps(az, vdt))));
+
+		//Angular
+		__m128 tx = Load(torqueX, i), ty = Load(torqueY, i), tz = Load(torqueZ, i);
+		__m128 aax = _mm_add_ps(_mm_add_ps(_mm_mul_ps(txx, tx), _mm_mul_ps(txy, ty)), _mm_mul_ps(txz, tz));
+		__m128 aay = _mm_add_ps(_mm_add_ps(_mm_mul_ps(txy, tx), _mm_mul_ps(tyy, ty)), _mm_mul_ps(tyz, tz));
+		__m128 aaz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(txz, tx), _mm_mul_ps(tyz, ty)), _mm_mul_ps(tzz, tz));
+
+		__m128 wx = Load(angVelX, i), wy = Load(angVelY, i), wz = Load(angVelZ, i);
+		Store(angVelX, i, Select(mask, wx, _mm_add_ps(wx, _mm_mul_ps(aax, vdt))));
+		Store(angVelY, i, Select(mask, wy, _mm_add_ps(wy, _mm_mul_ps(aay, vdt))));
+		Store(angVelZ, i, Select(mask, wz, _mm_add_ps(wz, _mm_mul_ps(aaz, vdt))));
+	}
+}
+
+void RigidBodyStore::IntegrateVelocity(float dt, float linearDamping, float angularDamping) {
+	const __m128 zero		= _mm_setzero_ps();
+	const __m128 one		= _mm_set1_ps(1.0f);
+	const __m128 vdt		= _mm_set1_ps(dt);
+	const __m128 halfDt		= _mm_set1_ps(dt * 0.5f);
+	const __m128 linDamp	= _mm_set1_ps(linearDamping);
+	const __m128 angDamp	= _mm_set1_ps(angularDamping);
+
+	for (int i = 0; i < capacity; i += 4) {
+		__m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&active[i]));
+
+		__m128 vx = Load(linVelX, i), vy = Load(linVelY, i), vz = Load(linVelZ, i);
+		__m128 px = Load(posX, i), py = Load(posY, i), pz = Load(posZ, i);
+		Store(posX, i, Select(mask, px, _mm_add_ps(px, _mm_mul_ps(vx, vdt))));
+		Store(posY, i, Select(mask, py, _mm_add_ps(py, _mm_mul_ps(vy, vdt))));
+		Store(posZ, i, Select(mask, pz, _mm_add_ps(pz, _mm_mul_ps(vz, vdt))));
+
+		Store(linVelX, i, Select(mask, vx, _mm_mul_ps(vx, linDamp)));
+		Store(linVelY, i, Select(mask, vy, _mm_mul_ps(vy, linDamp)));
+		Store(linVelZ, i, Select(mask, vz, _mm_mul_ps(vz, linDamp)));
+
+		__m128 wx = Load(angVelX, i), wy = Load(angVelY, i), wz = Load(angVelZ, i);
+		__m128 ax = _mm_mul_ps(wx, halfDt), ay = _mm_mul_ps(wy, halfDt), az = _mm_mul_ps(wz, halfDt);
+
+		__m128 x = Load(rotX, i), y = Load(rotY, i), z = Load(rotZ, i), w = Load(rotW, i);
+
+		__m128 nx = _mm_add_ps(x, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ax, w), _mm_mul_ps(ay, z)), _mm_mul_ps(az, y)));
+		__m128 ny = _mm_add_ps(y, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ay, w), _mm_mul_ps(az, x)), _mm_mul_ps(ax, z)));
+		__m128 nz = _mm_add_ps(z, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(az, w), _mm_mul_ps(ax, y)), _mm_mul_ps(ay, x)));
+		__m128 nw = _mm_sub_ps(w, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, x), _mm_mul_ps(ay, y)), _mm_mul_ps(az, z)));
+
+		__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+									   _mm_add_ps(_mm_mul_ps(nz, nz), _mm_mul_ps(nw, nw))));
+		__m128 scale = Select(_mm_cmpgt_ps(magnitude, zero), one, _mm_div_ps(one, magnitude));
+
+		Store(rotX, i, Select(mask, x, _mm_mul_ps(nx, scale)));
+		Store(rotY, i, Select(mask, y, _mm_mul_ps(ny, scale)));
+		Store(rotZ, i, Select(mask, z, _mm_mul_ps(nz, scale)));
+		Store(rotW, i, Select(mask, w, _mm_mul_ps(nw, scale)));
+
+		Store(angVelX, i, Select(mask, wx, _mm_mul_ps(wx, angDamp)));
+		Store(angVelY, i, Select(mask, wy, _mm_mul_ps(wy, angDamp)));
+		Store(angVelZ, i, Select(mask, wz, _mm_mul_ps(wz, angDamp)));
+	}
+}
+#else
+void RigidBodyStore::IntegrateAccel(float dt, const Vector3& gravity, bool applyGravity) {
+	IntegrateAccelScalar(0, capacity, dt, gravity, applyGravity);
+}
+
+void RigidBodyStore::IntegrateVelocity(float dt, float linearDamping, float angularDamping) {
+	IntegrateVelocityScalar(0, capacity, dt, linearDamping, angularDamping);
+}
+#endif
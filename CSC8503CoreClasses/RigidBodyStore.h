@@ -0,0 +1,210 @@
+#pragma once
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace CSC8503 {
+		class Transform;
+		class PhysicsObject;
+
+		/*
+		A copy of the whole store, for rolling the simulation back. Every
+		float array is copied out end to end into one buffer, so saving is a
+		memcpy per array, and so is restoring, unless bodies have come or
+		gone since. Transform positions and orientations are included, as
+		they're the other half of a body's state.
+		*/
+		struct RigidBodyState {
+			int							capacity = 0;
+			std::vector<Transform*>		transforms;
+			std::vector<float>			data;
+			std::vector<unsigned char>	asleep;
+		};
+
+		/*
+		Holds the simulation state of every PhysicsObject as a structure of
+		arrays, so that the integration steps can run straight down a few
+		contiguous float arrays (4 bodies at a time with SSE), instead of
+		chasing a GameObject, PhysicsObject and Transform pointer per body.
+
+		Each PhysicsSystem has a store of its own, and each PhysicsObject owns a
+		slot in one - its own private store to begin with, until a PhysicsSystem
+		finds it in the world and moves it across. Its getters and setters just
+		read and write that slot. Positions and
+		orientations still belong to the Transform, so the PhysicsSystem
+		gathers them in before integrating, and scatters them back after.
+
+		Only slots marked active (ie. their object is in the world being
+		simulated) are changed by the integration kernels. The arrays are
+		always padded out to a multiple of 4, with the padding inactive.
+		*/
+		class RigidBodyStore	{
+		public:
+			RigidBodyStore();
+			~RigidBodyStore();
+
+			int		AddBody(Transform* transform, PhysicsObject* owner);
+			void	RemoveBody(int slot);
+
+			//Takes a body (and all of its state) out of another store, returning its new slot
+			int		MoveBody(RigidBodyStore& from, int fromSlot);
+
+			int GetCapacity() const {
+				return capacity;
+			}
+
+			//The object whose body is in the slot, or nullptr if the slot's free
+			PhysicsObject* GetOwner(int slot) const {
+				return owners[slot];
+			}
+
+			Vector3 GetLinearVelocity(int slot) const {
+				return Vector3(linVelX[slot], linVelY[slot], linVelZ[slot]);
+			}
+			void SetLinearVelocity(int slot, const Vector3& v) {
+				linVelX[slot] = v.x; linVelY[slot] = v.y; linVelZ[slot] = v.z;
+			}
+
+			Vector3 GetAngularVelocity(int slot) const {
+				return Vector3(angVelX[slot], angVelY[slot], angVelZ[slot]);
+			}
+			void SetAngularVelocity(int slot, const Vector3& v) {
+				angVelX[slot] = v.x; angVelY[slot] = v.y; angVelZ[slot] = v.z;
+			}
+
+			Vector3 GetForce(int slot) const {
+				return Vector3(forceX[slot], forceY[slot], forceZ[slot]);
+			}
+			void AddForce(int slot, const Vector3& f) {
+				forceX[slot] += f.x; forceY[slot] += f.y; forceZ[slot] += f.z;
+			}
+
+			Vector3 GetTorque(int slot) const {
+				return Vector3(torqueX[slot], torqueY[slot], torqueZ[slot]);
+			}
+			void AddTorque(int slot, const Vector3& t) {
+				torqueX[slot] += t.x; torqueY[slot] += t.y; torqueZ[slot] += t.z;
+			}
+
+			float GetInverseMass(int slot) const {
+				return inverseMass[slot];
+			}
+			void SetInverseMass(int slot, float invMass) {
+				inverseMass[slot] = invMass;
+			}
+
+			Vector3 GetInverseInertia(int slot) const {
+				return Vector3(inertiaX[slot], inertiaY[slot], inertiaZ[slot]);
+			}
+			void SetInverseInertia(int slot, const Vector3& i) {
+				inertiaX[slot] = i.x; inertiaY[slot] = i.y; inertiaZ[slot] = i.z;
+			}
+
+			//These don't wake the body - the solver uses them to push bodies apart
+			void ApplyLinearImpulse(int slot, const Vector3& impulse) {
+				linVelX[slot] += impulse.x * inverseMass[slot];
+				linVelY[slot] += impulse.y * inverseMass[slot];
+				linVelZ[slot] += impulse.z * inverseMass[slot];
+			}
+			void ApplyAngularImpulse(int slot, const Vector3& impulse) {
+				angVelX[slot] += tensorXX[slot] * impulse.x + tensorXY[slot] * impulse.y + tensorXZ[slot] * impulse.z;
+				angVelY[slot] += tensorXY[slot] * impulse.x + tensorYY[slot] * impulse.y + tensorYZ[slot] * impulse.z;
+				angVelZ[slot] += tensorXZ[slot] * impulse.x + tensorYZ[slot] * impulse.y + tensorZZ[slot] * impulse.z;
+			}
+
+			Matrix3 GetInertiaTensor(int slot) const;
+			void	UpdateInertiaTensor(int slot);
+
+			void ClearForces(int slot);
+			void ClearForces();
+
+			/*
+			Sleeping bodies are left out of the active set, so don't get
+			integrated. Putting a body to sleep zeroes its velocities, so
+			that it's exactly where it was left when it wakes up again.
+			*/
+			bool IsAsleep(int slot) const {
+				return asleep[slot] != 0;
+			}
+			void Sleep(int slot);
+			void Wake(int slot) {
+				asleep[slot]		= 0;
+				sleepTimer[slot]	= 0.0f;
+			}
+
+			//How long the body has been moving slower than the given thresholds
+			float UpdateSleepTimer(int slot, float dt, float linearThreshold, float angularThreshold);
+
+			void ClearActive();
+			void SetActive(int slot) {
+				active[slot] = ~0u;
+			}
+			bool IsActive(int slot) const {
+				return active[slot] != 0;
+			}
+
+			//Copies the active bodies' Transform positions and orientations in / out
+			void GatherTransforms();
+			void ScatterTransforms();
+
+			void IntegrateAccel(float dt, const Vector3& gravity, bool applyGravity);
+			void IntegrateVelocity(float dt, float linearDamping, float angularDamping);
+
+			/*
+			Restoring only touches slots that still belong to the same Transform
+			as when the state was saved, so bodies added or removed since then
+			are left as they are.
+			*/
+			void SaveState(RigidBodyState& state);
+			void RestoreState(const RigidBodyState& state);
+
+		protected:
+			void Grow();
+
+			//Every per-body float array, in a fixed order
+			template<class F>
+			void ForEachArray(F func) {
+				std::vector<float>* arrays[] = {
+					&posX, &posY, &posZ,
+					&rotX, &rotY, &rotZ, &rotW,
+					&linVelX, &linVelY, &linVelZ,
+					&angVelX, &angVelY, &angVelZ,
+					&forceX, &forceY, &forceZ,
+					&torqueX, &torqueY, &torqueZ,
+					&inverseMass,
+					&inertiaX, &inertiaY, &inertiaZ,
+					&tensorXX, &tensorYY, &tensorZZ, &tensorXY, &tensorXZ, &tensorYZ,
+					&sleepTimer
+				};
+				for (auto a : arrays) {
+					func(*a);
+				}
+			}
+			void ResetSlot(int slot);
+			void ComputeInertiaTensor(int slot);
+
+			void IntegrateAccelScalar(int begin, int end, float dt, const Vector3& gravity, bool applyGravity);
+			void IntegrateVelocityScalar(int begin, int end, float dt, float linearDamping, float angularDamping);
+
+			int							capacity;
+			std::vector<int>			freeSlots;
+			std::vector<Transform*>		transforms;
+			std::vector<PhysicsObject*>	owners;
+			std::vector<unsigned int>	active;
+
+			std::vector<float> posX, posY, posZ;
+			std::vector<float> rotX, rotY, rotZ, rotW;
+			std::vector<float> linVelX, linVelY, linVelZ;
+			std::vector<float> angVelX, angVelY, angVelZ;
+			std::vector<float> forceX, forceY, forceZ;
+			std::vector<float> torqueX, torqueY, torqueZ;
+			std::vector<float> inverseMass;
+			std::vector<float> inertiaX, inertiaY, inertiaZ;
+
+			std::vector<float>			sleepTimer;
+			std::vector<unsigned char>	asleep;
+
+			//World space inverse inertia tensor - it's symmetric, so only 6 values are needed
+			std::vector<float> tensorXX, tensorYY, tensorZZ, tensorXY, tensorXZ, tensorYZ;
+		};
+	}
+}
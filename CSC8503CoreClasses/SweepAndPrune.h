@@ -0,0 +1,263 @@
+#pragma once
+
+#include "DynamicAABBTree.h"
+#include "PairCache.h"
+
+namespace NCL {
+    using namespace NCL::Maths;
+    namespace CSC8503 {
+        /*
+        Sort and sweep broadphase, with the sorted endpoint lists kept between
+        updates. Objects barely change order from one physics step to the next,
+        so the insertion sort used to fix the lists up is close to linear.
+
+        Every time a min endpoint crosses a max endpoint we know an overlap on
+        that axis has either started or stopped, which lets us emit begin and
+        end events for pairs directly, rather than having to diff pair lists.
+
+        With a single axis, pairs are only tracked on the x axis, and so are
+        a coarser (but cheaper to maintain) set of candidates.
+        */
+        template<class T>
+        class SweepAndPrune {
+        public:
+            static const int NullProxy = -1;
+
+            struct PairEvent {
+                T       a;
+                T       b;
+                bool    begin;
+            };
+
+            SweepAndPrune(int axisCount = 3) {
+                numAxes = std::max(1, std::min(axisCount, 3));
+            }
+
+            ~SweepAndPrune() {
+            }
+
+            void Clear() {
+                for (int i = 0; i < 3; ++i) {
+                    endpoints[i].clear();
+                }
+                proxies.clear();
+                freeProxies.clear();
+                pairs.Clear();
+                events.clear();
+            }
+
+            int CreateProxy(const TreeAABB& box, T object) {
+                int proxy;
+                if (freeProxies.empty()) {
+                    proxy = (int)proxies.size();
+                    proxies.emplace_back();
+                }
+                else {
+                    proxy = freeProxies.back();
+                    freeProxies.pop_back();
+                }
+                Proxy& p    = proxies[proxy];
+                p.box       = box;
+                p.object    = object;
+                p.inUse     = true;
+
+                //Add the endpoints onto the end of each axis, and let them sort down into place
+                for (int axis = 0; axis < numAxes; ++axis) {
+                    std::vector<Endpoint>& list = endpoints[axis];
+                    p.minIndex[axis] = (int)list.size();
+                    list.push_back({ box.min[axis], proxy, false });
+                    p.maxIndex[axis] = (int)list.size();
+                    list.push_back({ box.max[axis], proxy, true });
+
+                    SortMinDown(axis, p.minIndex[axis]);
+                    SortMaxDown(axis, proxies[proxy].maxIndex[axis]);
+                }
+                return proxy;
+            }
+
+            void DestroyProxy(int proxy) {
+                Proxy& p = proxies[proxy];
+                for (int axis = 0; axis < numAxes; ++axis) {
+                    std::vector<Endpoint>& list = endpoints[axis];
+                    //Remove the max first, so the min index is still valid
+                    list.erase(list.begin() + p.maxIndex[axis]);
+                    list.erase(list.begin() + p.minIndex[axis]);
+                    for (int i = p.minIndex[axis]; i < (int)list.size(); ++i) {
+                        SetIndex(axis, i);
+                    }
+                }
+                pairs.RemoveIf([&](const PairCache<bool>::Entry& e) {
+                    int a = e.FirstID();
+                    int b = e.SecondID();
+                    if (a != proxy && b != proxy) {
+                        return false;
+                    }
+                    events.push_back({ proxies[a].object, proxies[b].object, false });
+                    return true;
+                });
+                p.inUse = false;
+                freeProxies.push_back(proxy);
+            }
+
+            void MoveProxy(int proxy, const TreeAABB& box) {
+                TreeAABB oldBox = proxies[proxy].box;
+                proxies[proxy].box = box;
+
+                for (int axis = 0; axis < numAxes; ++axis) {
+                    Proxy& p = proxies[proxy];
+                    endpoints[axis][p.minIndex[axis]].value = box.min[axis];
+                    endpoints[axis][p.maxIndex[axis]].value = box.max[axis];
+
+                    //Grow outwards before shrinking in, so min stays before max
+                    if (box.min[axis] < oldBox.min[axis]) {
+                        SortMinDown(axis, p.minIndex[axis]);
+                    }
+                    if (box.max[axis] > oldBox.max[axis]) {
+                        SortMaxUp(axis, proxies[proxy].maxIndex[axis]);
+                    }
+                    if (box.min[axis] > oldBox.min[axis]) {
+                        SortMinUp(axis, proxies[proxy].minIndex[axis]);
+                    }
+                    if (box.max[axis] < oldBox.max[axis]) {
+                        SortMaxDown(axis, proxies[proxy].maxIndex[axis]);
+                    }
+                }
+            }
+
+            T GetObject(int proxy) const {
+                return proxies[proxy].object;
+            }
+
+            const TreeAABB& GetAABB(int proxy) const {
+                return proxies[proxy].box;
+            }
+
+            int GetPairCount() const {
+                return (int)pairs.size();
+            }
+
+            //Begin / end events since the last call to ClearEvents, in the order they happened
+            const std::vector<PairEvent>& GetEvents() const {
+                return events;
+            }
+
+            void ClearEvents() {
+                events.clear();
+            }
+
+        protected:
+            struct Endpoint {
+                float   value;
+                int     proxy;
+                bool    isMax;
+            };
+
+            struct Proxy {
+                TreeAABB    box;
+                T           object;
+                int         minIndex[3];
+                int         maxIndex[3];
+                bool        inUse = false;
+            };
+
+            void SetIndex(int axis, int index) {
+                const Endpoint& e = endpoints[axis][index];
+                if (e.isMax) {
+                    proxies[e.proxy].maxIndex[axis] = index;
+                }
+                else {
+                    proxies[e.proxy].minIndex[axis] = index;
+                }
+            }
+
+            void Swap(int axis, int i, int j) {
+                std::swap(endpoints[axis][i], endpoints[axis][j]);
+                SetIndex(axis, i);
+                SetIndex(axis, j);
+            }
+
+            bool Overlapping(int a, int b) const {
+                const TreeAABB& boxA = proxies[a].box;
+                const TreeAABB& boxB = proxies[b].box;
+                for (int axis = 0; axis < numAxes; ++axis) {
+                    if (boxA.min[axis] > boxB.max[axis] || boxA.max[axis] < boxB.min[axis]) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            void BeginPair(int a, int b) {
+                if (!Overlapping(a, b)) {
+                    return;
+                }
+                bool isNew;
+                pairs.Insert(a, b, 0, isNew);
+                if (isNew) {
+                    events.push_back({ proxies[a].object, proxies[b].object, true });
+                }
+            }
+
+            void EndPair(int a, int b) {
+                if (!Overlapping(a, b) && pairs.Remove(a, b)) {
+                    events.push_back({ proxies[a].object, proxies[b].object, false });
+                }
+            }
+
+            //A min moving down past a max means a new overlap on this axis
+            void SortMinDown(int axis, int index) {
+                std::vector<Endpoint>& list = endpoints[axis];
+                while (index > 0 && list[index - 1].value > list[index].value) {
+                    if (list[index - 1].isMax) {
+                        BeginPair(list[index].proxy, list[index - 1].proxy);
+                    }
+                    Swap(axis, index - 1, index);
+                    index--;
+                }
+            }
+
+            //A max moving up past a min means a new overlap on this axis
+            void SortMaxUp(int axis, int index) {
+                std::vector<Endpoint>& list = endpoints[axis];
+                while (index < (int)list.size() - 1 && list[index + 1].value < list[index].value) {
+                    if (!list[index + 1].isMax) {
+                        BeginPair(list[index].proxy, list[index + 1].proxy);
+                    }
+                    Swap(axis, index, index + 1);
+                    index++;
+                }
+            }
+
+            //A min moving up past a max means an overlap on this axis has ended
+            void SortMinUp(int axis, int index) {
+                std::vector<Endpoint>& list = endpoints[axis];
+                while (index < (int)list.size() - 1 && list[index + 1].value < list[index].value) {
+                    if (list[index + 1].isMax) {
+                        EndPair(list[index].proxy, list[index + 1].proxy);
+                    }
+                    Swap(axis, index, index + 1);
+                    index++;
+                }
+            }
+
+            //A max moving down past a min means an overlap on this axis has ended
+            void SortMaxDown(int axis, int index) {
+                std::vector<Endpoint>& list = endpoints[axis];
+                while (index > 0 && list[index - 1].value > list[index].value) {
+                    if (!list[index - 1].isMax) {
+                        EndPair(list[index].proxy, list[index - 1].proxy);
+                    }
+                    Swap(axis, index - 1, index);
+                    index--;
+                }
+            }
+
+            int                                     numAxes;
+            std::vector<Endpoint>                   endpoints[3];
+            std::vector<Proxy>                      proxies;
+            std::vector<int>                        freeProxies;
+            PairCache<bool>                         pairs;
+            std::vector<PairEvent>                  events;
+        };
+    }
+}
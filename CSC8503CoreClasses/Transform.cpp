@@ -19,6 +19,7 @@ void Transform::UpdateMatrix() {
 
 Transform& Transform::SetPosition(const Vector3& worldPos) {
     position = worldPos;
+    previousPosition = worldPos;
     UpdateMatrix();
     return *this;
 }
@@ -31,6 +32,38 @@ Transform& Transform::SetScale(const Vector3& worldScale) {
 
 Transform& Transform::SetOrientation(const Quaternion& worldOrientation) {
     orientation = worldOrientation;
+    previousOrientation = worldOrientation;
     UpdateMatrix();
     return *this;
+}
+
+/*
+Setting the position or orientation directly is a teleport, so snaps
+the previous state too. The physics system instead steps transforms
+forwards, so that the renderer can blend between the last two fixed
+steps, rather than objects stuttering whenever the frame rate and the
+physics rate don't line up.
+*/
+Transform& Transform::StepTo(const Vector3& worldPos, const Quaternion& worldOrientation) {
+    previousPosition    = position;
+    previousOrientation = orientation;
+    position            = worldPos;
+    orientation         = worldOrientation;
+    UpdateMatrix();
+    return *this;
+}
+
+void Transform::ResetInterpolation() {
+    previousPosition    = position;
+    previousOrientation = orientation;
+}
+
+Matrix4 Transform::GetInterpolatedMatrix(float alpha) const {
+    if (alpha >= 1.0f) {
+        return matrix;
+    }
+    Vector3 pos = previousPosition + (position - previousPosition) * alpha;
+    Quaternion q = Quaternion::Lerp(previousOrientation, orientation, alpha);
+    q.Normalise();
+    return Matrix4::Translation(pos) * Matrix4(q) * Matrix4::Scale(scale);
 }
\ No newline at end of file
@@ -16,6 +16,12 @@ namespace NCL {
             Transform& SetScale(const Vector3& worldScale);
             Transform& SetOrientation(const Quaternion& newOr);
 
+            //Moves on to a new simulated state, keeping the old one to interpolate from
+            Transform& StepTo(const Vector3& worldPos, const Quaternion& worldOrientation);
+            void ResetInterpolation();
+
+            Matrix4 GetInterpolatedMatrix(float alpha) const;
+
             Vector3 GetPosition() const {
                 return position;
             }
@@ -62,6 +68,9 @@ namespace NCL {
             Quaternion	orientation;
             Vector3		position;
 
+            Vector3		previousPosition;
+            Quaternion	previousOrientation;
+
             Vector3		scale;
 
             Vector3		forward;
@@ -0,0 +1,67 @@
+#include "TriangleMeshVolume.h"
+#include "CollisionDetection.h"
+#include "Mesh.h"
+
+using namespace NCL;
+using namespace NCL::Rendering;
+
+TriangleMeshVolume::TriangleMeshVolume(const Mesh& mesh, const Vector3& scale) : tree(0.0f) {
+	type = VolumeType::Mesh;
+
+	if (mesh.GetPrimitiveType() == GeometryPrimitive::Triangles) {
+		size_t triCount = mesh.GetPrimitiveCount();
+		triangles.reserve(triCount * 3);
+		for (unsigned int i = 0; i < triCount; ++i) {
+			Vector3 a, b, c;
+			if (mesh.GetTriangle(i, a, b, c)) {
+				triangles.push_back(a * scale);
+				triangles.push_back(b * scale);
+				triangles.push_back(c * scale);
+			}
+		}
+	}
+	BuildTree();
+}
+
+TriangleMeshVolume::TriangleMeshVolume(const std::vector<Vector3>& positions, const std::vector<unsigned int>& indices) : tree(0.0f) {
+	type = VolumeType::Mesh;
+
+	triangles.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		triangles.push_back(positions[indices[i]]);
+		triangles.push_back(positions[indices[i + 1]]);
+		triangles.push_back(positions[indices[i + 2]]);
+	}
+	BuildTree();
+}
+
+void TriangleMeshVolume::BuildTree() {
+	for (int i = 0; i < GetTriangleCount(); ++i) {
+		const Vector3* t = GetTriangle(i);
+		TreeAABB box(t[0], t[0]);
+		for (int j = 1; j < 3; ++j) {
+			box = TreeAABB::Merge(box, TreeAABB(t[j], t[j]));
+		}
+		tree.CreateProxy(box, i);
+
+		for (int j = 0; j < 3; ++j) {
+			halfSizes = Vector3(std::max(halfSizes.x, std::abs(t[j].x)), std::max(halfSizes.y, std::abs(t[j].y)), std::max(halfSizes.z, std::abs(t[j].z)));
+		}
+	}
+}
+
+bool TriangleMeshVolume::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, float& distance, Vector3& normal) const {
+	bool hit = false;
+	distance = maxDistance;
+	tree.RayQuery(origin, direction, maxDistance, [&](int proxy) {
+		const Vector3* t = GetTriangle(tree.GetObject(proxy));
+		float triDistance;
+		if (CollisionDetection::RayTriangleIntersection(origin, direction, t[0], t[1], t[2], triDistance) && triDistance < distance) {
+			distance	= triDistance;
+			normal		= Vector3::Cross(t[1] - t[0], t[2] - t[0]).Normalised();
+			hit			= true;
+		}
+		return distance;
+	});
+	return hit;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "CollisionVolume.h"
+#include "DynamicAABBTree.h"
+
+namespace NCL {
+	namespace Rendering {
+		class Mesh;
+	}
+	using namespace NCL::Maths;
+	using namespace NCL::CSC8503;
+
+	/*
+	A static collision volume made from a mesh's triangles, so level geometry
+	like the maze can be a single object, rather than hundreds of cubes. It
+	has no inside, so only makes sense on objects with an inverse mass of 0,
+	and two meshes never collide with each other.
+
+	The triangles get their own bounding volume tree, in the mesh's local
+	space, so a collision or raycast only has to look at the few triangles
+	near it. The tree is built once, with no fattening, as nothing moves.
+	*/
+	class TriangleMeshVolume : public CollisionVolume
+	{
+	public:
+		TriangleMeshVolume(const Rendering::Mesh& mesh, const Vector3& scale = Vector3(1, 1, 1));
+		TriangleMeshVolume(const std::vector<Vector3>& positions, const std::vector<unsigned int>& indices);
+		~TriangleMeshVolume() {
+
+		}
+
+		int GetTriangleCount() const {
+			return (int)triangles.size() / 3;
+		}
+
+		//Three local space vertices, one after the other
+		const Vector3* GetTriangle(int i) const {
+			return &triangles[i * 3];
+		}
+
+		Vector3 GetHalfDimensions() const {
+			return halfSizes;
+		}
+
+		//Calls func(triangle) for every triangle whose box overlaps the local space box
+		template<class F>
+		void QueryTriangles(const TreeAABB& localBox, F&& func) const {
+			tree.Query(localBox, [&](int proxy) {
+				func(tree.GetObject(proxy));
+				return true;
+			});
+		}
+
+		//Closest triangle hit by a ray in local space, if it's within maxDistance
+		bool RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, float& distance, Vector3& normal) const;
+
+	protected:
+		void BuildTree();
+
+		std::vector<Vector3>	triangles;
+		DynamicAABBTree<int>	tree;
+		Vector3					halfSizes;
+	};
+}